@@ -2,6 +2,7 @@
  * Ticket Reservation Client with Visual Seat Map
  * Usage: ./client [server_ip] [port]
  * Commands (case-insensitive): available/a, book n s1 s2..., cancel n s1 s2..., exit/q
+ * Any command except exit may name an event right after the command word: "book @2 1 5"
  */
 
 #include <stdio.h>
@@ -15,15 +16,71 @@
 
 #define DEFAULT_PORT 8080
 #define BUFFER_SIZE 1024
-#define MAX_SEATS 20
+#define DEFAULT_SEATS 20
+#define DEFAULT_ROW_WIDTH 5
+#define MAX_GRID_WIDTH 20   /* wider rows are summarised instead of drawn */
+#define MAX_GRID_ROWS 40    /* taller sections group rows into bands */
+
+struct section {
+    char name[32];
+    int first_seat, rows, row_width;
+};
+
+/* Venue layout from the server's LAYOUT reply (or the classic 4x5 map) */
+struct layout {
+    int event; /* 0 = server default */
+    int num_seats, num_sections;
+    struct section* sections;
+};
 
 void to_upper(char* str) {
     for (int i = 0; str[i]; i++) str[i] = toupper(str[i]);
 }
 
-void display_seat_map(char* response) {
-    int seats_status[MAX_SEATS + 1] = {0};
+int count_digits(int n) {
+    int d = 1;
+    while (n >= 10) n /= 10, d++;
+    return d;
+}
+
+void draw_grid(struct section* sec, const char* avail, int num_seats) {
+    int width = count_digits(sec->first_seat + sec->rows * sec->row_width - 1);
+    if (width < 2) width = 2;
+    printf("        ");
+    for (int col = 1; col <= sec->row_width; col++) printf("Col %d\t", col);
+    printf("\n");
+    
+    for (int row = 0; row < sec->rows; row++) {
+        printf("Row %d:  ", row + 1);
+        for (int col = 0; col < sec->row_width; col++) {
+            int seat = sec->first_seat + row * sec->row_width + col;
+            if (seat > num_seats) break;
+            if (avail[seat]) printf("[%*d]\t", width, seat);
+            else printf("[%*s]\t", width, "X");
+        }
+        printf("\n");
+    }
+}
+
+/* Too big to draw seat by seat: free counts per row, or per band of rows */
+void draw_summary(struct section* sec, const char* avail, int num_seats) {
+    int band = (sec->rows + MAX_GRID_ROWS - 1) / MAX_GRID_ROWS;
+    for (int row = 0; row < sec->rows; row += band) {
+        int last = row + band < sec->rows ? row + band : sec->rows;
+        int seat = sec->first_seat + row * sec->row_width;
+        int end = sec->first_seat + last * sec->row_width;
+        int free_count = 0, total = 0;
+        for (; seat < end && seat <= num_seats; seat++, total++) free_count += avail[seat];
+        if (band == 1) printf("Row %d:\t", row + 1);
+        else printf("Rows %d-%d:\t", row + 1, last);
+        printf("%d/%d available\n", free_count, total);
+    }
+}
+
+void display_seat_map(char* response, struct layout* layout) {
+    char* avail = calloc(layout->num_seats + 1, 1);
     int count = 0;
+    if (!avail) return;
     
     char* token = strtok(response, " \t\n");
     token = strtok(NULL, " \t\n");
@@ -31,32 +88,90 @@ void display_seat_map(char* response) {
     if (!token || strcmp(token, "NONE") == 0) {
         printf("\n\t\t* * * * * * * * * * * *   S\tC\tR\tE\tE\tN   * * * * * * * * * * * * *\n");
         printf("\nAll seats booked!\n\n");
+        free(avail);
         return;
     }
     
-    while (token && count < MAX_SEATS) {
+    while (token) {
         int seat = atoi(token);
-        if (seat >= 1 && seat <= MAX_SEATS) {
-            seats_status[seat] = 1;
+        if (seat >= 1 && seat <= layout->num_seats && !avail[seat]) {
+            avail[seat] = 1;
             count++;
         }
         token = strtok(NULL, " \t\n");
     }
     
     printf("\n\t\t* * * * * * * * * * * *   S\tC\tR\tE\tE\tN   * * * * * * * * * * * * *\n");
-    printf("\nSeat Map ([XX]=Available, [ X]=Booked):\n\n        ");
-    for (int col = 1; col <= 5; col++) printf("Col %d\t", col);
-    printf("\n");
-    
-    for (int row = 0; row < 4; row++) {
-        printf("Row %d:  ", row + 1);
-        for (int col = 0; col < 5; col++) {
-            int seat = row * 5 + col + 1;
-            printf(seats_status[seat] ? "[%2d]\t" : "[ X]\t", seat);
-        }
-        printf("\n");
+    printf("\nSeat Map ([XX]=Available, [ X]=Booked):\n\n");
+    for (int i = 0; i < layout->num_sections; i++) {
+        struct section* sec = &layout->sections[i];
+        if (layout->num_sections > 1) printf("Section %s:\n", sec->name);
+        if (sec->row_width <= MAX_GRID_WIDTH && sec->rows <= MAX_GRID_ROWS) draw_grid(sec, avail, layout->num_seats);
+        else draw_summary(sec, avail, layout->num_seats);
+        if (layout->num_sections > 1) printf("\n");
     }
     printf("\nAvailable: %d seats\n\n", count);
+    free(avail);
+}
+
+/* Read one newline-terminated response of any length; returns its length, 0 on close, -1 on error */
+ssize_t recv_line(int sock_fd, char** buffer, size_t* cap) {
+    size_t len = 0;
+    while (len == 0 || (*buffer)[len - 1] != '\n') {
+        if (len + BUFFER_SIZE + 1 > *cap) {
+            char* grown = realloc(*buffer, *cap * 2);
+            if (!grown) return -1;
+            *buffer = grown;
+            *cap *= 2;
+        }
+        ssize_t bytes = recv(sock_fd, *buffer + len, *cap - len - 1, 0);
+        if (bytes <= 0) return len ? (ssize_t)len : bytes;
+        len += bytes;
+    }
+    (*buffer)[len] = '\0';
+    return len;
+}
+
+/* Ask the server for its venue layout; older servers get the classic 4x5 map */
+void fetch_layout(int sock_fd, int event, struct layout* layout, char** buffer, size_t* cap) {
+    free(layout->sections);
+    layout->event = event;
+    layout->num_seats = DEFAULT_SEATS;
+    layout->num_sections = 1;
+    layout->sections = calloc(1, sizeof(struct section));
+    strcpy(layout->sections[0].name, "A");
+    layout->sections[0].first_seat = 1;
+    layout->sections[0].rows = DEFAULT_SEATS / DEFAULT_ROW_WIDTH;
+    layout->sections[0].row_width = DEFAULT_ROW_WIDTH;
+    
+    char request[32];
+    int len = event ? snprintf(request, sizeof(request), "LAYOUT @%d\n", event) : snprintf(request, sizeof(request), "LAYOUT\n");
+    if (send(sock_fd, request, len, 0) < 0 || recv_line(sock_fd, buffer, cap) <= 0) return;
+    if (strncmp(*buffer, "LAYOUT ", 7) != 0) return;
+    
+    int num_seats, sections = 0;
+    for (char* p = *buffer; *p; p++) sections += *p == ':';
+    sections /= 3;
+    if (sscanf(*buffer + 7, "%d", &num_seats) != 1 || num_seats <= 0 || sections <= 0) return;
+    struct section* secs = calloc(sections, sizeof(*secs));
+    if (!secs) return;
+    
+    char* token = strtok(*buffer + 7, " \n");
+    int n = 0;
+    while ((token = strtok(NULL, " \n")) && n < sections) {
+        char* colon = strchr(token, ':');
+        if (!colon || colon - token >= (int)sizeof(secs[n].name)) continue;
+        memcpy(secs[n].name, token, colon - token);
+        if (sscanf(colon + 1, "%d:%d:%d", &secs[n].first_seat, &secs[n].rows, &secs[n].row_width) == 3) n++;
+    }
+    if (n == 0) {
+        free(secs);
+        return;
+    }
+    free(layout->sections);
+    layout->sections = secs;
+    layout->num_sections = n;
+    layout->num_seats = num_seats;
 }
 
 void normalize_command(char* command, char* normalized) {
@@ -78,8 +193,11 @@ void normalize_command(char* command, char* normalized) {
     
     to_upper(cmd_copy + start);
     
-    if (strncmp(cmd_copy + start, "AVAILABLE", 9) == 0 || strncmp(cmd_copy + start, "AVAIL", 5) == 0 || strcmp(cmd_copy + start, "A") == 0) {
+    char* word = cmd_copy + start;
+    size_t word_len = strcspn(word, " \t");
+    if (strncmp(word, "AVAIL", 5) == 0 || (word_len == 1 && word[0] == 'A')) {
         strcpy(normalized, "AVAILABLE");
+        strcat(normalized, word + word_len); /* keep an "@event" argument */
     } else if (strncmp(cmd_copy + start, "BOOK", 4) == 0 || strncmp(cmd_copy + start, "B", 1) == 0) {
         strcpy(normalized, cmd_copy + start);
     } else if (strncmp(cmd_copy + start, "CANCEL", 6) == 0 || strncmp(cmd_copy + start, "C", 1) == 0) {
@@ -126,7 +244,10 @@ int main(int argc, char* argv[]) {
     printf("╚════════════════════════════════════════════════════════════╝\n");
     printf("\nConnected! Commands: available/a, book n s1 s2..., cancel n s1 s2..., exit/q\n\n");
     
-    char buffer[BUFFER_SIZE], command[BUFFER_SIZE];
+    char command[BUFFER_SIZE];
+    size_t cap = BUFFER_SIZE;
+    char* buffer = malloc(cap);
+    struct layout layout = {0};
     
     while (1) {
         printf("> ");
@@ -148,23 +269,30 @@ int main(int argc, char* argv[]) {
         if (len >= BUFFER_SIZE + 1) cmd_send[BUFFER_SIZE] = '\n';
         if (send(sock_fd, cmd_send, strlen(cmd_send), 0) < 0) break;
         
-        ssize_t bytes = recv(sock_fd, buffer, BUFFER_SIZE - 1, 0);
+        ssize_t bytes = recv_line(sock_fd, &buffer, &cap);
         if (bytes <= 0) {
             printf(bytes == 0 ? "Server closed connection\n" : "Receive failed\n");
             break;
         }
         
-        buffer[bytes] = '\0';
         if (strncmp(buffer, "AVAILABLE", 9) == 0) {
-            char response_copy[BUFFER_SIZE];
-            strncpy(response_copy, buffer, BUFFER_SIZE - 1);
-            response_copy[BUFFER_SIZE - 1] = '\0';
-            display_seat_map(response_copy);
+            char* response = buffer;
+            char* at = strchr(normalized, '@');
+            int event = at ? atoi(at + 1) : 0;
+            if (!layout.sections || layout.event != event) {
+                /* The layout request reuses the receive buffer, so keep the seat list aside */
+                response = strdup(buffer);
+                fetch_layout(sock_fd, event, &layout, &buffer, &cap);
+            }
+            if (response) display_seat_map(response, &layout);
+            if (response != buffer) free(response);
         } else {
             printf("Server: %s", buffer);
         }
     }
     
+    free(buffer);
+    free(layout.sections);
     close(sock_fd);
     printf("Disconnected\n");
     return 0;
@@ -0,0 +1,54 @@
+#!/bin/bash
+
+# Cluster throughput benchmark: the same venue split over 1, 2, 4... shards
+# Usage: ./cluster_bench.sh [seats] [seconds] [shard counts...]
+# Starts every shard as a local server process (-m epoll, one loop each)
+# plus the router in front of them, and runs loadgen against the router.
+# Bookings of one seat stay on one shard; run with LOADGEN_ARGS="-k 4" to
+# add multi-seat bookings, some of which span shards (two-phase commit).
+
+SEATS=${1:-100000}
+SECONDS_PER_RUN=${2:-5}
+shift $(($# < 2 ? $# : 2))
+COUNTS=${@:-1 2 4}
+BASE_PORT=9200
+ROUTER_PORT=9190
+LOADGEN_ARGS=${LOADGEN_ARGS:-"-c 64 -t 4 -m 1:1:0"}
+
+if [ ! -f ./server ] || [ ! -f ./router ] || [ ! -f ./loadgen ]; then
+    echo "Error: run 'make' and 'make bench' first."
+    exit 1
+fi
+
+PIDS=""
+cleanup() {
+    [ -n "$PIDS" ] && kill $PIDS 2>/dev/null
+    wait 2>/dev/null
+    PIDS=""
+}
+trap cleanup EXIT
+
+printf "%8s %12s %12s\n" "shards" "req/s" "cross_shard"
+for N in $COUNTS; do
+    SHARDS=""
+    for ((i = 0; i < N; i++)); do
+        PORT=$((BASE_PORT + i))
+        ./server -p $PORT -m epoll -t 1 -n $((SEATS / N)) > /dev/null 2>&1 &
+        PIDS="$PIDS $!"
+        SHARDS="$SHARDS 127.0.0.1:$PORT"
+    done
+    sleep 1
+    ./router -p $ROUTER_PORT $SHARDS > /dev/null 2>&1 &
+    PIDS="$PIDS $!"
+    sleep 1
+
+    RATE=$(./loadgen -p $ROUTER_PORT -n $(((SEATS / N) * N)) -d $SECONDS_PER_RUN $LOADGEN_ARGS |
+           awk '$1 == "total" { print $5 }')
+    exec 3<>/dev/tcp/127.0.0.1/$ROUTER_PORT
+    printf "STATS\nEXIT\n" >&3
+    CROSS=$(sed -n 's/.*cross_shard=\([0-9]*\).*/\1/p' <&3)
+    exec 3<&-
+    printf "%8d %12s %12s\n" $N "${RATE:--}" "${CROSS:--}"
+    cleanup
+    sleep 1
+done
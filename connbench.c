@@ -0,0 +1,171 @@
+/*
+ * Connection rate benchmark for the reservation server
+ * Usage: ./connbench [-h host] [-p port] [-t threads] [-d seconds] [-c command]
+ * Every thread opens a connection, sends one command (default AVAILABLE)
+ * followed by EXIT, reads until the server closes, and starts over, the
+ * way test.sh and the client use a connection per command. The server
+ * closes first, so its side keeps the TIME_WAIT and the client does not
+ * run out of ports. Reports connections per second and the time from
+ * connect() to the server's close; compare -m epoll (one accept thread)
+ * with -m reuseport (one SO_REUSEPORT listener per loop).
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+struct worker {
+    pthread_t thread;
+    long ok, failed;
+    double* samples;    /* microseconds per connection */
+    long num_samples, cap;
+} __attribute__((aligned(64)));
+
+static const char* host = "127.0.0.1";
+static const char* port = "8080";
+static int num_threads = 4;
+static double seconds = 5;
+static char request[256];
+static size_t request_len;
+static struct addrinfo* addr;
+static struct timespec end;
+
+static double elapsed_us(const struct timespec* a, const struct timespec* b) {
+    return (b->tv_sec - a->tv_sec) * 1e6 + (b->tv_nsec - a->tv_nsec) / 1e3;
+}
+
+static int before_end(const struct timespec* now) {
+    return now->tv_sec < end.tv_sec || (now->tv_sec == end.tv_sec && now->tv_nsec < end.tv_nsec);
+}
+
+/* One connection: connect, send, drain until EOF; 0 on success */
+static int one_connection(void) {
+    int fd = socket(addr->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    int ok = connect(fd, addr->ai_addr, addr->ai_addrlen) == 0 &&
+             write(fd, request, request_len) == (ssize_t)request_len;
+    char buf[4096];
+    ssize_t n;
+    while (ok && (n = read(fd, buf, sizeof(buf))) != 0) {
+        if (n < 0) ok = 0;
+    }
+    close(fd);
+    return ok ? 0 : -1;
+}
+
+static void* worker_run(void* arg) {
+    struct worker* w = arg;
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    while (before_end(&now)) {
+        start = now;
+        int r = one_connection();
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (r < 0) {
+            w->failed++;
+            continue;
+        }
+        w->ok++;
+        if (w->num_samples == w->cap) {
+            long cap = w->cap ? w->cap * 2 : 65536;
+            double* samples = realloc(w->samples, cap * sizeof(double));
+            if (!samples) continue;
+            w->samples = samples;
+            w->cap = cap;
+        }
+        w->samples[w->num_samples++] = elapsed_us(&start, &now);
+    }
+    return NULL;
+}
+
+static int cmp_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-h host] [-p port] [-t threads] [-d seconds] [-c command]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char* argv[]) {
+    const char* command = "AVAILABLE";
+    int opt;
+    while ((opt = getopt(argc, argv, "h:p:t:d:c:")) != -1) {
+        switch (opt) {
+        case 'h': host = optarg; break;
+        case 'p': port = optarg; break;
+        case 't': num_threads = atoi(optarg); break;
+        case 'd': seconds = atof(optarg); break;
+        case 'c': command = optarg; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (num_threads < 1 || seconds <= 0 || strlen(command) > sizeof(request) - 8) usage(argv[0]);
+    request_len = snprintf(request, sizeof(request), "%s\nEXIT\n", command);
+
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    if (getaddrinfo(host, port, &hints, &addr) != 0) {
+        fprintf(stderr, "Cannot resolve %s:%s\n", host, port);
+        return 1;
+    }
+
+    struct worker* workers = calloc(num_threads, sizeof(*workers));
+    struct timespec start, stop;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    end = start;
+    end.tv_sec += (time_t)seconds;
+    end.tv_nsec += (long)((seconds - (time_t)seconds) * 1e9);
+    if (end.tv_nsec >= 1000000000L) {
+        end.tv_sec++;
+        end.tv_nsec -= 1000000000L;
+    }
+    for (int t = 0; t < num_threads; t++) {
+        if (pthread_create(&workers[t].thread, NULL, worker_run, &workers[t]) != 0) {
+            perror("pthread_create");
+            return 1;
+        }
+    }
+
+    long ok = 0, failed = 0, n = 0;
+    for (int t = 0; t < num_threads; t++) {
+        pthread_join(workers[t].thread, NULL);
+        ok += workers[t].ok;
+        failed += workers[t].failed;
+        n += workers[t].num_samples;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    double elapsed = elapsed_us(&start, &stop) / 1e6;
+    freeaddrinfo(addr);
+
+    double* all = malloc((n ? n : 1) * sizeof(double));
+    for (int t = 0, k = 0; t < num_threads; t++) {
+        memcpy(all + k, workers[t].samples, workers[t].num_samples * sizeof(double));
+        k += workers[t].num_samples;
+        free(workers[t].samples);
+    }
+    qsort(all, n, sizeof(double), cmp_double);
+
+    printf("%d threads, %.1fs, \"%s\" per connection\n\n", num_threads, seconds, command);
+    printf("%12s %10s %12s %10s %10s %10s %10s\n", "connections", "failed", "conn/s", "p50 us", "p99 us",
+           "p99.9 us", "max us");
+    if (n) {
+        printf("%12ld %10ld %12.0f %10.1f %10.1f %10.1f %10.1f\n", ok, failed, ok / elapsed, all[n / 2],
+               all[(long)(n * 0.99)], all[(long)(n * 0.999)], all[n - 1]);
+    } else {
+        printf("%12ld %10ld %12.0f %10s %10s %10s %10s\n", ok, failed, 0.0, "-", "-", "-", "-");
+    }
+    free(all);
+    free(workers);
+    return 0;
+}
@@ -0,0 +1,427 @@
+/*
+ * Write-ahead journal with group commit, see journal.h
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <ctype.h>
+#include <limits.h>
+#include "journal.h"
+
+struct journal_buf {
+    char* data;
+    size_t len;
+};
+
+struct journal {
+    char* dir;
+    int fd;                       /* active segment */
+    size_t seg_bytes;             /* bytes written to the active segment */
+    enum journal_mode mode;
+    pthread_mutex_t lock;
+    pthread_cond_t work;          /* flusher: the active buffer is non-empty or a rotation is due */
+    pthread_cond_t space;         /* appenders: the active buffer was swapped out */
+    pthread_cond_t synced;        /* journal_wait / journal_rotate: durable advanced or segment sealed */
+    struct journal_buf bufs[2];
+    int active;                   /* buffer appenders copy into */
+    uint64_t next_lsn;
+    _Atomic uint64_t durable;
+    uint64_t* segments;           /* first LSN of every segment, oldest first; the last is active */
+    int num_segments, segments_cap;
+    int rotate;                   /* journal_rotate() is waiting for the flusher */
+    int* wakers;
+    int num_wakers;
+    pthread_t flusher;
+};
+
+static __thread uint64_t thread_lsn;
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc_table[i] = c;
+    }
+}
+
+uint32_t journal_crc32(uint32_t crc, const void* data, size_t len) {
+    pthread_once(&crc_once, crc_init);
+    const unsigned char* p = data;
+    crc = ~crc;
+    while (len--) crc = crc_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+/* Records are padded to 8 bytes so every header is aligned */
+size_t journal_record_size(int num_seats) {
+    return (sizeof(struct journal_record) + num_seats * sizeof(uint32_t) + 7) & ~(size_t)7;
+}
+
+uint32_t journal_record_crc(const struct journal_record* rec) {
+    return journal_crc32(0, (const char*)rec + sizeof(rec->crc), journal_record_size(rec->num_seats) - sizeof(rec->crc));
+}
+
+void journal_record_fill(struct journal_record* rec, uint64_t lsn, int op, int event, const int* seat_nums, int n,
+                         int64_t owner) {
+    memset(rec, 0, journal_record_size(n));
+    rec->num_seats = n;
+    rec->op = op;
+    rec->lsn = lsn;
+    rec->owner = owner;
+    rec->event = event;
+    for (int i = 0; i < n; i++) rec->seats[i] = seat_nums[i];
+    rec->crc = journal_record_crc(rec);
+}
+
+static void write_all(int fd, const char* buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            /* Acknowledged bookings would no longer be durable */
+            perror("Journal write failed");
+            exit(EXIT_FAILURE);
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+static void sync_fd(int fd) {
+    if (fdatasync(fd) < 0) {
+        perror("Journal sync failed");
+        exit(EXIT_FAILURE);
+    }
+}
+
+int journal_sync_dir(const char* dir) {
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    int rc = fsync(fd);
+    close(fd);
+    return rc;
+}
+
+static void segment_path(const char* dir, uint64_t first_lsn, char* path) {
+    snprintf(path, PATH_MAX, "%s/journal.%020llu", dir, (unsigned long long)first_lsn);
+}
+
+static int cmp_lsn(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static int add_segment(struct journal* j, uint64_t first_lsn) {
+    if (j->num_segments == j->segments_cap) {
+        int cap = j->segments_cap ? j->segments_cap * 2 : 16;
+        uint64_t* segments = realloc(j->segments, cap * sizeof(uint64_t));
+        if (!segments) return -1;
+        j->segments = segments;
+        j->segments_cap = cap;
+    }
+    j->segments[j->num_segments++] = first_lsn;
+    return 0;
+}
+
+static int list_segments(struct journal* j) {
+    DIR* d = opendir(j->dir);
+    if (!d) return -1;
+    struct dirent* e;
+    while ((e = readdir(d))) {
+        char* end;
+        if (strncmp(e->d_name, "journal.", 8) != 0 || !isdigit((unsigned char)e->d_name[8])) continue;
+        unsigned long long first = strtoull(e->d_name + 8, &end, 10);
+        if (*end == '\0' && add_segment(j, first) < 0) break;
+    }
+    closedir(d);
+    qsort(j->segments, j->num_segments, sizeof(uint64_t), cmp_lsn);
+    return 0;
+}
+
+/* Start a new active segment whose first record will be first_lsn; called with the lock held */
+static void segment_roll(struct journal* j, uint64_t first_lsn) {
+    char path[PATH_MAX];
+    segment_path(j->dir, first_lsn, path);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0 || journal_sync_dir(j->dir) < 0 || add_segment(j, first_lsn) < 0) {
+        perror("Journal segment create failed");
+        exit(EXIT_FAILURE);
+    }
+    if (j->fd >= 0) close(j->fd); /* every byte written to it has already been synced */
+    j->fd = fd;
+    j->seg_bytes = 0;
+}
+
+/* Walk one segment whose first record is *next_lsn, passing records after from_lsn to apply;
+ * returns the length of the intact prefix (or -1 on I/O error) and advances *next_lsn */
+static off_t scan_segment(const char* path, uint64_t* next_lsn, uint64_t from_lsn, journal_apply_fn apply, void* arg,
+                          long* applied, long* rejected, off_t* file_size) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat sb;
+    if (fd < 0 || fstat(fd, &sb) < 0) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    *file_size = sb.st_size;
+    if (sb.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    char* base = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return -1;
+    madvise(base, sb.st_size, MADV_SEQUENTIAL);
+
+    off_t off = 0;
+    while (off + (off_t)sizeof(struct journal_record) <= sb.st_size) {
+        const struct journal_record* rec = (const void*)(base + off);
+        off_t size = journal_record_size(rec->num_seats);
+        if (off + size > sb.st_size || rec->lsn != *next_lsn || journal_record_crc(rec) != rec->crc) break;
+        if (rec->lsn > from_lsn) {
+            if (apply(arg, rec) < 0) (*rejected)++;
+            else (*applied)++;
+        }
+        (*next_lsn)++;
+        off += size;
+    }
+    munmap(base, sb.st_size);
+    return off;
+}
+
+/* Replay every segment after from_lsn and open the newest one for appending */
+static int recover(struct journal* j, uint64_t from_lsn, journal_apply_fn apply, void* arg, long* replayed, long* skipped) {
+    if (list_segments(j) < 0) return -1;
+    j->next_lsn = from_lsn + 1;
+    for (int i = 0; i < j->num_segments; i++) {
+        int last = i == j->num_segments - 1;
+        if (!last && j->segments[i + 1] <= from_lsn + 1) continue; /* already covered by the snapshot */
+        if (j->segments[i] > j->next_lsn) {
+            fprintf(stderr, "Journal: records %llu to %llu are missing\n", (unsigned long long)j->next_lsn,
+                    (unsigned long long)j->segments[i] - 1);
+            return -1;
+        }
+        char path[PATH_MAX];
+        segment_path(j->dir, j->segments[i], path);
+        uint64_t next = j->segments[i];
+        off_t size, end = scan_segment(path, &next, from_lsn, apply, arg, replayed, skipped, &size);
+        if (end < 0) return -1;
+        if (!last && (end < size || next != j->segments[i + 1])) {
+            fprintf(stderr, "Journal: sealed segment %s is damaged\n", path);
+            return -1;
+        }
+        if (next > j->next_lsn) j->next_lsn = next;
+        if (last && next == j->next_lsn) {
+            /* Cut a torn tail off the active segment and keep appending to it */
+            j->fd = open(path, O_WRONLY | O_APPEND | O_CLOEXEC);
+            if (j->fd < 0 || ftruncate(j->fd, end) < 0) return -1;
+            j->seg_bytes = end;
+        }
+    }
+    /* No segment yet, or the snapshot is newer than the whole journal */
+    if (j->fd < 0) segment_roll(j, j->next_lsn);
+    return 0;
+}
+
+static void* flusher_run(void* arg) {
+    struct journal* j = arg;
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    pthread_mutex_lock(&j->lock);
+    for (;;) {
+        while (j->bufs[j->active].len == 0 && !j->rotate) pthread_cond_wait(&j->work, &j->lock);
+        if (j->bufs[j->active].len > 0) {
+            if (j->seg_bytes >= JOURNAL_SEGMENT_SIZE) segment_roll(j, atomic_load(&j->durable) + 1);
+            /* Everything appended so far goes out in one write and one sync */
+            struct journal_buf* buf = &j->bufs[j->active];
+            uint64_t last = j->next_lsn - 1;
+            j->active ^= 1;
+            pthread_cond_broadcast(&j->space);
+            pthread_mutex_unlock(&j->lock);
+
+            write_all(j->fd, buf->data, buf->len);
+            sync_fd(j->fd);
+
+            pthread_mutex_lock(&j->lock);
+            j->seg_bytes += buf->len;
+            buf->len = 0;
+            atomic_store_explicit(&j->durable, last, memory_order_release);
+            pthread_cond_broadcast(&j->synced);
+            uint64_t one = 1;
+            for (int i = 0; i < j->num_wakers; i++) write(j->wakers[i], &one, sizeof(one));
+        }
+        if (j->rotate) {
+            if (j->seg_bytes > 0) segment_roll(j, atomic_load(&j->durable) + 1);
+            j->rotate = 0;
+            pthread_cond_broadcast(&j->synced);
+        }
+    }
+    return NULL;
+}
+
+struct journal* journal_open(const char* dir, enum journal_mode mode, uint64_t from_lsn,
+                             journal_apply_fn apply, void* arg, long* replayed, long* skipped) {
+    struct journal* j = calloc(1, sizeof(*j));
+    if (!j) return NULL;
+    j->mode = mode;
+    j->fd = -1;
+    *replayed = *skipped = 0;
+    if ((mkdir(dir, 0755) < 0 && errno != EEXIST) || !(j->dir = strdup(dir)) ||
+        recover(j, from_lsn, apply, arg, replayed, skipped) < 0)
+        goto fail;
+    atomic_init(&j->durable, j->next_lsn - 1);
+
+    pthread_mutex_init(&j->lock, NULL);
+    pthread_cond_init(&j->work, NULL);
+    pthread_cond_init(&j->space, NULL);
+    pthread_cond_init(&j->synced, NULL);
+    if (mode == JOURNAL_GROUP) {
+        if (!(j->bufs[0].data = malloc(JOURNAL_BUFFER_SIZE)) || !(j->bufs[1].data = malloc(JOURNAL_BUFFER_SIZE)) ||
+            pthread_create(&j->flusher, NULL, flusher_run, j) != 0) {
+            free(j->bufs[0].data);
+            free(j->bufs[1].data);
+            pthread_mutex_destroy(&j->lock);
+            pthread_cond_destroy(&j->work);
+            pthread_cond_destroy(&j->space);
+            pthread_cond_destroy(&j->synced);
+            goto fail;
+        }
+    }
+    return j;
+
+fail:
+    if (j->fd >= 0) close(j->fd);
+    free(j->segments);
+    free(j->dir);
+    free(j);
+    return NULL;
+}
+
+uint64_t journal_append(struct journal* j, int op, int event, const int* seat_nums, int n, int64_t owner) {
+    size_t size = journal_record_size(n);
+    char data[size];
+    struct journal_record* rec = (void*)data;
+    memset(data, 0, size);
+    rec->num_seats = n;
+    rec->op = op;
+    rec->owner = owner;
+    rec->event = event;
+    for (int i = 0; i < n; i++) rec->seats[i] = seat_nums[i];
+
+    pthread_mutex_lock(&j->lock);
+    rec->lsn = j->next_lsn++;
+    rec->crc = journal_record_crc(rec);
+    if (j->mode == JOURNAL_SYNC) {
+        if (j->seg_bytes >= JOURNAL_SEGMENT_SIZE) segment_roll(j, rec->lsn);
+        write_all(j->fd, data, size);
+        sync_fd(j->fd);
+        j->seg_bytes += size;
+        atomic_store_explicit(&j->durable, rec->lsn, memory_order_release);
+    } else {
+        while (j->bufs[j->active].len + size > JOURNAL_BUFFER_SIZE) pthread_cond_wait(&j->space, &j->lock);
+        struct journal_buf* buf = &j->bufs[j->active];
+        if (buf->len == 0) pthread_cond_signal(&j->work);
+        memcpy(buf->data + buf->len, data, size);
+        buf->len += size;
+    }
+    pthread_mutex_unlock(&j->lock);
+    return thread_lsn = rec->lsn;
+}
+
+uint64_t journal_last_lsn(void) {
+    return thread_lsn;
+}
+
+uint64_t journal_durable(struct journal* j) {
+    return atomic_load_explicit(&j->durable, memory_order_acquire);
+}
+
+void journal_wait(struct journal* j, uint64_t lsn) {
+    if (journal_durable(j) >= lsn) return;
+    pthread_mutex_lock(&j->lock);
+    while (journal_durable(j) < lsn) pthread_cond_wait(&j->synced, &j->lock);
+    pthread_mutex_unlock(&j->lock);
+}
+
+int journal_add_waker(struct journal* j, int efd) {
+    pthread_mutex_lock(&j->lock);
+    int* wakers = realloc(j->wakers, (j->num_wakers + 1) * sizeof(int));
+    if (wakers) {
+        wakers[j->num_wakers++] = efd;
+        j->wakers = wakers;
+    }
+    pthread_mutex_unlock(&j->lock);
+    return wakers ? 0 : -1;
+}
+
+void journal_rotate(struct journal* j) {
+    pthread_mutex_lock(&j->lock);
+    if (j->mode == JOURNAL_SYNC) {
+        if (j->seg_bytes > 0) segment_roll(j, j->next_lsn);
+    } else {
+        j->rotate = 1;
+        pthread_cond_signal(&j->work);
+        while (j->rotate) pthread_cond_wait(&j->synced, &j->lock);
+    }
+    pthread_mutex_unlock(&j->lock);
+}
+
+uint64_t journal_replay_sealed(struct journal* j, uint64_t from_lsn, journal_apply_fn apply, void* arg) {
+    pthread_mutex_lock(&j->lock);
+    int count = j->num_segments;
+    uint64_t* segments = malloc(count * sizeof(uint64_t));
+    if (segments) memcpy(segments, j->segments, count * sizeof(uint64_t));
+    pthread_mutex_unlock(&j->lock);
+    if (!segments) return from_lsn;
+
+    uint64_t last = from_lsn;
+    long applied = 0, rejected = 0;
+    for (int i = 0; i + 1 < count; i++) {
+        if (segments[i + 1] - 1 <= last) continue;
+        char path[PATH_MAX];
+        segment_path(j->dir, segments[i], path);
+        uint64_t next = segments[i];
+        off_t size;
+        if (segments[i] > last + 1 || scan_segment(path, &next, last, apply, arg, &applied, &rejected, &size) < 0 ||
+            next != segments[i + 1])
+            break; /* never skip over a gap */
+        last = next - 1;
+    }
+    free(segments);
+    return last;
+}
+
+void journal_discard(struct journal* j, uint64_t lsn) {
+    pthread_mutex_lock(&j->lock);
+    int count = 0;
+    while (count + 1 < j->num_segments && j->segments[count + 1] - 1 <= lsn) count++;
+    uint64_t* discarded = malloc(count * sizeof(uint64_t));
+    if (!discarded) count = 0;
+    else memcpy(discarded, j->segments, count * sizeof(uint64_t));
+    memmove(j->segments, j->segments + count, (j->num_segments - count) * sizeof(uint64_t));
+    j->num_segments -= count;
+    pthread_mutex_unlock(&j->lock);
+
+    for (int i = 0; i < count; i++) {
+        char path[PATH_MAX];
+        segment_path(j->dir, discarded[i], path);
+        unlink(path);
+    }
+    if (count) journal_sync_dir(j->dir);
+    free(discarded);
+}
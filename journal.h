@@ -0,0 +1,80 @@
+/*
+ * Write-ahead journal of committed BOOK/CANCEL operations
+ * Records are appended while the seats are still held, so journal order is
+ * commit order, and a client only sees OK once its record is on disk.
+ *  - JOURNAL_GROUP: appenders copy records into a shared buffer and a
+ *    flusher thread writes and fdatasyncs whatever accumulated since the
+ *    last sync, so one sync covers every transaction that arrived meanwhile.
+ *  - JOURNAL_SYNC: every append writes and syncs its own record.
+ * The journal is a directory of segment files named after the first LSN
+ * they hold; only the newest segment is written to, older ones are sealed
+ * and can be discarded once a snapshot covers them (snapshot.c).
+ * On startup the segments are replayed in order; a torn final record (bad
+ * checksum or short read) in the newest segment is cut off.
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define JOURNAL_BUFFER_SIZE (1024 * 1024)
+#define JOURNAL_SEGMENT_SIZE (64 * 1024 * 1024)  /* roll over to a new segment past this */
+
+enum journal_mode { JOURNAL_GROUP, JOURNAL_SYNC };
+
+/* On-disk record: header followed by num_seats 32-bit seat numbers */
+struct journal_record {
+    uint32_t crc;        /* CRC-32 of everything after this field */
+    uint16_t num_seats;
+    uint8_t op;          /* enum seat_op */
+    uint8_t pad;
+    uint64_t lsn;        /* 1, 2, 3, ... */
+    int64_t owner;
+    uint32_t event;
+    uint32_t pad2;
+    uint32_t seats[];
+};
+
+struct journal;
+
+/* Called for every intact record in order; return -1 to report it as not applicable */
+typedef int (*journal_apply_fn)(void* arg, const struct journal_record* rec);
+
+/* Replays the records after from_lsn found in dir (created if missing) through apply,
+ * then starts accepting appends; *replayed / *skipped count applied and rejected
+ * records. NULL on I/O error or a damaged sealed segment. */
+struct journal* journal_open(const char* dir, enum journal_mode mode, uint64_t from_lsn,
+                             journal_apply_fn apply, void* arg, long* replayed, long* skipped);
+
+/* Queue one record; returns its LSN, also remembered as the calling thread's last LSN */
+uint64_t journal_append(struct journal* j, int op, int event, const int* seat_nums, int n, int64_t owner);
+uint64_t journal_last_lsn(void);
+
+/* Highest LSN known to be on disk */
+uint64_t journal_durable(struct journal* j);
+/* Block until lsn is durable */
+void journal_wait(struct journal* j, uint64_t lsn);
+/* eventfd signalled after every sync, for event loops waiting on journal_durable() */
+int journal_add_waker(struct journal* j, int efd);
+
+/* Seal the active segment if it holds any record */
+void journal_rotate(struct journal* j);
+/* Feed the records after from_lsn of every sealed segment to apply; returns the last LSN seen */
+uint64_t journal_replay_sealed(struct journal* j, uint64_t from_lsn, journal_apply_fn apply, void* arg);
+/* Delete the sealed segments whose records are all at or below lsn */
+void journal_discard(struct journal* j, uint64_t lsn);
+
+/* fsync a directory so file creations and renames in it are durable */
+int journal_sync_dir(const char* dir);
+uint32_t journal_crc32(uint32_t crc, const void* data, size_t len);
+
+/* Record encoding, shared with replication (repl.c) */
+size_t journal_record_size(int num_seats);
+uint32_t journal_record_crc(const struct journal_record* rec);
+/* Fill rec (journal_record_size(n) bytes) and its checksum */
+void journal_record_fill(struct journal_record* rec, uint64_t lsn, int op, int event, const int* seat_nums, int n,
+                         int64_t owner);
+
+#endif
@@ -0,0 +1,590 @@
+/*
+ * Load generator for the reservation server
+ * Usage: ./loadgen [-h host] [-p port] [-c connections] [-t threads] [-d seconds]
+ *                  [-m book:cancel:available:best] [-k seats] [-z zipf_s] [-n seats]
+ *                  [-r rate] [-P depth] [-b] [-S]
+ * Connections are spread over threads, each running its own epoll loop.
+ * Closed loop (default): every connection keeps depth requests in flight and
+ * sends the next one as soon as a reply comes back. Open loop (-r, requests
+ * per second over all connections): requests are issued on a fixed schedule
+ * whatever the server does, and latency counts from the time a request was
+ * due, so a stall shows up in the tail rather than slowing the load down
+ * (no coordinated omission).
+ * BOOK seats are drawn from a Zipf distribution over the venue, seat 1 the
+ * hottest (-z 0 = uniform); CANCEL gives back a seat the connection booked,
+ * and is sent as a BOOK while the connection has none. BEST is BOOK BEST k.
+ * -b speaks the binary protocol (protocol.h) instead of text.
+ * -S reads the server's STATS before and after the run and reports the
+ * network system calls it made per request.
+ * Latencies go into log-linear histograms with 64 sub-buckets per power of
+ * two (HDR style, under 1.6% error), one per thread and operation.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "protocol.h"
+
+#define MAX_DEPTH 256
+#define MAX_K 16
+#define HIST_SUB_BITS 6
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+enum op { OP_BOOK, OP_CANCEL, OP_AVAILABLE, OP_BEST, NUM_OPS };
+static const char* const op_names[NUM_OPS] = { "BOOK", "CANCEL", "AVAILABLE", "BEST" };
+
+struct histogram {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total, max;
+};
+
+struct pending {
+    uint64_t due;            /* ns; latency is measured from here */
+    uint8_t op, n;
+    int seats[MAX_K];
+};
+
+struct conn {
+    int fd, dead;
+    char* in;
+    size_t in_len, in_cap;
+    char* out;
+    size_t out_len, out_sent, out_cap;
+    struct pending ring[MAX_DEPTH];  /* requests in flight, oldest first */
+    int head, count;
+    int* owned;                      /* seats booked and not yet cancelled */
+    int num_owned, owned_cap;
+};
+
+struct worker {
+    pthread_t thread;
+    int id;
+    struct conn* conns;
+    int num_conns;
+    uint64_t rng;
+    struct histogram hist[NUM_OPS];
+    long ok[NUM_OPS], fail[NUM_OPS];
+    long errors, unsent;
+};
+
+/* Settings */
+static const char* host = "127.0.0.1";
+static const char* port = "8080";
+static int num_conns = 100, num_threads = 1, depth = 1, k_seats = 1, num_seats, binary, syscalls;
+static int mix[NUM_OPS] = { 80, 15, 5, 0 }, mix_total = 100;
+static double seconds = 10, zipf_s = 0.99, rate;
+static uint64_t end_ns;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* xorshift64*, one state per thread */
+static uint64_t next_random(uint64_t* s) {
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * 0x2545f4914f6cdd1dULL;
+}
+
+static double uniform(uint64_t* s) {
+    return (next_random(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* Histogram */
+
+static int hist_index(uint64_t v) {
+    if (v < HIST_SUB) return v;
+    int shift = 63 - __builtin_clzll(v) - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB + (int)((v >> shift) - HIST_SUB);
+}
+
+/* Highest value that lands in bucket i */
+static uint64_t hist_value(int i) {
+    if (i < HIST_SUB) return i;
+    int shift = i / HIST_SUB - 1;
+    return ((uint64_t)(i % HIST_SUB + HIST_SUB + 1) << shift) - 1;
+}
+
+static void hist_record(struct histogram* h, uint64_t v) {
+    h->counts[hist_index(v)]++;
+    h->total++;
+    if (v > h->max) h->max = v;
+}
+
+static void hist_merge(struct histogram* into, const struct histogram* h) {
+    for (int i = 0; i < HIST_BUCKETS; i++) into->counts[i] += h->counts[i];
+    into->total += h->total;
+    if (h->max > into->max) into->max = h->max;
+}
+
+static uint64_t hist_percentile(const struct histogram* h, double p) {
+    uint64_t rank = (uint64_t)ceil(p / 100 * h->total), seen = 0;
+    if (rank == 0) rank = 1;
+    for (int i = 0; i < HIST_BUCKETS; i++)
+        if ((seen += h->counts[i]) >= rank) return hist_value(i) < h->max ? hist_value(i) : h->max;
+    return h->max;
+}
+
+/* Zipf ranks 1..n by rejection-inversion (Hörmann and Derflinger), no table needed */
+
+static double zipf_n, zipf_hx1, zipf_hn, zipf_sdiv;
+
+static double helper1(double x) {
+    return fabs(x) > 1e-8 ? log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x));
+}
+
+static double helper2(double x) {
+    return fabs(x) > 1e-8 ? expm1(x) / x : 1 + x * 0.5 * (1 + x / 3 * (1 + 0.25 * x));
+}
+
+static double zipf_h(double x) {
+    return exp(-zipf_s * log(x));
+}
+
+static double zipf_hintegral(double x) {
+    double lx = log(x);
+    return helper2((1 - zipf_s) * lx) * lx;
+}
+
+static double zipf_hinverse(double x) {
+    double t = x * (1 - zipf_s);
+    if (t < -1) t = -1;
+    return exp(helper1(t) * x);
+}
+
+static void zipf_init(int n) {
+    zipf_n = n;
+    zipf_hx1 = zipf_hintegral(1.5) - 1;
+    zipf_hn = zipf_hintegral(n + 0.5);
+    zipf_sdiv = 2 - zipf_hinverse(zipf_hintegral(2.5) - zipf_h(2));
+}
+
+static int zipf_sample(uint64_t* rng) {
+    if (zipf_s == 0) return 1 + (int)(uniform(rng) * zipf_n);
+    for (;;) {
+        double u = zipf_hn + uniform(rng) * (zipf_hx1 - zipf_hn);
+        double x = zipf_hinverse(u);
+        double k = floor(x + 0.5);
+        if (k < 1) k = 1;
+        else if (k > zipf_n) k = zipf_n;
+        if (k - x <= zipf_sdiv || u >= zipf_hintegral(k + 0.5) - zipf_h(k)) return (int)k;
+    }
+}
+
+/* Connections */
+
+static int reserve(char** buf, size_t* cap, size_t need) {
+    if (need <= *cap) return 0;
+    size_t size = *cap ? *cap : 4096;
+    while (size < need) size *= 2;
+    char* grown = realloc(*buf, size);
+    if (!grown) return -1;
+    *buf = grown;
+    *cap = size;
+    return 0;
+}
+
+static void add_owned(struct conn* c, int seat) {
+    if (c->num_owned == c->owned_cap) {
+        int cap = c->owned_cap ? c->owned_cap * 2 : 16;
+        int* grown = realloc(c->owned, cap * sizeof(int));
+        if (!grown) return;
+        c->owned = grown;
+        c->owned_cap = cap;
+    }
+    c->owned[c->num_owned++] = seat;
+}
+
+static int open_conn(struct addrinfo* addr) {
+    int fd = socket(addr->ai_family, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, addr->ai_addr, addr->ai_addrlen) < 0) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+/* Send one command on a throwaway text connection; buf gets the first reply line */
+static int query(struct addrinfo* addr, const char* command, char* buf, size_t cap) {
+    int fd = open_conn(addr);
+    if (fd < 0) return -1;
+    size_t len = 0;
+    ssize_t r = 0;
+    if (write(fd, command, strlen(command)) != (ssize_t)strlen(command)) len = cap;
+    while (len < cap - 1 && !memchr(buf, '\n', len) && (r = read(fd, buf + len, cap - 1 - len)) > 0)
+        len += r;
+    close(fd);
+    buf[len < cap ? len : cap - 1] = '\0';
+    return 0;
+}
+
+/* Venue size from LAYOUT */
+static int query_seats(struct addrinfo* addr) {
+    char buf[4096];
+    int seats;
+    if (query(addr, "LAYOUT\n", buf, sizeof(buf)) < 0) return -1;
+    return sscanf(buf, "LAYOUT %d", &seats) == 1 ? seats : -1;
+}
+
+/* The server's network system call count (-S); -1 if it does not report one */
+static long long query_syscalls(struct addrinfo* addr) {
+    char buf[8192];
+    if (query(addr, "STATS\n", buf, sizeof(buf)) < 0) return -1;
+    const char* p = strstr(buf, " syscalls=");
+    return p ? atoll(p + 10) : -1;
+}
+
+/* Append one request due at due; picks the operation from the mix */
+static void queue_request(struct worker* w, struct conn* c, uint64_t due) {
+    struct pending* p = &c->ring[(c->head + c->count++) % MAX_DEPTH];
+    int pick = next_random(&w->rng) % mix_total;
+    p->op = 0;
+    while (pick >= mix[p->op]) pick -= mix[p->op++];
+    if (p->op == OP_CANCEL && c->num_owned == 0) p->op = OP_BOOK;
+    p->due = due;
+    p->n = 0;
+    if (p->op == OP_BOOK) {
+        while (p->n < k_seats) {
+            int seat = zipf_sample(&w->rng), dup = 0;
+            for (int i = 0; i < p->n; i++) dup |= p->seats[i] == seat;
+            if (!dup) p->seats[p->n++] = seat;
+        }
+    } else if (p->op == OP_CANCEL) {
+        int i = next_random(&w->rng) % c->num_owned;
+        p->seats[p->n++] = c->owned[i];
+        c->owned[i] = c->owned[--c->num_owned];
+    } else if (p->op == OP_BEST) {
+        p->n = k_seats;
+    }
+
+    if (reserve(&c->out, &c->out_cap, c->out_len + 16 + MAX_K * 12) < 0) {
+        c->dead = 1;
+        return;
+    }
+    char* o = c->out + c->out_len;
+    if (binary) {
+        static const uint8_t bin_ops[NUM_OPS] = { BIN_OP_BOOK, BIN_OP_CANCEL, BIN_OP_AVAILABLE, BIN_OP_BOOK_BEST };
+        int count = p->op == OP_BEST ? 2 : p->op == OP_AVAILABLE ? 0 : p->n;
+        struct bin_request req = { sizeof(req) + count * 4, bin_ops[p->op], count, 0, 0 };
+        memcpy(o, &req, sizeof(req));
+        o += sizeof(req);
+        uint32_t args[MAX_K] = { k_seats, 0 };
+        for (int i = 0; p->op != OP_BEST && i < count; i++) args[i] = p->seats[i];
+        memcpy(o, args, count * 4);
+        o += count * 4;
+    } else if (p->op == OP_AVAILABLE) {
+        o += sprintf(o, "AVAILABLE\n");
+    } else if (p->op == OP_BEST) {
+        o += sprintf(o, "BOOK BEST %d\n", k_seats);
+    } else {
+        o += sprintf(o, "%s %d", p->op == OP_BOOK ? "BOOK" : "CANCEL", p->n);
+        for (int i = 0; i < p->n; i++) o += sprintf(o, " %d", p->seats[i]);
+        *o++ = '\n';
+    }
+    c->out_len = o - c->out;
+}
+
+static void flush_conn(struct conn* c) {
+    while (c->out_sent < c->out_len) {
+        ssize_t n = write(c->fd, c->out + c->out_sent, c->out_len - c->out_sent);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EINTR) c->dead = 1;
+            if (errno != EINTR) break;
+            continue;
+        }
+        c->out_sent += n;
+    }
+    if (c->out_sent == c->out_len) c->out_sent = c->out_len = 0;
+}
+
+/* A reply to the oldest request in flight */
+static void complete(struct worker* w, struct conn* c, int ok, const int* booked, int num_booked) {
+    struct pending* p = &c->ring[c->head];
+    uint64_t now = now_ns();
+    c->head = (c->head + 1) % MAX_DEPTH;
+    c->count--;
+    if (now > end_ns) return;
+    hist_record(&w->hist[p->op], now - p->due);
+    if (ok) w->ok[p->op]++;
+    else w->fail[p->op]++;
+    if (ok && p->op == OP_BOOK)
+        for (int i = 0; i < p->n; i++) add_owned(c, p->seats[i]);
+    for (int i = 0; ok && i < num_booked; i++) add_owned(c, booked[i]);
+}
+
+/* Take every complete reply out of the input buffer */
+static void parse_replies(struct worker* w, struct conn* c) {
+    size_t start = 0;
+    int booked[MAX_K];
+    while (c->count > 0) {
+        int n = 0, ok;
+        if (binary) {
+            struct bin_response resp;
+            if (c->in_len - start < sizeof(resp)) break;
+            memcpy(&resp, c->in + start, sizeof(resp));
+            if (resp.size < sizeof(resp)) {
+                c->dead = 1;
+                break;
+            }
+            if (c->in_len - start < resp.size) break;
+            ok = resp.status == BIN_OK;
+            if (ok && resp.op == BIN_OP_BOOK_BEST)
+                for (; n < (int)resp.seat && n < MAX_K; n++)
+                    memcpy(&booked[n], c->in + start + sizeof(resp) + n * 4, 4);
+            start += resp.size;
+        } else {
+            char* line = c->in + start;
+            char* nl = memchr(line, '\n', c->in_len - start);
+            if (!nl) break;
+            ok = strncmp(line, "FAIL", 4) != 0;
+            if (ok && strncmp(line, "OK BOOKED", 9) == 0 && c->ring[c->head].op == OP_BEST)
+                for (char* q = line + 9; q < nl && n < MAX_K; n++) booked[n] = strtol(q, &q, 10);
+            start = nl + 1 - c->in;
+        }
+        complete(w, c, ok, booked, n);
+    }
+    memmove(c->in, c->in + start, c->in_len - start);
+    c->in_len -= start;
+}
+
+static void read_conn(struct worker* w, struct conn* c) {
+    for (;;) {
+        if (reserve(&c->in, &c->in_cap, c->in_len + 4096) < 0) {
+            c->dead = 1;
+            return;
+        }
+        ssize_t n = read(c->fd, c->in + c->in_len, c->in_cap - c->in_len);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+            c->dead = 1;
+            return;
+        }
+        if (n < 0) {
+            if (errno == EAGAIN) return;
+            continue;
+        }
+        c->in_len += n;
+        parse_replies(w, c);
+    }
+}
+
+static void* worker_run(void* arg) {
+    struct worker* w = arg;
+    int epfd = epoll_create1(0);
+    for (int i = 0; i < w->num_conns; i++) {
+        struct epoll_event ev = { EPOLLIN | EPOLLOUT | EPOLLET, { .ptr = &w->conns[i] } };
+        fcntl(w->conns[i].fd, F_SETFL, fcntl(w->conns[i].fd, F_GETFL) | O_NONBLOCK);
+        epoll_ctl(epfd, EPOLL_CTL_ADD, w->conns[i].fd, &ev);
+    }
+    uint64_t start = now_ns(), next_due = start;
+    uint64_t interval = rate > 0 ? (uint64_t)(1e9 * num_threads / rate) : 0;
+    int rr = 0;
+    struct epoll_event events[256];
+    if (!interval)
+        for (int i = 0; i < w->num_conns; i++) {
+            for (int d = 0; d < depth; d++) queue_request(w, &w->conns[i], start);
+            flush_conn(&w->conns[i]);
+        }
+
+    for (;;) {
+        uint64_t now = now_ns();
+        int timeout = now < end_ns ? (end_ns - now) / 1000000 + 1 : 0;
+        if (interval) {
+            /* Issue everything that has come due, round-robin over connections with room */
+            while (next_due <= now && next_due < end_ns) {
+                int tries = 0;
+                while (tries < w->num_conns && (w->conns[rr].dead || w->conns[rr].count == depth)) {
+                    rr = (rr + 1) % w->num_conns;
+                    tries++;
+                }
+                if (tries == w->num_conns) break;  /* every connection is full: the request waits, its clock running */
+                queue_request(w, &w->conns[rr], next_due);
+                flush_conn(&w->conns[rr]);
+                rr = (rr + 1) % w->num_conns;
+                next_due += interval;
+            }
+            if (next_due > now) timeout = (next_due - now) / 1000000;
+            else timeout = 1;
+        }
+        if (now >= end_ns) break;
+        int n = epoll_wait(epfd, events, 256, timeout);
+        for (int i = 0; i < n; i++) {
+            struct conn* c = events[i].data.ptr;
+            if (c->dead) continue;
+            if (events[i].events & EPOLLOUT) flush_conn(c);
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                int before = c->count;
+                read_conn(w, c);
+                if (!interval)
+                    for (int d = c->count; d < before && !c->dead; d++) queue_request(w, c, now_ns());
+                flush_conn(c);
+            }
+            if (c->dead) {
+                w->errors++;
+                epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+            }
+        }
+    }
+    if (interval && next_due < end_ns) w->unsent = (end_ns - next_due) / interval;
+    close(epfd);
+    return NULL;
+}
+
+static void print_row(const char* name, const struct histogram* h, long ok, long fail, double elapsed) {
+    printf("%-10s %10ld %10ld %10ld %10.0f", name, ok + fail, ok, fail, (ok + fail) / elapsed);
+    static const double points[] = { 50, 90, 99, 99.9, 99.99 };
+    for (int i = 0; i < 5; i++) printf(" %9.1f", h->total ? hist_percentile(h, points[i]) / 1000.0 : 0);
+    printf(" %9.1f\n", h->max / 1000.0);
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-h host] [-p port] [-c connections] [-t threads] [-d seconds]\n"
+                    "       %*s [-m book:cancel:available:best] [-k seats] [-z zipf_s] [-n seats]\n"
+                    "       %*s [-r rate] [-P depth] [-b] [-S]\n",
+            prog, (int)strlen(prog), "", (int)strlen(prog), "");
+    exit(1);
+}
+
+int main(int argc, char* argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "h:p:c:t:d:m:k:z:n:r:P:bS")) != -1) {
+        switch (opt) {
+        case 'h': host = optarg; break;
+        case 'p': port = optarg; break;
+        case 'c': num_conns = atoi(optarg); break;
+        case 't': num_threads = atoi(optarg); break;
+        case 'd': seconds = atof(optarg); break;
+        case 'm':
+            if (sscanf(optarg, "%d:%d:%d:%d", &mix[0], &mix[1], &mix[2], &mix[3]) < 3) usage(argv[0]);
+            break;
+        case 'k': k_seats = atoi(optarg); break;
+        case 'z': zipf_s = atof(optarg); break;
+        case 'n': num_seats = atoi(optarg); break;
+        case 'r': rate = atof(optarg); break;
+        case 'P': depth = atoi(optarg); break;
+        case 'b': binary = 1; break;
+        case 'S': syscalls = 1; break;
+        default: usage(argv[0]);
+        }
+    }
+    mix_total = mix[0] + mix[1] + mix[2] + mix[3];
+    if (num_conns < 1 || num_threads < 1 || seconds <= 0 || k_seats < 1 || k_seats > MAX_K || zipf_s < 0 ||
+        mix[0] < 0 || mix[1] < 0 || mix[2] < 0 || mix[3] < 0 || mix_total == 0 || rate < 0) usage(argv[0]);
+    if (num_threads > num_conns) num_threads = num_conns;
+    /* Open loop lets requests queue up per connection; closed loop keeps exactly depth in flight */
+    if (depth < 1 || depth > MAX_DEPTH) usage(argv[0]);
+    if (rate > 0 && depth == 1) depth = MAX_DEPTH;
+
+    signal(SIGPIPE, SIG_IGN);
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < (rlim_t)num_conns + 64) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM }, *addr;
+    if (getaddrinfo(host, port, &hints, &addr) != 0) {
+        fprintf(stderr, "Cannot resolve %s:%s\n", host, port);
+        return 1;
+    }
+    if (num_seats <= 0 && (num_seats = query_seats(addr)) <= 0) {
+        fprintf(stderr, "Cannot get the venue size from %s:%s\n", host, port);
+        return 1;
+    }
+    if (k_seats > num_seats) usage(argv[0]);
+    zipf_init(num_seats);
+
+    struct conn* conns = calloc(num_conns, sizeof(*conns));
+    struct worker* workers = calloc(num_threads, sizeof(*workers));
+    if (!conns || !workers) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    for (int i = 0; i < num_conns; i++) {
+        if ((conns[i].fd = open_conn(addr)) < 0) {
+            fprintf(stderr, "Connection %d to %s:%s failed: %s\n", i + 1, host, port, strerror(errno));
+            return 1;
+        }
+        if (binary && write(conns[i].fd, "\xb1", 1) != 1) return 1;
+    }
+    long long syscalls_before = syscalls ? query_syscalls(addr) : -1;
+
+    printf("%d connections, %d threads, %s, %s, %.1fs, %d seats, zipf %.2f, mix %d:%d:%d:%d, %d seats/request\n",
+           num_conns, num_threads, binary ? "binary" : "text", rate > 0 ? "open loop" : "closed loop", seconds,
+           num_seats, zipf_s, mix[0], mix[1], mix[2], mix[3], k_seats);
+    if (rate > 0) printf("target %.0f req/s\n", rate);
+    else printf("%d in flight per connection\n", depth);
+
+    uint64_t start = now_ns();
+    end_ns = start + (uint64_t)(seconds * 1e9);
+    for (int t = 0; t < num_threads; t++) {
+        struct worker* w = &workers[t];
+        w->id = t;
+        w->conns = &conns[t * num_conns / num_threads];
+        w->num_conns = (t + 1) * num_conns / num_threads - t * num_conns / num_threads;
+        w->rng = 0x9e3779b97f4a7c15ULL * (t + 1) ^ start;
+        pthread_create(&w->thread, NULL, worker_run, w);
+    }
+    static struct histogram total, per_op[NUM_OPS];
+    long ok[NUM_OPS] = { 0 }, fail[NUM_OPS] = { 0 }, errors = 0, unsent = 0;
+    for (int t = 0; t < num_threads; t++) {
+        pthread_join(workers[t].thread, NULL);
+        for (int o = 0; o < NUM_OPS; o++) {
+            hist_merge(&per_op[o], &workers[t].hist[o]);
+            hist_merge(&total, &workers[t].hist[o]);
+            ok[o] += workers[t].ok[o];
+            fail[o] += workers[t].fail[o];
+        }
+        errors += workers[t].errors;
+        unsent += workers[t].unsent;
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+    long long syscalls_after = syscalls_before >= 0 ? query_syscalls(addr) : -1;
+    freeaddrinfo(addr);
+
+    printf("\n%-10s %10s %10s %10s %10s %9s %9s %9s %9s %9s %9s\n", "op", "requests", "ok", "fail", "req/s",
+           "p50 us", "p90 us", "p99 us", "p99.9 us", "p99.99", "max us");
+    long all_ok = 0, all_fail = 0;
+    for (int o = 0; o < NUM_OPS; o++) {
+        if (ok[o] + fail[o] == 0) continue;
+        print_row(op_names[o], &per_op[o], ok[o], fail[o], elapsed);
+        all_ok += ok[o];
+        all_fail += fail[o];
+    }
+    print_row("total", &total, all_ok, all_fail, elapsed);
+    if (errors) printf("\n%ld connections lost\n", errors);
+    if (unsent) printf("\n%ld requests were due but never sent (every connection had %d in flight)\n", unsent, depth);
+    if (syscalls && syscalls_after < 0) printf("\nThe server does not report syscalls in STATS\n");
+    else if (syscalls && all_ok + all_fail > 0)
+        printf("\nserver network syscalls: %lld, %.3f per request\n", syscalls_after - syscalls_before,
+               (double)(syscalls_after - syscalls_before) / (all_ok + all_fail));
+
+    for (int i = 0; i < num_conns; i++) {
+        close(conns[i].fd);
+        free(conns[i].in);
+        free(conns[i].out);
+        free(conns[i].owned);
+    }
+    free(conns);
+    free(workers);
+    return 0;
+}
@@ -0,0 +1,244 @@
+/*
+ * Asynchronous request log, see logger.h
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include "logger.h"
+#include "trace.h"
+
+#define LOG_BATCH_BYTES (256 * 1024)
+#define LOG_LINE_MAX 192
+#define LOG_POLL_MS 1  /* writer poll interval while records keep arriving */
+#define CACHE_LINE 64
+
+struct log_record {
+    int64_t sec;
+    uint32_t ip;   /* network byte order, formatted by the writer */
+    uint16_t port;
+    char action[LOG_ACTION_LEN];
+    char result[LOG_RESULT_LEN];
+};
+
+/* One producer (the owning thread), one consumer (the writer) */
+struct log_ring {
+    _Alignas(CACHE_LINE) _Atomic uint32_t head;  /* producer line */
+    uint32_t tail_cache;
+    _Atomic uint64_t dropped;
+    _Alignas(CACHE_LINE) _Atomic uint32_t tail;  /* consumer line */
+    uint64_t reported;
+    _Atomic int orphaned;  /* owning thread exited */
+    uint32_t size;         /* records, power of two */
+    struct log_ring* next;
+    _Alignas(CACHE_LINE) struct log_record records[];
+};
+
+static _Atomic(struct log_ring*) rings;  /* pushed by producers, unlinked only by the writer */
+static __thread struct log_ring* my_ring;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static pthread_t writer;
+static int flush_interval_ms = LOG_FLUSH_MS;
+static uint32_t ring_size = LOG_RING_SIZE;
+static atomic_int writer_started, writer_stop, writer_done;
+
+static void ring_orphan(void* arg) {
+    atomic_store_explicit(&((struct log_ring*)arg)->orphaned, 1, memory_order_release);
+}
+
+static void ring_key_create(void) {
+    pthread_key_create(&ring_key, ring_orphan);
+}
+
+static struct log_ring* ring_register(void) {
+    struct log_ring* r;
+    if (posix_memalign((void**)&r, CACHE_LINE, sizeof(*r) + ring_size * sizeof(struct log_record)) != 0) return NULL;
+    memset(r, 0, offsetof(struct log_ring, records));
+    r->size = ring_size;
+    pthread_once(&ring_key_once, ring_key_create);
+    pthread_setspecific(ring_key, r);
+    r->next = atomic_load_explicit(&rings, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&rings, &r->next, r, memory_order_release, memory_order_relaxed))
+        ;
+    return my_ring = r;
+}
+
+static void copy_field(char* dst, const char* src, size_t size) {
+    size_t i = 0;
+    for (; i < size - 1 && src[i]; i++) dst[i] = src[i];
+    dst[i] = '\0';
+}
+
+void log_request(const char* action, struct sockaddr_in* client_addr, const char* result) {
+    TRACE_SCOPE("log_request");
+    struct log_ring* r = my_ring ? my_ring : ring_register();
+    if (!r) return;
+    uint32_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if (h - r->tail_cache >= r->size) {
+        r->tail_cache = atomic_load_explicit(&r->tail, memory_order_acquire);
+        if (h - r->tail_cache >= r->size) {
+            atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+            return;
+        }
+    }
+    struct log_record* rec = &r->records[h & (r->size - 1)];
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    rec->sec = ts.tv_sec;
+    rec->ip = client_addr->sin_addr.s_addr;
+    rec->port = client_addr->sin_port;
+    copy_field(rec->action, action, sizeof(rec->action));
+    copy_field(rec->result, result, sizeof(rec->result));
+    atomic_store_explicit(&r->head, h + 1, memory_order_release);
+}
+
+/* Writer side: the timestamp string is rendered once per distinct second */
+static const char* time_string(int64_t sec) {
+    static int64_t cached_sec = -1;
+    static char cached[32];
+    if (sec != cached_sec) {
+        time_t t = sec;
+        struct tm tm;
+        localtime_r(&t, &tm);
+        strftime(cached, sizeof(cached), "%a %b %e %H:%M:%S %Y", &tm);
+        cached_sec = sec;
+    }
+    return cached;
+}
+
+static void write_all(const char* buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(STDOUT_FILENO, buf, len);
+        if (n <= 0) return;  /* the sink is gone; the records are lost either way */
+        buf += n;
+        len -= n;
+    }
+}
+
+/* Make room for one more line, writing the batch out early if it is full */
+static void batch_reserve(char* batch, size_t* len) {
+    if (*len > LOG_BATCH_BYTES - LOG_LINE_MAX) {
+        write_all(batch, *len);
+        *len = 0;
+    }
+}
+
+static int drain_ring(struct log_ring* r, char* batch, size_t* len) {
+    uint32_t t = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    uint32_t h = atomic_load_explicit(&r->head, memory_order_acquire);
+    int n = 0;
+    for (; t != h; t++, n++) {
+        batch_reserve(batch, len);
+        struct log_record* rec = &r->records[t & (r->size - 1)];
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &rec->ip, ip, sizeof(ip));
+        *len += snprintf(batch + *len, LOG_LINE_MAX, "[%s] Client %s:%d - %s - %s\n",
+                         time_string(rec->sec), ip, ntohs(rec->port), rec->action, rec->result);
+        atomic_store_explicit(&r->tail, t + 1, memory_order_release);
+    }
+    uint64_t dropped = atomic_load_explicit(&r->dropped, memory_order_relaxed);
+    if (dropped != r->reported) {
+        batch_reserve(batch, len);
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+        *len += snprintf(batch + *len, LOG_LINE_MAX, "[%s] Logger - dropped %llu records\n",
+                         time_string(ts.tv_sec), (unsigned long long)(dropped - r->reported));
+        r->reported = dropped;
+    }
+    return n;
+}
+
+/* Drain every ring once, freeing rings whose thread has exited */
+static int drain_all(char* batch, size_t* len) {
+    int n = 0;
+    struct log_ring* prev = NULL;
+    struct log_ring* r = atomic_load_explicit(&rings, memory_order_acquire);
+    while (r) {
+        int orphaned = atomic_load_explicit(&r->orphaned, memory_order_acquire);
+        n += drain_ring(r, batch, len);
+        struct log_ring* next = r->next;
+        if (!orphaned) {
+            prev = r;
+        } else if (prev) {
+            prev->next = next;
+            free(r);
+        } else {
+            struct log_ring* expected = r;
+            if (!atomic_compare_exchange_strong(&rings, &expected, next)) {
+                /* new rings were pushed in front; r is now further down */
+                for (prev = expected; prev->next != r; prev = prev->next)
+                    ;
+                prev->next = next;
+            }
+            free(r);
+        }
+        r = next;
+    }
+    return n;
+}
+
+static void sleep_ms(int ms) {
+    struct timespec ts = {ms / 1000, (ms % 1000) * 1000000L};
+    nanosleep(&ts, NULL);
+}
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void* logger_run(void* arg) {
+    (void)arg;
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    char* batch = malloc(LOG_BATCH_BYTES);
+    size_t len = 0;
+    int64_t last_write = now_ms();
+    int idle_ms = LOG_POLL_MS;
+    while (!atomic_load(&writer_stop)) {
+        /* Poll often while busy so rings don't overflow, back off when idle */
+        if (drain_all(batch, &len) > 0) idle_ms = LOG_POLL_MS;
+        else if (idle_ms < flush_interval_ms) idle_ms *= 2;
+        int64_t now = now_ms();
+        if (len > 0 && (now - last_write >= flush_interval_ms || len > LOG_BATCH_BYTES / 2)) {
+            write_all(batch, len);
+            len = 0;
+            last_write = now;
+        }
+        sleep_ms(idle_ms < flush_interval_ms ? idle_ms : flush_interval_ms);
+    }
+    drain_all(batch, &len);
+    write_all(batch, len);
+    atomic_store(&writer_done, 1);
+    return NULL;
+}
+
+int logger_start(int flush_ms, int records_per_thread) {
+    if (flush_ms < 1 || records_per_thread < 1 || (records_per_thread & (records_per_thread - 1))) return -1;
+    flush_interval_ms = flush_ms;
+    ring_size = records_per_thread;
+    if (pthread_create(&writer, NULL, logger_run, NULL) != 0) return -1;
+    atomic_store(&writer_started, 1);
+    return 0;
+}
+
+void logger_shutdown(void) {
+    if (!atomic_load(&writer_started)) return;
+    atomic_store(&writer_stop, 1);
+    for (int i = 0; i < 2000 && !atomic_load(&writer_done); i++) sleep_ms(1);
+}
@@ -0,0 +1,30 @@
+/*
+ * Asynchronous request log
+ * Each thread appends fixed-size binary records to its own single-producer
+ * ring; a writer thread drains every ring, formats the records (with a
+ * timestamp string rendered once per second) and writes them to stdout in
+ * batches. The request path never locks, formats or makes a syscall: when a
+ * ring is full the record is dropped and counted, and the writer reports
+ * the drops in the log. A thread's ring is allocated on its first record;
+ * with a thread per connection the rings are kept small (LOG_RING_SMALL),
+ * since every connection has one.
+ */
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <netinet/in.h>
+
+#define LOG_FLUSH_MS 100     /* default interval between batched writes */
+#define LOG_RING_SIZE 1024   /* records per thread, power of two */
+#define LOG_RING_SMALL 32    /* records per thread with a thread per connection (~3 KB) */
+#define LOG_ACTION_LEN 12
+#define LOG_RESULT_LEN 64
+
+/* records_per_thread: ring size, a power of two */
+int logger_start(int flush_ms, int records_per_thread);
+void log_request(const char* action, struct sockaddr_in* client_addr, const char* result);
+/* Drain and write everything logged so far; async-signal-safe */
+void logger_shutdown(void);
+
+#endif
@@ -0,0 +1,213 @@
+/*
+ * Server metrics, see metrics.h
+ */
+
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "metrics.h"
+
+#define CACHE_LINE 64
+#define HIST_SUB_BITS 4
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS 40
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB)
+
+struct metrics_shard {
+    _Atomic uint64_t results[METRICS_COMMANDS][METRICS_RESULTS];
+    _Atomic uint64_t latency_sum[METRICS_COMMANDS];
+    _Atomic uint64_t bytes_in, bytes_out, opened, closed, syscalls;
+    _Atomic uint64_t latency[METRICS_COMMANDS][HIST_BUCKETS];
+} __attribute__((aligned(CACHE_LINE)));
+
+/* Sum over every shard */
+struct metrics_totals {
+    uint64_t results[METRICS_COMMANDS][METRICS_RESULTS];
+    uint64_t latency_sum[METRICS_COMMANDS];
+    uint64_t bytes_in, bytes_out, opened, closed, syscalls;
+    uint64_t latency[METRICS_COMMANDS][HIST_BUCKETS];
+};
+
+static struct metrics_shard shards[METRICS_SHARDS];
+static _Atomic unsigned next_shard;
+static __thread struct metrics_shard* my_shard;
+static const char* const* command_names;
+static const char* const* result_names;
+static int num_command_names, num_result_names;
+
+void metrics_init(const char* const* commands, int num_commands, const char* const* results, int num_results) {
+    command_names = commands;
+    num_command_names = num_commands < METRICS_COMMANDS ? num_commands : METRICS_COMMANDS;
+    result_names = results;
+    num_result_names = num_results < METRICS_RESULTS ? num_results : METRICS_RESULTS;
+}
+
+static struct metrics_shard* shard(void) {
+    if (!my_shard) my_shard = &shards[atomic_fetch_add_explicit(&next_shard, 1, memory_order_relaxed) % METRICS_SHARDS];
+    return my_shard;
+}
+
+static inline void add(_Atomic uint64_t* counter, uint64_t v) {
+    atomic_fetch_add_explicit(counter, v, memory_order_relaxed);
+}
+
+uint64_t metrics_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int hist_index(uint64_t v) {
+    if (v < HIST_SUB) return v;
+    int shift = 63 - __builtin_clzll(v) - HIST_SUB_BITS;
+    if (shift > HIST_MAX_BITS - HIST_SUB_BITS - 1) return HIST_BUCKETS - 1;
+    return (shift + 1) * HIST_SUB + (int)((v >> shift) - HIST_SUB);
+}
+
+/* Highest value that lands in bucket i */
+static uint64_t hist_value(int i) {
+    if (i < HIST_SUB) return i;
+    int shift = i / HIST_SUB - 1;
+    return ((uint64_t)(i % HIST_SUB + HIST_SUB + 1) << shift) - 1;
+}
+
+void metrics_command(int command, int result, uint64_t ns) {
+    struct metrics_shard* s = shard();
+    if (command < 0 || command >= METRICS_COMMANDS) return;
+    add(&s->results[command][result < METRICS_RESULTS ? result : METRICS_RESULTS - 1], 1);
+    add(&s->latency_sum[command], ns);
+    add(&s->latency[command][hist_index(ns)], 1);
+}
+
+void metrics_bytes(uint64_t in, uint64_t out) {
+    struct metrics_shard* s = shard();
+    if (in) add(&s->bytes_in, in);
+    if (out) add(&s->bytes_out, out);
+}
+
+void metrics_syscalls(uint64_t n) {
+    add(&shard()->syscalls, n);
+}
+
+void metrics_conn(int opened) {
+    add(opened ? &shard()->opened : &shard()->closed, 1);
+}
+
+static void collect(struct metrics_totals* t) {
+    memset(t, 0, sizeof(*t));
+    for (int i = 0; i < METRICS_SHARDS; i++) {
+        struct metrics_shard* s = &shards[i];
+        for (int c = 0; c < METRICS_COMMANDS; c++) {
+            for (int r = 0; r < METRICS_RESULTS; r++)
+                t->results[c][r] += atomic_load_explicit(&s->results[c][r], memory_order_relaxed);
+            t->latency_sum[c] += atomic_load_explicit(&s->latency_sum[c], memory_order_relaxed);
+            for (int b = 0; b < HIST_BUCKETS; b++)
+                t->latency[c][b] += atomic_load_explicit(&s->latency[c][b], memory_order_relaxed);
+        }
+        t->bytes_in += atomic_load_explicit(&s->bytes_in, memory_order_relaxed);
+        t->bytes_out += atomic_load_explicit(&s->bytes_out, memory_order_relaxed);
+        t->opened += atomic_load_explicit(&s->opened, memory_order_relaxed);
+        t->closed += atomic_load_explicit(&s->closed, memory_order_relaxed);
+        t->syscalls += atomic_load_explicit(&s->syscalls, memory_order_relaxed);
+    }
+}
+
+static uint64_t command_count(const struct metrics_totals* t, int c) {
+    uint64_t n = 0;
+    for (int r = 0; r < METRICS_RESULTS; r++) n += t->results[c][r];
+    return n;
+}
+
+static uint64_t percentile(const struct metrics_totals* t, int c, double p) {
+    uint64_t total = command_count(t, c), rank = (uint64_t)(p / 100 * total + 0.999999), seen = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++)
+        if ((seen += t->latency[c][b]) >= rank && seen > 0) return hist_value(b);
+    return 0;
+}
+
+/* Lower-case copy of a name for STATS keys */
+static const char* key(const char* name) {
+    static __thread char buf[32];
+    size_t i = 0;
+    for (; name[i] && i < sizeof(buf) - 1; i++) buf[i] = name[i] >= 'A' && name[i] <= 'Z' ? name[i] + 32 : name[i];
+    buf[i] = '\0';
+    return buf;
+}
+
+/* Too big for a stack, so one copy shared by every reader */
+static struct metrics_totals totals;
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void metrics_write_stats(FILE* f) {
+    struct metrics_totals* t = &totals;
+    pthread_mutex_lock(&totals_lock);
+    collect(t);
+    fprintf(f, "STATS connections=%llu connections_total=%llu bytes_in=%llu bytes_out=%llu syscalls=%llu",
+            (unsigned long long)(t->opened - t->closed), (unsigned long long)t->opened,
+            (unsigned long long)t->bytes_in, (unsigned long long)t->bytes_out, (unsigned long long)t->syscalls);
+    for (int c = 0; c < num_command_names; c++) {
+        uint64_t n = command_count(t, c);
+        if (n == 0) continue;
+        fprintf(f, " %s=%llu", key(command_names[c]), (unsigned long long)n);
+        for (int r = 1; r < num_result_names; r++)
+            if (t->results[c][r])
+                fprintf(f, " %s_%s=%llu", key(command_names[c]), result_names[r], (unsigned long long)t->results[c][r]);
+        fprintf(f, " %s_p50_us=%.1f", key(command_names[c]), percentile(t, c, 50) / 1000.0);
+        fprintf(f, " %s_p99_us=%.1f", key(command_names[c]), percentile(t, c, 99) / 1000.0);
+    }
+    pthread_mutex_unlock(&totals_lock);
+}
+
+void metrics_write_prometheus(FILE* f) {
+    struct metrics_totals* t = &totals;
+    pthread_mutex_lock(&totals_lock);
+    collect(t);
+    fprintf(f, "# HELP ticket_commands_total Commands processed, by command and result.\n"
+               "# TYPE ticket_commands_total counter\n");
+    for (int c = 0; c < num_command_names; c++)
+        for (int r = 0; r < num_result_names; r++)
+            if (t->results[c][r])
+                fprintf(f, "ticket_commands_total{command=\"%s\",result=\"%s\"} %llu\n", command_names[c],
+                        result_names[r], (unsigned long long)t->results[c][r]);
+
+    /* Exported at powers of two from ~1us to ~1s; a bucket boundary of the histogram sits on each */
+    fprintf(f, "# HELP ticket_command_duration_seconds Time to process one command.\n"
+               "# TYPE ticket_command_duration_seconds histogram\n");
+    for (int c = 0; c < num_command_names; c++) {
+        uint64_t n = command_count(t, c), below = 0;
+        if (n == 0) continue;
+        int b = 0;
+        for (int k = 10; k <= 30; k++) {
+            for (; b < (k - HIST_SUB_BITS + 1) * HIST_SUB; b++) below += t->latency[c][b];
+            fprintf(f, "ticket_command_duration_seconds_bucket{command=\"%s\",le=\"%.10g\"} %llu\n", command_names[c],
+                    (double)(1ULL << k) / 1e9, (unsigned long long)below);
+        }
+        fprintf(f, "ticket_command_duration_seconds_bucket{command=\"%s\",le=\"+Inf\"} %llu\n", command_names[c],
+                (unsigned long long)n);
+        fprintf(f, "ticket_command_duration_seconds_sum{command=\"%s\"} %.9f\n", command_names[c],
+                t->latency_sum[c] / 1e9);
+        fprintf(f, "ticket_command_duration_seconds_count{command=\"%s\"} %llu\n", command_names[c],
+                (unsigned long long)n);
+    }
+
+    fprintf(f, "# HELP ticket_bytes_received_total Bytes read from clients.\n"
+               "# TYPE ticket_bytes_received_total counter\n"
+               "ticket_bytes_received_total %llu\n"
+               "# HELP ticket_bytes_sent_total Bytes written to clients.\n"
+               "# TYPE ticket_bytes_sent_total counter\n"
+               "ticket_bytes_sent_total %llu\n"
+               "# HELP ticket_connections Open client connections.\n"
+               "# TYPE ticket_connections gauge\n"
+               "ticket_connections %llu\n"
+               "# HELP ticket_connections_total Client connections accepted.\n"
+               "# TYPE ticket_connections_total counter\n"
+               "ticket_connections_total %llu\n"
+               "# HELP ticket_network_syscalls_total System calls made to accept, receive, send and wait for clients.\n"
+               "# TYPE ticket_network_syscalls_total counter\n"
+               "ticket_network_syscalls_total %llu\n",
+            (unsigned long long)t->bytes_in, (unsigned long long)t->bytes_out,
+            (unsigned long long)(t->opened - t->closed), (unsigned long long)t->opened,
+            (unsigned long long)t->syscalls);
+    pthread_mutex_unlock(&totals_lock);
+}
@@ -0,0 +1,42 @@
+/*
+ * Server metrics
+ * Counters and latency histograms live in METRICS_SHARDS cache-line aligned
+ * shards; each thread picks one on first use, so with a fixed set of event
+ * loops every loop has its own and updates never share a cache line. Under
+ * thread-per-client, threads share shards round-robin, which is why updates
+ * are relaxed atomic adds rather than plain stores. Nothing is aggregated
+ * until STATS or a scrape asks for it.
+ * Latencies are per command in log-linear histograms: 16 sub-buckets per
+ * power of two of nanoseconds (at most 6% error), up to 2^40 ns.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define METRICS_SHARDS 64
+#define METRICS_COMMANDS 24   /* command ids 0..23 */
+#define METRICS_RESULTS 16    /* result 0 is success, the others are failure reasons */
+
+/* Names for command ids and results, used when formatting */
+void metrics_init(const char* const* commands, int num_commands, const char* const* results, int num_results);
+
+uint64_t metrics_now(void);
+
+/* One command finished with result after ns nanoseconds */
+void metrics_command(int command, int result, uint64_t ns);
+
+void metrics_bytes(uint64_t in, uint64_t out);
+void metrics_conn(int opened);   /* 1 when a connection opens, 0 when it closes */
+/* Network system calls (accept, recv, send, epoll_wait, io_uring_enter) */
+void metrics_syscalls(uint64_t n);
+
+/* One line: STATS key=value ... (no newline) */
+void metrics_write_stats(FILE* f);
+
+/* Prometheus text exposition format */
+void metrics_write_prometheus(FILE* f);
+
+#endif
@@ -0,0 +1,183 @@
+/*
+ * Text command parser, see parse.h
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <limits.h>
+#include "parse.h"
+
+static const struct keyword {
+    const char* name;
+    size_t len;
+    enum command_type type;
+} keywords[] = {
+    { "EXIT", 4, CMD_EXIT }, { "EVENTS", 6, CMD_EVENTS },
+    { "AVAILABLE", 9, CMD_AVAILABLE }, { "LAYOUT", 6, CMD_LAYOUT },
+    { "BOOK", 4, CMD_BOOK }, { "CANCEL", 6, CMD_CANCEL },
+    { "LOGIN", 5, CMD_LOGIN }, { "RESUME", 6, CMD_RESUME }, { "MINE", 4, CMD_MINE },
+    { "HOLD", 4, CMD_HOLD }, { "CONFIRM", 7, CMD_CONFIRM }, { "RELEASE", 7, CMD_RELEASE },
+    { "STATS", 5, CMD_STATS }, { "TRACE", 5, CMD_TRACE }, { "PROMOTE", 7, CMD_PROMOTE }
+};
+
+static inline int is_space(char ch) {
+    return ch == ' ' || ch == '\t';
+}
+
+/* Case-insensitive prefix match against an upper-case keyword */
+static int has_prefix(const char* p, size_t len, const struct keyword* kw) {
+    if (len < kw->len) return 0;
+    for (size_t i = 0; i < kw->len; i++)
+        if ((p[i] & ~0x20) != kw->name[i]) return 0;
+    return 1;
+}
+
+/* Decimal digits up to the next separator; -1 if anything else, clamped to INT_MAX */
+static long parse_number(const char** pp, const char* end) {
+    const char* p = *pp;
+    long v = 0;
+    if (p == end || (unsigned)(*p - '0') > 9) return -1;
+    for (; p < end && (unsigned)(*p - '0') <= 9; p++)
+        if ((v = v * 10 + (*p - '0')) > INT_MAX) v = INT_MAX;
+    if (p < end && !is_space(*p)) return -1;
+    *pp = p;
+    return v;
+}
+
+static const char* skip_space(const char* p, const char* end) {
+    while (p < end && is_space(*p)) p++;
+    return p;
+}
+
+void parse_command(const char* line, size_t len, struct command* cmd) {
+    cmd->event = 0;
+    cmd->args = line;
+    cmd->args_len = 0;
+    for (size_t i = 0; i < len; i++)
+        if (line[i] == '\r' || line[i] == '\0') len = i;
+    if (len == 0) {
+        cmd->type = CMD_EMPTY;
+        cmd->name = "";
+        return;
+    }
+    const struct keyword* kw = keywords;
+    while (kw < keywords + sizeof(keywords) / sizeof(keywords[0]) && !has_prefix(line, len, kw)) kw++;
+    if (kw == keywords + sizeof(keywords) / sizeof(keywords[0])) {
+        cmd->type = CMD_UNKNOWN;
+        cmd->name = "UNKNOWN";
+        cmd->args_len = len;
+        return;
+    }
+    cmd->type = kw->type;
+    cmd->name = kw->name;
+
+    const char* end = line + len;
+    const char* p = skip_space(line + kw->len, end);
+    if (p < end && *p == '@') {
+        const char* q = p + 1;
+        long id = parse_number(&q, end);
+        cmd->event = id < 1 ? -1 : id;
+        p = skip_space(q, end);
+    }
+    cmd->args = p;
+    cmd->args_len = end - p;
+}
+
+enum parse_error parse_seats(const char* args, size_t len, int total_seats, int* seat_nums, int* num_seats) {
+    const char* end = args + len;
+    const char* p = skip_space(args, end);
+    *num_seats = 0;
+    if (p == end) return PARSE_NO_COUNT;
+    long expected = parse_number(&p, end);
+    if (expected < 0) return PARSE_BAD_NUMBER;
+    if (expected == 0 || expected > MAX_REQUEST_SEATS || expected > total_seats) return PARSE_BAD_COUNT;
+
+    int n = 0;
+    for (p = skip_space(p, end); p < end; p = skip_space(p, end)) {
+        if (n == expected) return PARSE_TOO_MANY;
+        long seat = parse_number(&p, end);
+        if (seat < 0) return PARSE_BAD_NUMBER;
+        seat_nums[n++] = seat;
+    }
+    *num_seats = n;
+    if (n < expected) return PARSE_TOO_FEW;
+    return check_seats(seat_nums, n, total_seats);
+}
+
+int parse_all(const char* args, size_t len) {
+    static const struct keyword all = { "ALL", 3, CMD_CANCEL };
+    const char* end = args + len;
+    const char* p = skip_space(args, end);
+    return has_prefix(p, end - p, &all) && skip_space(p + 3, end) == end;
+}
+
+int parse_best(const char* args, size_t len, struct best_request* req, enum parse_error* err) {
+    static const struct keyword best = { "BEST", 4, CMD_BOOK };
+    const char* end = args + len;
+    const char* p = skip_space(args, end);
+    if (!has_prefix(p, end - p, &best) || (p + 4 < end && !is_space(p[4]))) return 0;
+    p = skip_space(p + 4, end);
+    req->section = NULL;
+    req->section_len = 0;
+    long count = parse_number(&p, end);
+    if (p == end && count < 0) *err = PARSE_NO_COUNT;
+    else if (count < 0) *err = PARSE_BAD_NUMBER;
+    else if (count == 0 || count > MAX_REQUEST_SEATS) *err = PARSE_BAD_COUNT;
+    else *err = PARSE_OK;
+    req->count = count;
+    p = skip_space(p, end);
+    if (*err != PARSE_OK || p == end) return 1;
+    const char* q = p;
+    while (q < end && !is_space(*q)) q++;
+    req->section = p;
+    req->section_len = q - p;
+    if (skip_space(q, end) != end) *err = PARSE_TOO_MANY;
+    return 1;
+}
+
+enum parse_error check_seats(const int* seat_nums, int n, int total_seats) {
+    /* One bit per venue seat, kept clear between calls so only the listed seats are touched */
+    static __thread uint64_t* seen;
+    static __thread int seen_words;
+    if (n <= 0 || n > MAX_REQUEST_SEATS || n > total_seats) return PARSE_BAD_COUNT;
+    for (int i = 0; i < n; i++)
+        if (seat_nums[i] < 1 || seat_nums[i] > total_seats) return PARSE_OUT_OF_RANGE;
+    if (n == 1) return PARSE_OK;
+    int words = (total_seats + 63) / 64;
+    if (seen_words < words) {
+        uint64_t* grown = calloc(words, sizeof(uint64_t));
+        if (!grown) {
+            /* Fall back to pairwise comparison */
+            for (int i = 0; i < n; i++)
+                for (int j = i + 1; j < n; j++)
+                    if (seat_nums[i] == seat_nums[j]) return PARSE_DUPLICATE;
+            return PARSE_OK;
+        }
+        free(seen);
+        seen = grown;
+        seen_words = words;
+    }
+    enum parse_error err = PARSE_OK;
+    int i = 0;
+    for (; i < n; i++) {
+        int idx = seat_nums[i] - 1;
+        uint64_t bit = 1ULL << (idx % 64);
+        if (seen[idx / 64] & bit) {
+            err = PARSE_DUPLICATE;
+            break;
+        }
+        seen[idx / 64] |= bit;
+    }
+    while (i-- > 0) seen[(seat_nums[i] - 1) / 64] = 0;
+    return err;
+}
+
+const char* parse_error_string(enum parse_error err) {
+    static const char* const strings[] = {
+        [PARSE_OK] = "ok", [PARSE_NO_COUNT] = "missing seat count",
+        [PARSE_BAD_COUNT] = "bad seat count", [PARSE_BAD_NUMBER] = "not a number",
+        [PARSE_TOO_FEW] = "fewer seats than count", [PARSE_TOO_MANY] = "more seats than count",
+        [PARSE_OUT_OF_RANGE] = "seat out of range", [PARSE_DUPLICATE] = "duplicate seat"
+    };
+    return strings[err];
+}
@@ -0,0 +1,64 @@
+/*
+ * Text command parser
+ * Works in place on a (pointer, length) view of one framed line: no copies,
+ * no allocation, no strtok/atoi. Keywords are matched case-insensitively as
+ * prefixes, the same way the server always has; seat lists are parsed in a
+ * single pass and duplicates are found with a per-thread bitmap in O(n).
+ */
+
+#ifndef PARSE_H
+#define PARSE_H
+
+#include <stddef.h>
+#include "seats.h"
+
+enum command_type {
+    CMD_EMPTY, CMD_UNKNOWN, CMD_EXIT, CMD_EVENTS,
+    CMD_AVAILABLE, CMD_LAYOUT, CMD_BOOK, CMD_CANCEL, CMD_LOGIN, CMD_RESUME, CMD_MINE,
+    CMD_HOLD, CMD_CONFIRM, CMD_RELEASE, CMD_STATS, CMD_TRACE, CMD_PROMOTE
+};
+
+enum parse_error {
+    PARSE_OK = 0,
+    PARSE_NO_COUNT,      /* no seat count */
+    PARSE_BAD_COUNT,     /* count is 0, over MAX_REQUEST_SEATS or larger than the venue */
+    PARSE_BAD_NUMBER,    /* a token is not a decimal number */
+    PARSE_TOO_FEW,       /* fewer seats than the count */
+    PARSE_TOO_MANY,      /* more seats than the count */
+    PARSE_OUT_OF_RANGE,  /* seat outside the venue */
+    PARSE_DUPLICATE      /* same seat twice */
+};
+
+struct command {
+    enum command_type type;
+    const char* name;    /* keyword as logged, e.g. "BOOK" */
+    long event;          /* 0 without "@<event>", -1 if malformed */
+    const char* args;    /* rest of the line after the keyword and event */
+    size_t args_len;
+};
+
+/* Split a line (without its newline) into keyword, optional @event and arguments */
+void parse_command(const char* line, size_t len, struct command* cmd);
+
+/* "<count> <seat> <seat> ..." with all the seat list rules checked */
+enum parse_error parse_seats(const char* args, size_t len, int total_seats, int* seat_nums, int* num_seats);
+
+/* "ALL" in place of a seat list (CANCEL ALL) */
+int parse_all(const char* args, size_t len);
+
+/* BOOK BEST <count> [section] */
+struct best_request {
+    int count;
+    const char* section;  /* NULL for any section */
+    size_t section_len;
+};
+
+/* Whether args start with BEST; if so *err tells whether the rest is valid */
+int parse_best(const char* args, size_t len, struct best_request* req, enum parse_error* err);
+
+/* Seat list rules on already decoded seats: 1..MAX_REQUEST_SEATS seats, inside the venue, no duplicates */
+enum parse_error check_seats(const int* seat_nums, int n, int total_seats);
+
+const char* parse_error_string(enum parse_error err);
+
+#endif
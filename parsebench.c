@@ -0,0 +1,166 @@
+/*
+ * Command parser micro-benchmark
+ * Usage: ./parsebench [-l lines] [-n seats] [-m max_request_seats] [-r rounds]
+ * Generates synthetic command lines (BOOK/CANCEL with 1..m random seats,
+ * AVAILABLE @event, and a few malformed lines), then times the in-place
+ * parser of parse.c against the old copy + strtok + atoi + pairwise
+ * duplicate check over the same buffer.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <time.h>
+#include "parse.h"
+
+#define LINE_MAX_LEN 1024
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* The parser as it was: upper-case copy, prefix compare, strtok/atoi, O(n^2) duplicates */
+static int legacy_check(const int* seat_nums, int n, int total_seats) {
+    if (n <= 0 || n > MAX_REQUEST_SEATS || n > total_seats) return -1;
+    for (int i = 0; i < n; i++) {
+        if (seat_nums[i] < 1 || seat_nums[i] > total_seats) return -1;
+        for (int j = i + 1; j < n; j++)
+            if (seat_nums[i] == seat_nums[j]) return -1;
+    }
+    return 0;
+}
+
+static int legacy_parse(char* command, int total_seats, int* seat_nums, int* num_seats) {
+    command[strcspn(command, "\r\n")] = '\0';
+    char cmd_upper[LINE_MAX_LEN];
+    strncpy(cmd_upper, command, LINE_MAX_LEN - 1);
+    cmd_upper[LINE_MAX_LEN - 1] = '\0';
+    for (int i = 0; cmd_upper[i]; i++) cmd_upper[i] = toupper(cmd_upper[i]);
+    if (strncmp(cmd_upper, "EXIT", 4) == 0 || strncmp(cmd_upper, "EVENTS", 6) == 0) return 0;
+    static const char* const commands[] = { "AVAILABLE", "LAYOUT", "BOOK", "CANCEL" };
+    int cmd = 0;
+    while (cmd < 4 && strncmp(cmd_upper, commands[cmd], strlen(commands[cmd])) != 0) cmd++;
+    if (cmd == 4) return -1;
+    char* args = command + strlen(commands[cmd]);
+    while (*args == ' ' || *args == '\t') args++;
+    if (*args == '@') {
+        char* end;
+        strtol(args + 1, &end, 10);
+        args = end;
+    }
+    if (cmd < 2) return 0;
+
+    char args_copy[LINE_MAX_LEN];
+    strncpy(args_copy, args, LINE_MAX_LEN - 1);
+    args_copy[LINE_MAX_LEN - 1] = '\0';
+    char* token = strtok(args_copy, " \t\n");
+    if (!token) return -1;
+    int expected = atoi(token);
+    if (expected <= 0 || expected > MAX_REQUEST_SEATS) return -1;
+    *num_seats = 0;
+    while ((token = strtok(NULL, " \t\n")) && *num_seats < expected) seat_nums[(*num_seats)++] = atoi(token);
+    if (token || *num_seats != expected) return -1;
+    return legacy_check(seat_nums, *num_seats, total_seats);
+}
+
+static int parse(const char* line, size_t len, int total_seats, int* seat_nums, int* num_seats) {
+    struct command cmd;
+    parse_command(line, len, &cmd);
+    if (cmd.type == CMD_UNKNOWN) return -1;
+    if (cmd.type != CMD_BOOK && cmd.type != CMD_CANCEL) return 0;
+    return parse_seats(cmd.args, cmd.args_len, total_seats, seat_nums, num_seats) == PARSE_OK ? 0 : -1;
+}
+
+/* Newline-separated lines; starts[i] is the offset of line i */
+static char* generate(long lines, int total_seats, int max_seats, size_t** starts, size_t* size) {
+    size_t cap = lines * 32 + 1024, len = 0;
+    char* buf = malloc(cap);
+    *starts = malloc((lines + 1) * sizeof(size_t));
+    if (!buf || !*starts) return NULL;
+    for (long i = 0; i < lines; i++) {
+        if (cap - len < (size_t)max_seats * 12 + 64) {
+            cap *= 2;
+            if (!(buf = realloc(buf, cap))) return NULL;
+        }
+        (*starts)[i] = len;
+        int kind = rand() % 100;
+        if (kind < 5) {
+            len += sprintf(buf + len, "AVAILABLE @%d", 1 + rand() % 4);
+        } else if (kind < 8) {
+            len += sprintf(buf + len, "BOOK 3 %d %d x", 1 + rand() % total_seats, 1 + rand() % total_seats);
+        } else {
+            int n = 1 + rand() % max_seats;
+            len += sprintf(buf + len, kind < 60 ? "BOOK %d" : "cancel %d", n);
+            /* Distinct seats from a random start, plus the odd duplicate */
+            int first = rand() % total_seats;
+            for (int k = 0; k < n; k++)
+                len += sprintf(buf + len, " %d", 1 + (first + (kind == 99 && k == n - 1 ? 0 : k)) % total_seats);
+        }
+        buf[len++] = '\n';
+    }
+    (*starts)[lines] = len;
+    *size = len;
+    return buf;
+}
+
+int main(int argc, char* argv[]) {
+    long lines = 2000000;
+    int total_seats = 1000, max_seats = 8, rounds = 3, opt;
+    while ((opt = getopt(argc, argv, "l:n:m:r:h")) != -1) {
+        switch (opt) {
+        case 'l': lines = atol(optarg); break;
+        case 'n': total_seats = atoi(optarg); break;
+        case 'm': max_seats = atoi(optarg); break;
+        case 'r': rounds = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-l lines] [-n seats] [-m max_request_seats] [-r rounds]\n", argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (lines < 1 || total_seats < 1 || max_seats < 1 || max_seats > MAX_REQUEST_SEATS || max_seats > total_seats ||
+        rounds < 1) {
+        fprintf(stderr, "Error: bad arguments\n");
+        return 1;
+    }
+
+    srand(42);
+    size_t* starts;
+    size_t size;
+    char* buf = generate(lines, total_seats, max_seats, &starts, &size);
+    char* scratch = malloc(size);
+    if (!buf || !scratch) {
+        fprintf(stderr, "Error: Cannot allocate %ld lines\n", lines);
+        return 1;
+    }
+    printf("%ld lines, %.1f MB, %d seats, up to %d seats per request\n", lines, size / 1e6, total_seats, max_seats);
+
+    int seat_nums[MAX_REQUEST_SEATS], num_seats;
+    for (int r = 0; r < rounds; r++) {
+        long bad = 0;
+        double start = now_sec();
+        for (long i = 0; i < lines; i++)
+            bad += parse(buf + starts[i], starts[i + 1] - starts[i] - 1, total_seats, seat_nums, &num_seats) < 0;
+        double in_place = now_sec() - start;
+
+        /* The old parser writes into its line, so it gets a fresh copy each round (not timed) */
+        memcpy(scratch, buf, size);
+        for (long i = 0; i < lines; i++) scratch[starts[i + 1] - 1] = '\0';
+        long legacy_bad = 0;
+        start = now_sec();
+        for (long i = 0; i < lines; i++)
+            legacy_bad += legacy_parse(scratch + starts[i], total_seats, seat_nums, &num_seats) < 0;
+        double legacy = now_sec() - start;
+
+        printf("round %d: in-place %6.1f ns/line (%ld rejected)   legacy %6.1f ns/line (%ld rejected)   %.2fx\n",
+               r + 1, in_place * 1e9 / lines, bad, legacy * 1e9 / lines, legacy_bad, legacy / in_place);
+    }
+    free(buf);
+    free(scratch);
+    free(starts);
+    return 0;
+}
@@ -0,0 +1,66 @@
+/*
+ * Binary wire protocol
+ * A connection whose first byte is BIN_MAGIC speaks fixed-layout frames
+ * instead of text lines (same port; text commands always start with ASCII).
+ * All integers are little-endian and frames are packed back to back, so
+ * readers should memcpy headers out rather than cast unaligned pointers.
+ *
+ *   request:  struct bin_request, then count uint32 seat numbers (BOOK/CANCEL/HOLD/...),
+ *             or for RESUME count = 8 and the 32-character session token, or for
+ *             BOOK_BEST count = 2: seats wanted, section (0 = any, k = k-th in LAYOUT)
+ *   response: struct bin_response, then for AVAILABLE (seat + 63) / 64 uint64
+ *             words of the event's free-seat bitmap (bit i set = seat i + 1 free),
+ *             for LOGIN the 32-character session token, for MINE, CANCEL_ALL and
+ *             BOOK_BEST seat uint32 seat numbers (the session's seats / the ones
+ *             cancelled / the ones booked)
+ *
+ * Responses come back in request order; tag is echoed so clients can match
+ * pipelined requests without counting.
+ */
+
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdint.h>
+
+#define BIN_MAGIC 0xB1
+
+enum bin_op {
+    BIN_OP_AVAILABLE = 1, BIN_OP_BOOK, BIN_OP_CANCEL, BIN_OP_LOGIN, BIN_OP_RESUME,
+    BIN_OP_MINE, BIN_OP_CANCEL_ALL, BIN_OP_HOLD, BIN_OP_CONFIRM, BIN_OP_RELEASE,
+    BIN_OP_BOOK_BEST
+};
+
+enum bin_status {
+    BIN_OK = 0,
+    BIN_TAKEN,          /* BOOK: seat already booked */
+    BIN_NOT_BOOKED,     /* CANCEL: seat is free */
+    BIN_NOT_OWNER,      /* CANCEL: seat booked by another client */
+    BIN_INVALID,        /* bad seat list */
+    BIN_UNKNOWN_EVENT,
+    BIN_UNKNOWN_OP,
+    BIN_NO_MEMORY,
+    BIN_BAD_SESSION,    /* RESUME: token not valid */
+    BIN_HELD,           /* CANCEL: seat is only held */
+    BIN_NOT_HELD,       /* CONFIRM/RELEASE: seat not held by this client */
+    BIN_READ_ONLY       /* a write sent to a replica */
+};
+
+struct bin_request {
+    uint16_t size;      /* whole frame, header included */
+    uint8_t op;
+    uint8_t count;      /* seat numbers that follow */
+    uint32_t event;     /* 0 = the first event */
+    uint32_t tag;
+} __attribute__((packed));
+
+struct bin_response {
+    uint32_t size;      /* whole frame, header included */
+    uint8_t op;
+    uint8_t status;
+    uint16_t pad;
+    uint32_t tag;
+    uint32_t seat;      /* failing seat, or the venue size for AVAILABLE */
+} __attribute__((packed));
+
+#endif
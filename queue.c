@@ -0,0 +1,73 @@
+/*
+ * Bounded lock-free MPMC queue, see queue.h
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "queue.h"
+
+int queue_init(struct queue* q, size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) size *= 2;
+    if (!(q->cells = malloc(size * sizeof(*q->cells)))) return -1;
+    for (size_t i = 0; i < size; i++) atomic_init(&q->cells[i].seq, i);
+    q->mask = size - 1;
+    atomic_init(&q->enqueue_pos, 0);
+    atomic_init(&q->dequeue_pos, 0);
+    return 0;
+}
+
+void queue_destroy(struct queue* q) {
+    free(q->cells);
+    q->cells = NULL;
+}
+
+int queue_push(struct queue* q, void* data) {
+    size_t pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+    struct queue_cell* cell;
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else if (dif < 0) {
+            return -1; /* the consumer of the previous lap has not emptied it */
+        } else {
+            pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+        }
+    }
+    cell->data = data;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+    return 0;
+}
+
+void* queue_pop(struct queue* q) {
+    size_t pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+    struct queue_cell* cell;
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->dequeue_pos, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else if (dif < 0) {
+            return NULL; /* not filled yet */
+        } else {
+            pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+        }
+    }
+    void* data = cell->data;
+    atomic_store_explicit(&cell->seq, pos + q->mask + 1, memory_order_release);
+    return data;
+}
+
+size_t queue_depth(struct queue* q) {
+    size_t head = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+}
@@ -0,0 +1,43 @@
+/*
+ * Bounded lock-free MPMC queue of pointers
+ * Each cell carries a sequence number that says whose turn it is: a
+ * producer may fill cell i when its sequence equals the enqueue position,
+ * a consumer may empty it when the sequence is one past it. Claiming a
+ * position is a single CAS on the shared counter, and producers and
+ * consumers only meet on the cell they hand over.
+ */
+
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+#define QUEUE_CACHE_LINE 64
+
+struct queue_cell {
+    _Atomic size_t seq;
+    void* data;
+};
+
+struct queue {
+    struct queue_cell* cells;
+    size_t mask;
+    _Alignas(QUEUE_CACHE_LINE) _Atomic size_t enqueue_pos;
+    _Alignas(QUEUE_CACHE_LINE) _Atomic size_t dequeue_pos;
+};
+
+/* Room for at least capacity items (rounded up to a power of two) */
+int queue_init(struct queue* q, size_t capacity);
+void queue_destroy(struct queue* q);
+
+/* Returns -1 when full */
+int queue_push(struct queue* q, void* data);
+
+/* Returns NULL when empty */
+void* queue_pop(struct queue* q);
+
+/* Items queued right now (approximate while others push or pop) */
+size_t queue_depth(struct queue* q);
+
+#endif
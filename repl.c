@@ -0,0 +1,541 @@
+/*
+ * Primary/replica replication, see repl.h
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <netdb.h>
+#include <time.h>
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "repl.h"
+#include "logger.h"
+
+/* A connected replica, served by its own sender thread */
+struct replica {
+    int fd;
+    struct sockaddr_in addr;
+    uint64_t pos;          /* stream offset of the next record to send */
+    uint64_t acked;
+    int need_image;        /* its position is not (or no longer) in the log */
+    struct replica *prev, *next;
+};
+
+/* Primary side; everything is guarded by lock */
+static struct {
+    int enabled;
+    pthread_mutex_t lock;
+    pthread_cond_t grew;       /* senders: records were appended */
+    int waiting;               /* senders blocked on grew */
+    char* data;                /* records after base, back to back */
+    size_t len, cap;
+    uint64_t folded;           /* stream offset of data[0] */
+    uint64_t base;             /* the image holds every record up to here */
+    uint64_t next_seq;
+    uint64_t epoch;
+    int64_t** image;           /* owner per seat, per event */
+    struct event* events;
+    int num_events;
+    size_t image_bytes;
+    struct replica* replicas;
+    int num_replicas;
+    int listen_fd;
+    pthread_t acceptor;
+} primary = { .lock = PTHREAD_MUTEX_INITIALIZER, .grew = PTHREAD_COND_INITIALIZER };
+
+/* Replica side */
+static struct {
+    struct sockaddr_in addr;
+    struct event* events;
+    int num_events;
+    journal_apply_fn apply;
+    void* arg;
+    _Atomic int following;
+    _Atomic int connected;
+    _Atomic uint64_t applied;
+    uint64_t epoch;            /* of the primary run applied is counted in; 0 = none */
+    pthread_mutex_t lock;      /* fd, for repl_promote */
+    pthread_cond_t stop;
+    int fd;
+    pthread_t thread;
+} follower = { .lock = PTHREAD_MUTEX_INITIALIZER, .stop = PTHREAD_COND_INITIALIZER, .fd = -1 };
+
+static void block_signals(void) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+}
+
+static int send_all(int fd, const void* buf, size_t len) {
+    const char* p = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int recv_all(int fd, void* buf, size_t len) {
+    char* p = buf;
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int reserve(char** buf, size_t* cap, size_t len) {
+    if (*cap >= len) return 0;
+    char* grown = realloc(*buf, len);
+    if (!grown) return -1;
+    *buf = grown;
+    *cap = len;
+    return 0;
+}
+
+/* Primary */
+
+/* Move the records before stream offset upto into the image */
+static void fold_locked(uint64_t upto) {
+    size_t n = upto - primary.folded;
+    for (size_t off = 0; off < n;) {
+        const struct journal_record* rec = (const void*)(primary.data + off);
+        int64_t* owners = primary.image[rec->event - 1];
+        for (int i = 0; i < rec->num_seats; i++)
+            owners[rec->seats[i] - 1] = rec->op == SEAT_OP_BOOK ? rec->owner : NO_OWNER;
+        primary.base = rec->lsn;
+        off += journal_record_size(rec->num_seats);
+    }
+    memmove(primary.data, primary.data + n, primary.len - n);
+    primary.len -= n;
+    primary.folded = upto;
+}
+
+/* Fold what every replica has been sent; past REPL_LOG_MAX fold it all and resend images */
+static void maybe_fold_locked(void) {
+    if (primary.len < REPL_LOG_FOLD) return;
+    uint64_t upto = primary.folded + primary.len;
+    for (struct replica* r = primary.replicas; r && primary.len < REPL_LOG_MAX; r = r->next)
+        if (!r->need_image && r->pos < upto) upto = r->pos;
+    for (struct replica* r = primary.replicas; r; r = r->next)
+        if (r->pos < upto) r->need_image = 1;
+    fold_locked(upto);
+}
+
+void repl_append(int op, int event, const int* seat_nums, int n, int64_t owner) {
+    if (!primary.enabled) return;
+    size_t size = journal_record_size(n);
+    pthread_mutex_lock(&primary.lock);
+    if (primary.len + size > primary.cap &&
+        reserve(&primary.data, &primary.cap, (primary.len + size) * 2) < 0) {
+        /* Out of memory: empty the log into the image, every replica resyncs from there */
+        fold_locked(primary.folded + primary.len);
+        for (struct replica* r = primary.replicas; r; r = r->next) r->need_image = 1;
+    }
+    journal_record_fill((void*)(primary.data + primary.len), primary.next_seq++, op, event, seat_nums, n, owner);
+    primary.len += size;
+    if (primary.waiting) pthread_cond_broadcast(&primary.grew);
+    pthread_mutex_unlock(&primary.lock);
+}
+
+/* Acknowledgements that have arrived, without waiting; -1 once the replica is gone */
+static int read_acks(struct replica* r, char* pending, size_t* have) {
+    for (;;) {
+        ssize_t n = recv(r->fd, pending + *have, sizeof(uint64_t) - *have, MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        if (n == 0) return -1;
+        *have += n;
+        if (*have == sizeof(uint64_t)) {
+            uint64_t seq;
+            memcpy(&seq, pending, sizeof(seq));
+            *have = 0;
+            pthread_mutex_lock(&primary.lock);
+            r->acked = seq;
+            pthread_mutex_unlock(&primary.lock);
+        }
+    }
+}
+
+/* The replica's hello: same venues, and where to start it */
+static int handshake(struct replica* r) {
+    struct repl_hello hello;
+    struct timeval timeout = { 5, 0 };
+    setsockopt(r->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (recv_all(r->fd, &hello, sizeof(hello)) < 0 || memcmp(hello.magic, REPL_MAGIC, 8) != 0 ||
+        hello.num_events != (uint32_t)primary.num_events) return -1;
+    for (int i = 0; i < primary.num_events; i++) {
+        uint32_t venue[2];
+        if (recv_all(r->fd, venue, sizeof(venue)) < 0 || venue[0] != (uint32_t)primary.events[i].id ||
+            venue[1] != (uint32_t)primary.events[i].venue.num_seats) return -1;
+    }
+    timeout.tv_sec = 0;
+    setsockopt(r->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    pthread_mutex_lock(&primary.lock);
+    r->need_image = 1;
+    if (hello.epoch == primary.epoch && hello.seq >= primary.base && hello.seq < primary.next_seq) {
+        size_t off = 0;
+        while (off < primary.len && ((const struct journal_record*)(primary.data + off))->lsn <= hello.seq)
+            off += journal_record_size(((const struct journal_record*)(primary.data + off))->num_seats);
+        r->pos = primary.folded + off;
+        r->acked = hello.seq;
+        r->need_image = 0;
+    }
+    pthread_mutex_unlock(&primary.lock);
+    return 0;
+}
+
+static void* sender_run(void* arg) {
+    struct replica* r = arg;
+    block_signals();
+    char* buf = NULL;
+    size_t cap = 0, have = 0;
+    char pending[sizeof(uint64_t)];
+    if (handshake(r) < 0) {
+        log_request("REPLICA", &r->addr, "FAIL: bad hello or different venues");
+        goto done;
+    }
+    log_request("REPLICA", &r->addr, r->need_image ? "Attached (image)" : "Attached (resumed)");
+
+    pthread_mutex_lock(&primary.lock);
+    for (;;) {
+        struct repl_msg msg = { .epoch = primary.epoch };
+        if (r->need_image) {
+            if (reserve(&buf, &cap, primary.image_bytes) < 0) break;
+            size_t off = 0;
+            for (int i = 0; i < primary.num_events; i++) {
+                size_t size = primary.events[i].venue.num_seats * sizeof(int64_t);
+                memcpy(buf + off, primary.image[i], size);
+                off += size;
+            }
+            msg.type = REPL_MSG_IMAGE;
+            msg.len = off;
+            msg.seq = primary.base;
+            r->pos = primary.folded;
+            r->need_image = 0;
+        } else {
+            while (r->pos == primary.folded + primary.len && !r->need_image) {
+                /* Idle: look for acknowledgements and a closed connection once in a while */
+                struct timespec deadline;
+                clock_gettime(CLOCK_REALTIME, &deadline);
+                deadline.tv_sec++;
+                primary.waiting++;
+                int rc = pthread_cond_timedwait(&primary.grew, &primary.lock, &deadline);
+                primary.waiting--;
+                if (rc == ETIMEDOUT) {
+                    pthread_mutex_unlock(&primary.lock);
+                    rc = read_acks(r, pending, &have);
+                    pthread_mutex_lock(&primary.lock);
+                    if (rc < 0) goto unlock;
+                }
+            }
+            if (r->need_image) continue;
+            /* Everything not yet sent goes out as one message */
+            size_t off = r->pos - primary.folded;
+            if (reserve(&buf, &cap, primary.len - off) < 0) break;
+            memcpy(buf, primary.data + off, primary.len - off);
+            msg.type = REPL_MSG_RECORDS;
+            msg.len = primary.len - off;
+            msg.seq = primary.next_seq - 1;
+        }
+        pthread_mutex_unlock(&primary.lock);
+
+        if (send_all(r->fd, &msg, sizeof(msg)) < 0 || send_all(r->fd, buf, msg.len) < 0 ||
+            read_acks(r, pending, &have) < 0) {
+            pthread_mutex_lock(&primary.lock);
+            break;
+        }
+
+        pthread_mutex_lock(&primary.lock);
+        if (msg.type == REPL_MSG_RECORDS && !r->need_image) r->pos += msg.len;
+        maybe_fold_locked();
+    }
+unlock:
+    pthread_mutex_unlock(&primary.lock);
+    log_request("REPLICA", &r->addr, "Detached");
+done:
+    pthread_mutex_lock(&primary.lock);
+    if (r->prev) r->prev->next = r->next;
+    else primary.replicas = r->next;
+    if (r->next) r->next->prev = r->prev;
+    primary.num_replicas--;
+    pthread_mutex_unlock(&primary.lock);
+    close(r->fd);
+    free(buf);
+    free(r);
+    return NULL;
+}
+
+/* Accepts replicas; between them folds the log, so it stays small even with none attached */
+static void* acceptor_run(void* arg) {
+    (void)arg;
+    block_signals();
+    for (;;) {
+        struct pollfd pfd = { .fd = primary.listen_fd, .events = POLLIN };
+        if (poll(&pfd, 1, 100) > 0) {
+            struct replica* r = calloc(1, sizeof(*r));
+            socklen_t addr_len = sizeof(r->addr);
+            if (r && (r->fd = accept4(primary.listen_fd, (struct sockaddr*)&r->addr, &addr_len, SOCK_CLOEXEC)) >= 0) {
+                int one = 1;
+                setsockopt(r->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                pthread_mutex_lock(&primary.lock);
+                r->next = primary.replicas;
+                if (r->next) r->next->prev = r;
+                primary.replicas = r;
+                primary.num_replicas++;
+                pthread_mutex_unlock(&primary.lock);
+                pthread_t thread;
+                if (pthread_create(&thread, NULL, sender_run, r) == 0) {
+                    pthread_detach(thread);
+                } else {
+                    pthread_mutex_lock(&primary.lock);
+                    primary.replicas = r->next;
+                    if (r->next) r->next->prev = NULL;
+                    primary.num_replicas--;
+                    pthread_mutex_unlock(&primary.lock);
+                    close(r->fd);
+                    free(r);
+                }
+            } else {
+                free(r);
+            }
+        }
+        pthread_mutex_lock(&primary.lock);
+        maybe_fold_locked();
+        pthread_mutex_unlock(&primary.lock);
+    }
+    return NULL;
+}
+
+int repl_serve(int port, struct event* events, int num_events) {
+    primary.events = events;
+    primary.num_events = num_events;
+    primary.next_seq = 1;
+    if (getrandom(&primary.epoch, sizeof(primary.epoch), 0) != sizeof(primary.epoch)) return -1;
+    primary.epoch |= 1; /* never 0, which a replica sends when it has followed no one */
+    if (!(primary.image = calloc(num_events, sizeof(int64_t*)))) return -1;
+    for (int i = 0; i < num_events; i++) {
+        struct seat_store* st = &events[i].store;
+        if (!(primary.image[i] = malloc(st->num_seats * sizeof(int64_t)))) return -1;
+        for (int s = 0; s < st->num_seats; s++)
+            primary.image[i][s] = atomic_load_explicit(&st->owners[s], memory_order_relaxed);
+        primary.image_bytes += st->num_seats * sizeof(int64_t);
+    }
+    if (reserve(&primary.data, &primary.cap, REPL_LOG_FOLD * 2) < 0) return -1;
+
+    primary.listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int on = 1;
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = INADDR_ANY, .sin_port = htons(port) };
+    if (primary.listen_fd < 0 || setsockopt(primary.listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0 ||
+        bind(primary.listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(primary.listen_fd, 16) < 0)
+        return -1;
+    primary.enabled = 1;
+    return pthread_create(&primary.acceptor, NULL, acceptor_run, NULL) == 0 ? 0 : -1;
+}
+
+/* Replica */
+
+static int apply_record(const struct journal_record* rec) {
+    if (follower.apply(follower.arg, rec) < 0) return -1;
+    atomic_store_explicit(&follower.applied, rec->lsn, memory_order_relaxed);
+    return 0;
+}
+
+/* Bring every seat that differs from the image in line, through the normal seat operations */
+static int apply_image(const char* data, uint64_t len, uint64_t seq) {
+    uint64_t expected = 0;
+    for (int i = 0; i < follower.num_events; i++) expected += follower.events[i].venue.num_seats * sizeof(int64_t);
+    if (len != expected) return -1;
+    char space[sizeof(struct journal_record) + 8];
+    struct journal_record* rec = (void*)space;
+    for (int i = 0; i < follower.num_events; i++) {
+        struct seat_store* st = &follower.events[i].store;
+        for (int s = 0; s < st->num_seats; s++, data += sizeof(int64_t)) {
+            int64_t want, have = atomic_load_explicit(&st->owners[s], memory_order_relaxed);
+            memcpy(&want, data, sizeof(want));
+            if (want == have) continue;
+            int seat = s + 1;
+            if (have != NO_OWNER) {
+                journal_record_fill(rec, seq, SEAT_OP_CANCEL, follower.events[i].id, &seat, 1, have);
+                if (follower.apply(follower.arg, rec) < 0) return -1;
+            }
+            if (want != NO_OWNER) {
+                journal_record_fill(rec, seq, SEAT_OP_BOOK, follower.events[i].id, &seat, 1, want);
+                if (follower.apply(follower.arg, rec) < 0) return -1;
+            }
+        }
+    }
+    atomic_store_explicit(&follower.applied, seq, memory_order_relaxed);
+    return 0;
+}
+
+static int apply_records(const char* data, uint64_t len) {
+    for (uint64_t off = 0; off < len;) {
+        const struct journal_record* rec = (const void*)(data + off);
+        if (len - off < sizeof(*rec)) return -1;
+        size_t size = journal_record_size(rec->num_seats);
+        if (len - off < size || journal_record_crc(rec) != rec->crc ||
+            rec->lsn != atomic_load_explicit(&follower.applied, memory_order_relaxed) + 1 || apply_record(rec) < 0)
+            return -1;
+        off += size;
+    }
+    return 0;
+}
+
+/* One connection to the primary: hello, then apply and acknowledge until it breaks */
+static void follow_session(int fd) {
+    size_t hello_len = sizeof(struct repl_hello) + follower.num_events * 2 * sizeof(uint32_t);
+    char* hello = malloc(hello_len);
+    if (!hello) return;
+    struct repl_hello* h = (void*)hello;
+    memcpy(h->magic, REPL_MAGIC, 8);
+    h->epoch = follower.epoch;
+    h->seq = atomic_load_explicit(&follower.applied, memory_order_relaxed);
+    h->num_events = follower.num_events;
+    h->pad = 0;
+    uint32_t* venues = (uint32_t*)(h + 1);
+    for (int i = 0; i < follower.num_events; i++) {
+        venues[2 * i] = follower.events[i].id;
+        venues[2 * i + 1] = follower.events[i].venue.num_seats;
+    }
+    int rc = send_all(fd, hello, hello_len);
+    free(hello);
+
+    char* buf = NULL;
+    size_t cap = 0;
+    struct repl_msg msg;
+    while (rc == 0 && recv_all(fd, &msg, sizeof(msg)) == 0) {
+        if (reserve(&buf, &cap, msg.len) < 0 || recv_all(fd, buf, msg.len) < 0) break;
+        if (msg.type == REPL_MSG_IMAGE) {
+            rc = apply_image(buf, msg.len, msg.seq);
+            follower.epoch = msg.epoch;
+        } else {
+            rc = msg.type == REPL_MSG_RECORDS && msg.epoch == follower.epoch ? apply_records(buf, msg.len) : -1;
+        }
+        if (rc < 0) {
+            /* Diverged from the primary: start over from an image */
+            log_request("FOLLOW", &follower.addr, "FAIL: stream did not apply, resyncing");
+            follower.epoch = 0;
+            break;
+        }
+        uint64_t applied = atomic_load_explicit(&follower.applied, memory_order_relaxed);
+        rc = send_all(fd, &applied, sizeof(applied));
+    }
+    free(buf);
+}
+
+static void* follower_run(void* arg) {
+    (void)arg;
+    block_signals();
+    while (atomic_load(&follower.following)) {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr*)&follower.addr, sizeof(follower.addr)) == 0) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            pthread_mutex_lock(&follower.lock);
+            follower.fd = fd;
+            pthread_mutex_unlock(&follower.lock);
+            if (atomic_load(&follower.following)) {
+                atomic_store(&follower.connected, 1);
+                log_request("FOLLOW", &follower.addr, "Connected to primary");
+                follow_session(fd);
+                atomic_store(&follower.connected, 0);
+                log_request("FOLLOW", &follower.addr, "Disconnected from primary");
+            }
+            pthread_mutex_lock(&follower.lock);
+            follower.fd = -1;
+            pthread_mutex_unlock(&follower.lock);
+        }
+        if (fd >= 0) close(fd);
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += REPL_RETRY_MS / 1000;
+        deadline.tv_nsec += REPL_RETRY_MS % 1000 * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_mutex_lock(&follower.lock);
+        while (atomic_load(&follower.following) &&
+               pthread_cond_timedwait(&follower.stop, &follower.lock, &deadline) != ETIMEDOUT) {
+        }
+        pthread_mutex_unlock(&follower.lock);
+    }
+    return NULL;
+}
+
+int repl_follow(const char* host_port, struct event* events, int num_events, journal_apply_fn apply, void* arg) {
+    char host[256];
+    const char* colon = strrchr(host_port, ':');
+    if (!colon || colon == host_port || (size_t)(colon - host_port) >= sizeof(host)) return -1;
+    memcpy(host, host_port, colon - host_port);
+    host[colon - host_port] = '\0';
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM }, *res;
+    if (getaddrinfo(host, colon + 1, &hints, &res) != 0) return -1;
+    memcpy(&follower.addr, res->ai_addr, sizeof(follower.addr));
+    freeaddrinfo(res);
+
+    follower.events = events;
+    follower.num_events = num_events;
+    follower.apply = apply;
+    follower.arg = arg;
+    atomic_store(&follower.following, 1);
+    if (pthread_create(&follower.thread, NULL, follower_run, NULL) != 0) {
+        atomic_store(&follower.following, 0);
+        return -1;
+    }
+    return 0;
+}
+
+int repl_read_only(void) {
+    return atomic_load_explicit(&follower.following, memory_order_relaxed);
+}
+
+int repl_promote(void) {
+    pthread_mutex_lock(&follower.lock);
+    int was_following = atomic_exchange(&follower.following, 0);
+    if (was_following && follower.fd >= 0) shutdown(follower.fd, SHUT_RDWR);
+    pthread_cond_signal(&follower.stop);
+    pthread_mutex_unlock(&follower.lock);
+    if (!was_following) return -1;
+    /* Nothing is applied after this, so writes from now on cannot interleave with the stream */
+    pthread_join(follower.thread, NULL);
+    log_request("PROMOTE", &follower.addr, "Stopped following, accepting writes");
+    return 0;
+}
+
+void repl_get_stats(struct repl_stats* s) {
+    memset(s, 0, sizeof(*s));
+    if (primary.enabled) {
+        s->primary = 1;
+        pthread_mutex_lock(&primary.lock);
+        s->replicas = primary.num_replicas;
+        s->seq = primary.next_seq - 1;
+        s->acked = s->seq;
+        for (struct replica* r = primary.replicas; r; r = r->next)
+            if (r->acked < s->acked) s->acked = r->acked;
+        pthread_mutex_unlock(&primary.lock);
+    }
+    s->replica = repl_read_only();
+    s->applied = atomic_load_explicit(&follower.applied, memory_order_relaxed);
+    s->connected = atomic_load_explicit(&follower.connected, memory_order_relaxed);
+}
@@ -0,0 +1,81 @@
+/*
+ * Primary/replica replication of the seat stores
+ * The primary appends every committed BOOK/CANCEL to an in-memory log from
+ * the seat stores' commit hook, while the seats are still held, so log
+ * order is commit order, exactly as for the journal. Records use the
+ * journal's format (struct journal_record) with their own sequence numbers.
+ * Appending is a memcpy under a mutex: nothing on the commit path waits for
+ * a replica. One sender thread per replica ships everything it has not yet
+ * sent in one message and does not wait for the acknowledgement before the
+ * next, so changes are batched and pipelined.
+ * The log is folded into a base image (an owner per seat) once every
+ * replica has been sent past it, or regardless once it outgrows
+ * REPL_LOG_MAX. A replica that connects for the first time, or whose
+ * position is no longer in the log, first gets the image and then the
+ * records after it; one that reconnects to the same primary run resumes
+ * from its position.
+ * A replica (-F host:port) applies the stream to its own stores through
+ * the normal seat operations, so its own journal, seat index and replicas
+ * see the changes too, and serves reads. Until PROMOTE it refuses writes
+ * and keeps reconnecting to the primary.
+ */
+
+#ifndef REPL_H
+#define REPL_H
+
+#include <stdint.h>
+#include "seats.h"
+#include "journal.h"
+
+#define REPL_MAGIC "TKTREPL1"
+#define REPL_LOG_FOLD (1024 * 1024)        /* fold what every replica has been sent past this */
+#define REPL_LOG_MAX (64 * 1024 * 1024)    /* fold everything past this; laggards get the image */
+#define REPL_RETRY_MS 1000                 /* replica reconnect interval */
+
+/* Replica -> primary on connect: who it last followed and how far it got,
+ * then num_events pairs of (event id, seats) that must match the primary's */
+struct repl_hello {
+    char magic[8];
+    uint64_t epoch;
+    uint64_t seq;
+    uint32_t num_events;
+    uint32_t pad;
+};
+
+enum repl_msg_type { REPL_MSG_IMAGE = 1, REPL_MSG_RECORDS };
+
+/* Primary -> replica: header, then len bytes; an image is every event's owner
+ * table (int64 per seat) in event order, records are journal records back to back.
+ * Replica -> primary: the last applied seq, a uint64 after every message. */
+struct repl_msg {
+    uint32_t type;
+    uint32_t pad;
+    uint64_t len;
+    uint64_t epoch;  /* random per primary run */
+    uint64_t seq;    /* image: every record up to here is in it; records: the last one */
+};
+
+struct repl_stats {
+    int primary, replica;     /* -P given; following (not yet promoted) */
+    int replicas;             /* primary: replicas connected */
+    uint64_t seq;             /* primary: last record appended */
+    uint64_t acked;           /* primary: lowest position acknowledged by a connected replica */
+    uint64_t applied;         /* replica: last record applied */
+    int connected;            /* replica: attached to the primary */
+};
+
+/* Primary: take the stores' current contents as the image and accept replicas on port */
+int repl_serve(int port, struct event* events, int num_events);
+/* From the commit hook; does nothing unless repl_serve ran */
+void repl_append(int op, int event, const int* seat_nums, int n, int64_t owner);
+
+/* Replica: follow host:port, feeding records (with their seq as lsn) to apply */
+int repl_follow(const char* host_port, struct event* events, int num_events, journal_apply_fn apply, void* arg);
+/* Refuse writes while following */
+int repl_read_only(void);
+/* Stop following and accept writes; -1 if this server is not a replica */
+int repl_promote(void);
+
+void repl_get_stats(struct repl_stats* s);
+
+#endif
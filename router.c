@@ -0,0 +1,616 @@
+/*
+ * Seat-partitioned cluster router
+ * Usage: ./router [-p port] shard_host:port...
+ * Splits one venue over several ordinary server processes (shards). Each
+ * shard serves its own part of the venue as seats 1..n_i; the router asks
+ * every shard for its LAYOUT at startup and numbers the parts one after
+ * another, so shard i owns the global seats after the first i-1 shards'.
+ * Every client connection gets a connection to each shard, and with it a
+ * session per shard, so ownership (CANCEL, MINE) works as on one server.
+ * BOOK and CANCEL that touch one shard are forwarded as they are. A BOOK
+ * spanning shards is a two-phase commit built on the shards' holds: HOLD on
+ * every shard involved (prepare: all-or-nothing per shard, and the hold
+ * lifetime bounds how long a shard waits for the decision), then CONFIRM
+ * on all of them if every hold succeeded, or RELEASE on those that did.
+ * A CONFIRM only fails if its hold expired meanwhile; the shards already
+ * confirmed are then cancelled again, so the client sees all or nothing.
+ * A CANCEL spanning shards first reads MINE on every shard involved. Only
+ * this client's sessions can cancel its seats, so once every seat is
+ * listed there, every shard's CANCEL succeeds; otherwise nothing is
+ * cancelled and the shard that lacks a seat gives the failure.
+ * The router keeps no record of its decisions: if it dies between the
+ * CONFIRMs of a cross-shard BOOK, the shards confirmed so far keep their
+ * seats and the rest let their holds expire, a partial booking.
+ * AVAILABLE, MINE and CANCEL ALL go to every shard and are merged.
+ * Text protocol only, event 1 only; HOLD/CONFIRM/RELEASE and sessions
+ * (LOGIN/RESUME) are not offered through the router.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "parse.h"
+#include "protocol.h"
+
+#define PORT 8080
+#define MAX_SHARDS 64
+#define MAX_LINE 1023         /* longest accepted command line, as in the server */
+#define BUFFER_SIZE 4096
+
+struct shard {
+    struct sockaddr_in addr;
+    int offset;               /* global seat = offset + local seat */
+    int num_seats;
+    char* sections;           /* this shard's part of the LAYOUT reply, seats renumbered */
+};
+
+/* A growable byte buffer: client output, or input from a socket */
+struct buf {
+    char* data;
+    size_t len, cap;
+};
+
+/* One client's connection to one shard */
+struct backend {
+    int fd;
+    struct buf in;
+    size_t line;              /* length of the line last returned, dropped on the next read */
+};
+
+struct client {
+    int fd;
+    struct backend backends[MAX_SHARDS];
+    struct buf in, out;
+};
+
+static struct shard shards[MAX_SHARDS];
+static int num_shards, total_seats;
+static char* layout;          /* "LAYOUT <total> <sections>\n" */
+static _Atomic unsigned long long requests, cross_shard, aborted;
+
+static int buf_reserve(struct buf* b, size_t extra) {
+    if (b->cap - b->len >= extra) return 0;
+    size_t cap = b->cap ? b->cap : BUFFER_SIZE;
+    while (cap - b->len < extra) cap *= 2;
+    char* data = realloc(b->data, cap);
+    if (!data) return -1;
+    b->data = data;
+    b->cap = cap;
+    return 0;
+}
+
+static void buf_put(struct buf* b, const char* s, size_t len) {
+    if (buf_reserve(b, len) == 0) {
+        memcpy(b->data + b->len, s, len);
+        b->len += len;
+    }
+}
+
+static void buf_puts(struct buf* b, const char* s) {
+    buf_put(b, s, strlen(s));
+}
+
+static int write_all(int fd, const char* p, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Next reply line from a shard (without its newline); NULL if the shard went away */
+static const char* backend_line(struct backend* b, size_t* len) {
+    memmove(b->in.data, b->in.data + b->line, b->in.len - b->line);
+    b->in.len -= b->line;
+    b->line = 0;
+    for (;;) {
+        char* nl = b->in.len ? memchr(b->in.data, '\n', b->in.len) : NULL;
+        if (nl) {
+            *len = nl - b->in.data;
+            b->line = *len + 1;
+            return b->in.data;
+        }
+        if (buf_reserve(&b->in, BUFFER_SIZE) < 0) return NULL;
+        ssize_t n = recv(b->fd, b->in.data + b->in.len, b->in.cap - b->in.len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return NULL;
+        b->in.len += n;
+    }
+}
+
+static int starts_with(const char* line, size_t len, const char* prefix) {
+    size_t n = strlen(prefix);
+    return len >= n && memcmp(line, prefix, n) == 0;
+}
+
+/* Append a shard's reply with its seat numbers made global: every number after
+ * the first word, or only the first one ("FAIL seat N ...") when first_only */
+static void put_global(struct buf* out, const char* line, size_t len, int offset, int first_only) {
+    size_t i = 0;
+    int mapped = 0;
+    while (i < len && line[i] != ' ') i++;
+    buf_put(out, line, i);
+    while (i < len) {
+        size_t start = i;
+        while (i < len && (line[i] < '0' || line[i] > '9') && line[i] != ' ') i++;
+        if (i == start && line[i] == ' ') i++;
+        if (i > start) {
+            buf_put(out, line + start, i - start);
+            continue;
+        }
+        long seat = 0;
+        while (i < len && line[i] >= '0' && line[i] <= '9') seat = seat * 10 + (line[i++] - '0');
+        char num[24];
+        int n = snprintf(num, sizeof(num), "%ld", first_only && mapped ? seat : seat + offset);
+        buf_put(out, num, n);
+        mapped = 1;
+    }
+    buf_put(out, "\n", 1);
+}
+
+/* Seats of one shard, in local numbers, and where they came from in the request */
+struct part {
+    int n;
+    int seats[MAX_REQUEST_SEATS];
+};
+
+static int shard_of(int seat) {
+    int lo = 0, hi = num_shards - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (shards[mid].offset < seat) lo = mid;
+        else hi = mid - 1;
+    }
+    return lo;
+}
+
+/* Group a request's seats by shard; returns how many shards it touches */
+static int split(const int* seats, int n, struct part* parts) {
+    int involved = 0;
+    for (int s = 0; s < num_shards; s++) parts[s].n = 0;
+    for (int i = 0; i < n; i++) {
+        int s = shard_of(seats[i]);
+        if (parts[s].n++ == 0) involved++;
+        parts[s].seats[parts[s].n - 1] = seats[i] - shards[s].offset;
+    }
+    return involved;
+}
+
+/* Send "<verb> n s1 s2 ..." for one shard's part */
+static int send_part(struct client* c, int s, const char* verb, const struct part* p) {
+    char line[32 + MAX_REQUEST_SEATS * 12];
+    int len = snprintf(line, sizeof(line), "%s %d", verb, p->n);
+    for (int i = 0; i < p->n; i++) len += snprintf(line + len, sizeof(line) - len, " %d", p->seats[i]);
+    line[len++] = '\n';
+    return write_all(c->backends[s].fd, line, len);
+}
+
+/* Run verb on every shard with seats in parts, all at once; ok[s] tells which answered
+ * with ok_prefix. The first other reply is kept in fail (global numbers). -1 if a shard is gone. */
+static int fan_out(struct client* c, const char* verb, const struct part* parts, const char* ok_prefix, int* ok,
+                   struct buf* fail) {
+    for (int s = 0; s < num_shards; s++)
+        if (parts[s].n && send_part(c, s, verb, &parts[s]) < 0) return -1;
+    int all = 1;
+    for (int s = 0; s < num_shards; s++) {
+        if (!parts[s].n) continue;
+        size_t len;
+        const char* line = backend_line(&c->backends[s], &len);
+        if (!line) return -1;
+        ok[s] = starts_with(line, len, ok_prefix);
+        if (!ok[s] && all) put_global(fail, line, len, shards[s].offset, 1);
+        all &= ok[s];
+    }
+    return all;
+}
+
+/* Undo the shards in ok with verb; best effort, replies are only drained */
+static int undo(struct client* c, const char* verb, const struct part* parts, const int* ok) {
+    struct part none[MAX_SHARDS];
+    for (int s = 0; s < num_shards; s++) none[s] = ok[s] ? parts[s] : (struct part){ 0 };
+    int dummy[MAX_SHARDS];
+    struct buf ignored = { 0 };
+    int rc = fan_out(c, verb, none, "", dummy, &ignored);
+    free(ignored.data);
+    return rc < 0 ? -1 : 0;
+}
+
+static void put_seats(struct buf* out, const char* prefix, const int* seats, int n) {
+    buf_puts(out, prefix);
+    for (int i = 0; i < n; i++) {
+        char num[16];
+        buf_put(out, num, snprintf(num, sizeof(num), " %d", seats[i]));
+    }
+    buf_put(out, "\n", 1);
+}
+
+/* BOOK n s1 s2 ...: forwarded if it stays on one shard, two-phase commit over holds otherwise */
+static int route_book(struct client* c, const int* seats, int n) {
+    struct part parts[MAX_SHARDS];
+    int ok[MAX_SHARDS] = { 0 };
+    struct buf fail = { 0 };
+    int rc;
+    if (split(seats, n, parts) == 1) {
+        if ((rc = fan_out(c, "BOOK", parts, "OK", ok, &fail)) > 0) put_seats(&c->out, "OK BOOKED", seats, n);
+    } else {
+        atomic_fetch_add_explicit(&cross_shard, 1, memory_order_relaxed);
+        /* Phase 1: every shard holds its seats, or the ones that did let go again */
+        rc = fan_out(c, "HOLD", parts, "OK", ok, &fail);
+        if (rc == 0 && undo(c, "RELEASE", parts, ok) < 0) rc = -1;
+        /* Phase 2: all held, so the booking commits */
+        if (rc > 0) {
+            int held[MAX_SHARDS];
+            memcpy(held, ok, sizeof(held));
+            rc = fan_out(c, "CONFIRM", parts, "OK", ok, &fail);
+            if (rc == 0) {
+                /* A hold expired before its CONFIRM: take back what did commit */
+                int lost[MAX_SHARDS];
+                for (int s = 0; s < num_shards; s++) lost[s] = held[s] && !ok[s];
+                if (undo(c, "CANCEL", parts, ok) < 0 || undo(c, "RELEASE", parts, lost) < 0) rc = -1;
+            }
+        }
+        if (rc == 0) atomic_fetch_add_explicit(&aborted, 1, memory_order_relaxed);
+        if (rc > 0) put_seats(&c->out, "OK BOOKED", seats, n);
+    }
+    if (rc == 0) buf_put(&c->out, fail.data, fail.len);
+    free(fail.data);
+    return rc < 0 ? -1 : 0;
+}
+
+static int int_cmp(const void* a, const void* b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+/* Whether a MINE reply lists every seat of p */
+static int mine_covers(const char* line, size_t len, const struct part* p) {
+    int sorted[MAX_REQUEST_SEATS], found = 0;
+    memcpy(sorted, p->seats, p->n * sizeof(int));
+    qsort(sorted, p->n, sizeof(int), int_cmp);
+    for (size_t i = 4; i < len;) {
+        if (line[i] < '0' || line[i] > '9') {
+            i++;
+            continue;
+        }
+        int seat = 0;
+        while (i < len && line[i] >= '0' && line[i] <= '9') seat = seat * 10 + (line[i++] - '0');
+        found += bsearch(&seat, sorted, p->n, sizeof(int), int_cmp) != NULL;
+    }
+    return starts_with(line, len, "MINE") && found == p->n;
+}
+
+/* CANCEL n s1 s2 ...: ownership is checked on every shard involved before any of them cancels */
+static int route_cancel(struct client* c, const int* seats, int n) {
+    struct part parts[MAX_SHARDS];
+    int ok[MAX_SHARDS] = { 0 }, missing = -1;
+    struct buf fail = { 0 };
+    if (split(seats, n, parts) > 1) {
+        atomic_fetch_add_explicit(&cross_shard, 1, memory_order_relaxed);
+        for (int s = 0; s < num_shards; s++)
+            if (parts[s].n && write_all(c->backends[s].fd, "MINE\n", 5) < 0) return -1;
+        for (int s = 0; s < num_shards; s++) {
+            size_t len;
+            const char* line;
+            if (!parts[s].n) continue;
+            if (!(line = backend_line(&c->backends[s], &len))) return -1;
+            if (missing < 0 && !mine_covers(line, len, &parts[s])) missing = s;
+        }
+    }
+    int rc;
+    if (missing >= 0) {
+        /* Not ours there, so that shard's CANCEL fails on its own and says why */
+        struct part only[MAX_SHARDS] = { 0 };
+        only[missing] = parts[missing];
+        parts[missing].n = 0;
+        rc = fan_out(c, "CANCEL", only, "OK", ok, &fail);
+    }
+    if (missing < 0 || rc > 0) rc = fan_out(c, "CANCEL", parts, "OK", ok, &fail);
+    if (rc > 0) put_seats(&c->out, "OK CANCELLED", seats, n);
+    else if (rc == 0) buf_put(&c->out, fail.data, fail.len);
+    free(fail.data);
+    return rc < 0 ? -1 : 0;
+}
+
+/* Send line to every shard and merge the seat lists that come back after keyword;
+ * empty is the reply when no shard has any (NULL: "<keyword> NONE") */
+static int route_all(struct client* c, const char* line, const char* keyword, const char* empty) {
+    for (int s = 0; s < num_shards; s++)
+        if (write_all(c->backends[s].fd, line, strlen(line)) < 0) return -1;
+    size_t start = c->out.len, klen = strlen(keyword);
+    int any = 0;
+    buf_puts(&c->out, keyword);
+    for (int s = 0; s < num_shards; s++) {
+        size_t len;
+        const char* reply = backend_line(&c->backends[s], &len);
+        if (!reply) return -1;
+        if (!starts_with(reply, len, keyword) || starts_with(reply + klen, len - klen, " NONE") || len == klen) continue;
+        /* Drop the shard's keyword and newline: " s1 s2 ..." made global */
+        size_t before = c->out.len;
+        put_global(&c->out, reply + klen, len - klen, shards[s].offset, 0);
+        c->out.len--;
+        if (c->out.len > before) any = 1;
+    }
+    if (!any) {
+        c->out.len = start;
+        if (empty) buf_puts(&c->out, empty);
+        else buf_puts(&c->out, keyword), buf_puts(&c->out, " NONE");
+    }
+    buf_put(&c->out, "\n", 1);
+    return 0;
+}
+
+/* BOOK BEST n [section]: shard by shard until one has room */
+static int route_best(struct client* c, const struct best_request* req) {
+    char line[64 + MAX_LINE];
+    int len = snprintf(line, sizeof(line), "BOOK BEST %d%s%.*s\n", req->count, req->section ? " " : "",
+                       (int)req->section_len, req->section ? req->section : "");
+    int known = req->section == NULL;
+    for (int s = 0; s < num_shards; s++) {
+        size_t n;
+        const char* reply;
+        if (write_all(c->backends[s].fd, line, len) < 0 || !(reply = backend_line(&c->backends[s], &n))) return -1;
+        if (starts_with(reply, n, "OK")) {
+            put_global(&c->out, reply, n, shards[s].offset, 0);
+            return 0;
+        }
+        if (!starts_with(reply, n, "FAIL unknown section")) known = 1;
+    }
+    if (!known) {
+        buf_puts(&c->out, "FAIL unknown section\n");
+    } else {
+        char reply[64];
+        buf_put(&c->out, reply, snprintf(reply, sizeof(reply), "FAIL no %d adjacent seats available\n", req->count));
+    }
+    return 0;
+}
+
+static void put_stats(struct client* c) {
+    char line[160];
+    buf_put(&c->out, line, snprintf(line, sizeof(line), "STATS shards=%d seats=%d requests=%llu cross_shard=%llu"
+                                    " aborted=%llu\n", num_shards, total_seats,
+                                    atomic_load_explicit(&requests, memory_order_relaxed),
+                                    atomic_load_explicit(&cross_shard, memory_order_relaxed),
+                                    atomic_load_explicit(&aborted, memory_order_relaxed)));
+}
+
+/* One command line; returns 1 on EXIT, -1 when a shard is gone */
+static int route_command(struct client* c, const char* line, size_t len) {
+    struct command cmd;
+    parse_command(line, len, &cmd);
+    if (cmd.type == CMD_EMPTY) return 0;
+    atomic_fetch_add_explicit(&requests, 1, memory_order_relaxed);
+    if (cmd.event != 0 && cmd.event != 1) {
+        buf_puts(&c->out, "FAIL unknown event\n");
+        return 0;
+    }
+    int seats[MAX_REQUEST_SEATS], n;
+    struct best_request best;
+    enum parse_error err = PARSE_OK;
+    switch (cmd.type) {
+    case CMD_EXIT:
+        return 1;
+    case CMD_AVAILABLE:
+        return route_all(c, "AVAILABLE\n", "AVAILABLE", NULL);
+    case CMD_MINE:
+        return route_all(c, "MINE\n", "MINE", NULL);
+    case CMD_LAYOUT:
+        buf_puts(&c->out, layout);
+        return 0;
+    case CMD_EVENTS: {
+        char reply[32];
+        buf_put(&c->out, reply, snprintf(reply, sizeof(reply), "EVENTS 1:%d\n", total_seats));
+        return 0;
+    }
+    case CMD_STATS:
+        put_stats(c);
+        return 0;
+    case CMD_BOOK:
+        if (parse_best(cmd.args, cmd.args_len, &best, &err)) {
+            if (err == PARSE_OK) return route_best(c, &best);
+        } else if ((err = parse_seats(cmd.args, cmd.args_len, total_seats, seats, &n)) == PARSE_OK) {
+            return route_book(c, seats, n);
+        }
+        break;
+    case CMD_CANCEL:
+        if (parse_all(cmd.args, cmd.args_len)) return route_all(c, "CANCEL ALL\n", "OK CANCELLED", "FAIL no seats booked");
+        if ((err = parse_seats(cmd.args, cmd.args_len, total_seats, seats, &n)) == PARSE_OK)
+            return route_cancel(c, seats, n);
+        break;
+    case CMD_UNKNOWN:
+        buf_puts(&c->out, "FAIL unknown command\n");
+        return 0;
+    default:
+        buf_puts(&c->out, "FAIL not supported by the router\n");
+        return 0;
+    }
+    buf_puts(&c->out, "FAIL invalid request\n");
+    return 0;
+}
+
+static int connect_shard(const struct shard* s) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, (const struct sockaddr*)&s->addr, sizeof(s->addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void* client_run(void* arg) {
+    struct client* c = arg;
+    int result = 0;
+    for (int s = 0; s < num_shards; s++) {
+        c->backends[s].fd = connect_shard(&shards[s]);
+        if (c->backends[s].fd < 0) result = -1;
+    }
+    while (result == 0) {
+        if (buf_reserve(&c->in, BUFFER_SIZE) < 0) break;
+        ssize_t n = recv(c->fd, c->in.data + c->in.len, c->in.cap - c->in.len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        if (c->in.len == 0 && (unsigned char)c->in.data[0] == BIN_MAGIC) {
+            buf_puts(&c->out, "FAIL the router only speaks the text protocol\n");
+            break;
+        }
+        c->in.len += n;
+        /* Every complete line that arrived, replies sent together */
+        size_t start = 0;
+        char* nl;
+        while (result == 0 && (nl = memchr(c->in.data + start, '\n', c->in.len - start))) {
+            size_t len = nl - (c->in.data + start);
+            if (len > MAX_LINE) buf_puts(&c->out, "FAIL request too long\n");
+            else result = route_command(c, c->in.data + start, len);
+            start += len + 1;
+        }
+        memmove(c->in.data, c->in.data + start, c->in.len - start);
+        c->in.len -= start;
+        if (c->in.len > MAX_LINE) {
+            buf_puts(&c->out, "FAIL request too long\n");
+            c->in.len = 0;
+        }
+        if (c->out.len && write_all(c->fd, c->out.data, c->out.len) < 0) break;
+        c->out.len = 0;
+    }
+    /* Replies are uncertain once a shard is gone: say so and hang up */
+    if (result < 0) buf_puts(&c->out, "FAIL shard unavailable\n");
+    if (c->out.len) write_all(c->fd, c->out.data, c->out.len);
+    for (int s = 0; s < num_shards; s++) {
+        if (c->backends[s].fd >= 0) close(c->backends[s].fd);
+        free(c->backends[s].in.data);
+    }
+    close(c->fd);
+    free(c->in.data);
+    free(c->out.data);
+    free(c);
+    return NULL;
+}
+
+/* host:port, and its LAYOUT; seats are numbered after the shards before it */
+static int add_shard(const char* host_port, struct buf* sections) {
+    struct shard* s = &shards[num_shards];
+    char host[256];
+    const char* colon = strrchr(host_port, ':');
+    if (!colon || colon == host_port || (size_t)(colon - host_port) >= sizeof(host)) return -1;
+    memcpy(host, host_port, colon - host_port);
+    host[colon - host_port] = '\0';
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM }, *res;
+    if (getaddrinfo(host, colon + 1, &hints, &res) != 0) return -1;
+    memcpy(&s->addr, res->ai_addr, sizeof(s->addr));
+    freeaddrinfo(res);
+
+    struct backend b = { .fd = connect_shard(s) };
+    size_t len;
+    const char* reply;
+    if (b.fd < 0 || write_all(b.fd, "LAYOUT\n", 7) < 0 || !(reply = backend_line(&b, &len)) ||
+        sscanf(reply, "LAYOUT %d", &s->num_seats) != 1 || s->num_seats < 1) {
+        if (b.fd >= 0) close(b.fd);
+        free(b.in.data);
+        return -1;
+    }
+    s->offset = total_seats;
+    total_seats += s->num_seats;
+    /* Sections: name:first_seat:rows:row_width, first_seat made global */
+    const char* p = memchr(reply + 7, ' ', len - 7);
+    while (p && p < reply + len) {
+        const char* end = memchr(p + 1, ' ', reply + len - (p + 1));
+        if (!end) end = reply + len;
+        char name[64];
+        int first, rows, width;
+        int n = end - (p + 1) < (long)sizeof(name) ? (int)(end - (p + 1)) : (int)sizeof(name) - 1;
+        memcpy(name, p + 1, n);
+        name[n] = '\0';
+        char* colon1 = strchr(name, ':');
+        if (colon1 && sscanf(colon1, ":%d:%d:%d", &first, &rows, &width) == 3) {
+            char entry[96];
+            *colon1 = '\0';
+            buf_put(sections, entry, snprintf(entry, sizeof(entry), " %s:%d:%d:%d", name, first + s->offset, rows, width));
+        }
+        p = end < reply + len ? end : NULL;
+    }
+    close(b.fd);
+    free(b.in.data);
+    num_shards++;
+    return 0;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-p port] shard_host:port...\n", prog);
+    exit(1);
+}
+
+int main(int argc, char* argv[]) {
+    int port = PORT, opt;
+    while ((opt = getopt(argc, argv, "p:")) != -1) {
+        switch (opt) {
+        case 'p': port = atoi(optarg); break;
+        default: usage(argv[0]);
+        }
+    }
+    if (port <= 0 || port > 65535 || optind == argc || argc - optind > MAX_SHARDS) usage(argv[0]);
+    signal(SIGPIPE, SIG_IGN);
+
+    struct buf sections = { 0 };
+    for (int i = optind; i < argc; i++) {
+        if (add_shard(argv[i], &sections) < 0) {
+            fprintf(stderr, "Error: Cannot get the layout of shard %s\n", argv[i]);
+            return 1;
+        }
+        printf("Shard %d: %s, seats %d-%d\n", num_shards, argv[i], shards[num_shards - 1].offset + 1,
+               shards[num_shards - 1].offset + shards[num_shards - 1].num_seats);
+    }
+    char head[32];
+    struct buf text = { 0 };
+    buf_put(&text, head, snprintf(head, sizeof(head), "LAYOUT %d", total_seats));
+    buf_put(&text, sections.data, sections.len);
+    buf_put(&text, "\n", 2);
+    layout = text.data;
+    free(sections.data);
+
+    int server_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int on = 1;
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = INADDR_ANY, .sin_port = htons(port) };
+    if (server_fd < 0 || setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0 ||
+        bind(server_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(server_fd, SOMAXCONN) < 0) {
+        perror("Listen failed");
+        return 1;
+    }
+    printf("Router listening on port %d: %d seats over %d shards\n", port, total_seats, num_shards);
+    fflush(stdout);
+
+    for (;;) {
+        int fd = accept4(server_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) continue;
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        struct client* c = calloc(1, sizeof(*c));
+        pthread_t thread;
+        if (!c) {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        if (pthread_create(&thread, NULL, client_run, c) == 0) {
+            pthread_detach(thread);
+        } else {
+            close(fd);
+            free(c);
+        }
+    }
+}
@@ -0,0 +1,290 @@
+/*
+ * Seat store micro-benchmark
+ * Usage: ./seatbench [-t max_threads] [-d seconds] [-g] [-s lock|cas] [-n seats] [-a]
+ *                    [-m read_pct] [-j journal_dir [-J group|sync]]
+ * Each thread books and cancels seats in its own stripe, so with striped
+ * locking throughput should scale with the number of cores; -g puts every
+ * seat in one stripe to reproduce the old global-mutex behaviour and
+ * -s cas runs the same workload against the lock-free bitmap protocol.
+ * -a adds a reader thread polling AVAILABLE and reports its latency, which
+ * should stay flat as the number of writers grows.
+ * -m 95 runs a poller-heavy mix instead: every thread reads AVAILABLE 95%
+ * of the time and books (then cancels) a random seat pair otherwise; BOOK
+ * p99 should not move as more and more pollers join.
+ * -j journals every operation and waits for it to be durable, like the
+ * server does before replying; compare -J sync (one fdatasync per
+ * operation) with -J group (one fdatasync per batch).
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <dirent.h>
+#include <limits.h>
+#include "seats.h"
+#include "journal.h"
+
+struct worker {
+    pthread_t thread;
+    int id;
+    long ops;
+    double* book_samples;   /* -m: BOOK latencies in microseconds */
+    long num_book;
+    double* read_samples;   /* -m: AVAILABLE latencies */
+    long num_read;
+} __attribute__((aligned(CACHE_LINE)));
+
+#define MAX_SAMPLES 1000000
+#define MIX_SAMPLES 200000   /* per thread and operation */
+
+static struct seat_store store;
+static volatile int running;
+static double* samples; /* AVAILABLE latencies in microseconds */
+static long num_samples;
+static volatile char sink; /* keeps the AVAILABLE copy from being optimised away */
+static struct journal* journal;
+static int read_pct = -1;  /* -m */
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void* worker_run(void* arg) {
+    struct worker* w = arg;
+    int stripe = w->id % store.num_stripes;
+    int per_stripe = store.num_seats / store.num_stripes;
+    int pair[2] = { stripe * per_stripe + 1, stripe * per_stripe + (per_stripe > 1 ? 2 : 1) };
+    int n = pair[0] == pair[1] ? 1 : 2, bad;
+    long ops = 0;
+    
+    while (running) {
+        seats_book(&store, pair, n, w->id, &bad);
+        if (journal) journal_wait(journal, journal_last_lsn());
+        seats_cancel(&store, pair, n, w->id, &bad);
+        if (journal) journal_wait(journal, journal_last_lsn());
+        ops += 2;
+    }
+    w->ops = ops;
+    return NULL;
+}
+
+/* -m: AVAILABLE read_pct% of the time, otherwise BOOK and CANCEL two adjacent random seats */
+static void* mix_run(void* arg) {
+    struct worker* w = arg;
+    size_t cap = store.num_seats * 9 + 16;
+    char* copy = malloc(cap);
+    unsigned rnd = w->id * 2654435761u + 1;
+    int bad;
+    while (running) {
+        rnd = rnd * 1103515245 + 12345;
+        double start = now_sec();
+        if ((int)((rnd >> 8) % 100) < read_pct) {
+            long len = seats_avail_read(&store, seats_version(&store), copy, cap);
+            if (len > 0) sink = copy[len - 1];
+            if (w->num_read < MIX_SAMPLES) w->read_samples[w->num_read++] = (now_sec() - start) * 1e6;
+        } else {
+            int first = (rnd >> 12) % (store.num_seats - 1) + 1, pair[2] = { first, first + 1 };
+            int booked = seats_book(&store, pair, 2, w->id, &bad) == SEAT_OK;
+            if (w->num_book < MIX_SAMPLES) w->book_samples[w->num_book++] = (now_sec() - start) * 1e6;
+            if (booked) seats_cancel(&store, pair, 2, w->id, &bad);
+        }
+        w->ops++;
+    }
+    free(copy);
+    return NULL;
+}
+
+static void* reader_run(void* arg) {
+    (void)arg;
+    char* copy = malloc(store.num_seats * 9 + 16);
+    while (running && num_samples < MAX_SAMPLES) {
+        double start = now_sec();
+        long len = seats_avail_read(&store, seats_version(&store), copy, store.num_seats * 9 + 16);
+        if (len > 0) sink = copy[len - 1];
+        samples[num_samples++] = (now_sec() - start) * 1e6;
+    }
+    free(copy);
+    return NULL;
+}
+
+static void journal_hook(void* arg, enum seat_op op, const int* seat_nums, int n, int64_t owner) {
+    (void)arg;
+    journal_append(journal, op, 1, seat_nums, n, owner);
+}
+
+/* Every run starts from an empty journal */
+static void clear_journal(const char* dir) {
+    DIR* d = opendir(dir);
+    struct dirent* e;
+    while (d && (e = readdir(d))) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        if (strncmp(e->d_name, "journal.", 8) == 0) unlink(path);
+    }
+    if (d) closedir(d);
+}
+
+static int skip_record(void* arg, const struct journal_record* rec) {
+    (void)arg;
+    (void)rec;
+    return 0;
+}
+
+static int cmp_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+static int cmp_double(const void* a, const void* b);
+
+/* Merge the threads' samples and return the given percentile */
+static double percentile(struct worker* workers, int threads, int book, double p) {
+    long n = 0;
+    for (int i = 0; i < threads; i++) n += book ? workers[i].num_book : workers[i].num_read;
+    if (n == 0) return 0;
+    double* all = malloc(n * sizeof(double));
+    long k = 0;
+    for (int i = 0; i < threads; i++) {
+        long m = book ? workers[i].num_book : workers[i].num_read;
+        memcpy(all + k, book ? workers[i].book_samples : workers[i].read_samples, m * sizeof(double));
+        k += m;
+    }
+    qsort(all, n, sizeof(double), cmp_double);
+    double v = all[(long)(n * p / 100) < n ? (long)(n * p / 100) : n - 1];
+    free(all);
+    return v;
+}
+
+static void run_mix(int threads, double seconds) {
+    struct worker* workers = calloc(threads, sizeof(*workers));
+    running = 1;
+    for (int i = 0; i < threads; i++) {
+        workers[i].id = i + 1;
+        workers[i].book_samples = malloc(MIX_SAMPLES * sizeof(double));
+        workers[i].read_samples = malloc(MIX_SAMPLES * sizeof(double));
+        pthread_create(&workers[i].thread, NULL, mix_run, &workers[i]);
+    }
+    double start = now_sec();
+    usleep(seconds * 1e6);
+    running = 0;
+    long total = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        total += workers[i].ops;
+    }
+    double elapsed = now_sec() - start;
+    printf("%7d %12.0f %10.2f %10.2f %12.2f %10.2f\n", threads, total / elapsed, percentile(workers, threads, 1, 50),
+           percentile(workers, threads, 1, 99), percentile(workers, threads, 0, 50), percentile(workers, threads, 0, 99));
+    for (int i = 0; i < threads; i++) {
+        free(workers[i].book_samples);
+        free(workers[i].read_samples);
+    }
+    free(workers);
+}
+
+static double run(int threads, double seconds, int with_reader) {
+    struct worker* workers = calloc(threads, sizeof(*workers));
+    pthread_t reader;
+    running = 1;
+    num_samples = 0;
+    if (with_reader) pthread_create(&reader, NULL, reader_run, NULL);
+    double start = now_sec();
+    for (int i = 0; i < threads; i++) {
+        workers[i].id = i;
+        pthread_create(&workers[i].thread, NULL, worker_run, &workers[i]);
+    }
+    usleep(seconds * 1e6);
+    running = 0;
+    long total = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        total += workers[i].ops;
+    }
+    double elapsed = now_sec() - start;
+    if (with_reader) pthread_join(reader, NULL);
+    free(workers);
+    return total / elapsed;
+}
+
+int main(int argc, char* argv[]) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads = cpus > 0 ? cpus : 1, num_seats = DEFAULT_SEATS, global = 0, readers = 0, opt;
+    enum seat_store_kind kind = SEAT_STORE_LOCK;
+    double seconds = 1.0;
+    const char* journal_path = NULL;
+    enum journal_mode journal_mode = JOURNAL_GROUP;
+    
+    while ((opt = getopt(argc, argv, "t:d:gs:n:am:j:J:")) != -1) {
+        switch (opt) {
+        case 't': max_threads = atoi(optarg); break;
+        case 'd': seconds = atof(optarg); break;
+        case 'g': global = 1; break;
+        case 'n': num_seats = atoi(optarg); break;
+        case 'a': readers = 1; break;
+        case 'm': read_pct = atoi(optarg); break;
+        case 's': kind = strcmp(optarg, "cas") == 0 ? SEAT_STORE_CAS : SEAT_STORE_LOCK; break;
+        case 'j': journal_path = optarg; break;
+        case 'J': journal_mode = strcmp(optarg, "sync") == 0 ? JOURNAL_SYNC : JOURNAL_GROUP; break;
+        default:
+            fprintf(stderr, "Usage: %s [-t max_threads] [-d seconds] [-g] [-s lock|cas] [-n seats] [-a]"
+                            " [-m read_pct]"
+                            " [-j journal_dir [-J group|sync]]\n", argv[0]);
+            return 1;
+        }
+    }
+    
+    if (init_seats(&store, num_seats, kind, global ? num_seats : SEATS_PER_STRIPE) < 0) {
+        fprintf(stderr, "Cannot allocate %d seats\n", num_seats);
+        return 1;
+    }
+    if (journal_path) {
+        long replayed, skipped;
+        clear_journal(journal_path);
+        if (!(journal = journal_open(journal_path, journal_mode, 0, skip_record, NULL, &replayed, &skipped))) {
+            perror("Journal open failed");
+            return 1;
+        }
+        store.commit_hook = journal_hook;
+    }
+    printf("%d seats, %s, %.1fs per run%s\n\n", num_seats,
+           kind == SEAT_STORE_CAS ? "lock-free CAS" : global ? "1 stripe" : "striped locks", seconds,
+           !journal ? "" : journal_mode == JOURNAL_SYNC ? ", journal fdatasync per operation" : ", journal group commit");
+    if (read_pct >= 0) {
+        printf("%d%% AVAILABLE / %d%% BOOK\n", read_pct, 100 - read_pct);
+        printf("threads      ops/sec   BOOK p50     BOOK p99   AVAILABLE p50   p99 (us)\n");
+        for (int t = 1; t <= max_threads; t *= 2) {
+            run_mix(t, seconds);
+            if (t < max_threads && t * 2 > max_threads) t = max_threads / 2;
+        }
+        return 0;
+    }
+    if (readers) {
+        samples = malloc(MAX_SAMPLES * sizeof(double));
+        printf("writers      ops/sec   AVAILABLE avg us   p99 us\n");
+    } else {
+        printf("threads      ops/sec   speedup\n");
+    }
+    
+    double base = 0;
+    for (int t = 1; t <= max_threads; t *= 2) {
+        double rate = run(t, seconds, readers);
+        if (t == 1) base = rate;
+        if (readers) {
+            double sum = 0;
+            for (long i = 0; i < num_samples; i++) sum += samples[i];
+            qsort(samples, num_samples, sizeof(double), cmp_double);
+            printf("%7d %12.0f %18.2f %8.2f\n", t, rate, num_samples ? sum / num_samples : 0,
+                   num_samples ? samples[num_samples * 99 / 100] : 0);
+        } else {
+            printf("%7d %12.0f %8.2fx\n", t, rate, rate / base);
+        }
+        if (t < max_threads && t * 2 > max_threads) t = max_threads / 2;
+    }
+    return 0;
+}
@@ -0,0 +1,650 @@
+/*
+ * Bitmap seat store with striped-lock and lock-free CAS protocols (see seats.h)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+#include "seats.h"
+#include "trace.h"
+
+#define CANCELLING (-2) /* owner slot claimed by an in-flight CANCEL/CONFIRM/RELEASE */
+#define MAX_STRIPES 16384
+#define ALIGN_UP(n) (((n) + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1))
+
+
+/* Bits of one bitmap word touched by a request */
+struct word_mask {
+    int word;
+    uint64_t mask;
+};
+
+static int venue_add_section(struct venue* v, const char* name, int rows, int row_width) {
+    if (rows <= 0 || row_width <= 0 || (long)rows * row_width > MAX_VENUE_SEATS - v->num_seats) return -1;
+    struct venue_section* sections = realloc(v->sections, (v->num_sections + 1) * sizeof(*sections));
+    if (!sections) return -1;
+    v->sections = sections;
+    struct venue_section* sec = &sections[v->num_sections++];
+    snprintf(sec->name, sizeof(sec->name), "%s", name);
+    sec->first_seat = v->num_seats + 1;
+    sec->rows = rows;
+    sec->row_width = row_width;
+    v->num_seats += rows * row_width;
+    return 0;
+}
+
+int venue_flat(struct venue* v, int num_seats, int row_width) {
+    memset(v, 0, sizeof(*v));
+    if (num_seats <= 0 || num_seats > MAX_VENUE_SEATS || row_width <= 0) return -1;
+    if (row_width > num_seats) row_width = num_seats;
+    if (venue_add_section(v, "A", (num_seats + row_width - 1) / row_width, row_width) < 0) return -1;
+    v->num_seats = num_seats; /* the last row may be partial */
+    return 0;
+}
+
+int venue_load(struct venue* v, const char* path) {
+    memset(v, 0, sizeof(*v));
+    FILE* f = fopen(path, "r");
+    if (!f) return -1;
+    
+    char line[256], name[MAX_SECTION_NAME];
+    int rows, row_width, lineno = 0, err = 0;
+    while (!err && fgets(line, sizeof(line), f)) {
+        lineno++;
+        line[strcspn(line, "#\r\n")] = '\0';
+        if (strspn(line, " \t") == strlen(line)) continue;
+        if (sscanf(line, "%31s %d %d", name, &rows, &row_width) != 3 || strchr(name, ':') ||
+            venue_add_section(v, name, rows, row_width) < 0) {
+            fprintf(stderr, "%s:%d: expected \"name rows row_width\"\n", path, lineno);
+            err = 1;
+        }
+    }
+    fclose(f);
+    if (!err && v->num_sections == 0) {
+        fprintf(stderr, "%s: no sections\n", path);
+        err = 1;
+    }
+    if (err) {
+        free(v->sections);
+        memset(v, 0, sizeof(*v));
+        return -1;
+    }
+    return 0;
+}
+
+int init_seats(struct seat_store* st, int num_seats, enum seat_store_kind kind, int seats_per_stripe) {
+    memset(st, 0, sizeof(*st));
+    st->kind = kind;
+    st->num_seats = num_seats;
+    st->num_words = (num_seats + 63) / 64;
+    st->stripe_size = seats_per_stripe > 0 ? seats_per_stripe : SEATS_PER_STRIPE;
+    while ((num_seats + st->stripe_size - 1) / st->stripe_size > MAX_STRIPES) st->stripe_size *= 2;
+    st->num_stripes = (num_seats + st->stripe_size - 1) / st->stripe_size;
+    
+    /* bitmaps, owner and expiry arrays and stripe locks live in one cache-aligned block */
+    int dirty_count = (st->num_words + 63) / 64;
+    size_t bits_size = ALIGN_UP(st->num_words * sizeof(uint64_t));
+    size_t dirty_size = ALIGN_UP(dirty_count * sizeof(uint64_t));
+    size_t owners_size = ALIGN_UP(num_seats * sizeof(int64_t));
+    size_t expiry_size = ALIGN_UP(num_seats * sizeof(uint32_t));
+    size_t size = 2 * bits_size + 2 * dirty_size + owners_size + expiry_size + st->num_stripes * sizeof(struct seat_stripe);
+    if (posix_memalign(&st->block, CACHE_LINE, size) != 0) {
+        st->block = NULL;
+        return -1;
+    }
+    char* p = st->block;
+    st->booked_bits = (_Atomic uint64_t*)p;
+    st->held_bits = (_Atomic uint64_t*)(p += bits_size);
+    st->dirty_words = (_Atomic uint64_t*)(p += bits_size);
+    st->full_words = (_Atomic uint64_t*)(p += dirty_size);
+    st->owners = (_Atomic int64_t*)(p += dirty_size);
+    st->hold_expiry = (uint32_t*)(p += owners_size);
+    st->stripes = (struct seat_stripe*)(p + expiry_size);
+    
+    for (int s = 0; s < st->num_stripes; s++) pthread_mutex_init(&st->stripes[s].lock, NULL);
+    for (int w = 0; w < st->num_words; w++) {
+        atomic_init(&st->booked_bits[w], 0);
+        atomic_init(&st->held_bits[w], 0);
+    }
+    for (int d = 0; d < dirty_count; d++) {
+        atomic_init(&st->dirty_words[d], ~0ULL); /* first render does every word */
+        atomic_init(&st->full_words[d], 0);
+    }
+    for (int i = 0; i < num_seats; i++) atomic_init(&st->owners[i], NO_OWNER);
+    atomic_init(&st->version, 1);
+    pthread_mutex_init(&st->avail.render_lock, NULL);
+    return 0;
+}
+
+void destroy_seats(struct seat_store* st) {
+    for (int s = 0; s < st->num_stripes; s++) pthread_mutex_destroy(&st->stripes[s].lock);
+    pthread_mutex_destroy(&st->avail.render_lock);
+    free(st->avail.slots[0].text);
+    free(st->avail.slots[1].text);
+    while (st->avail.retired) {
+        struct avail_retired* r = st->avail.retired;
+        st->avail.retired = r->next;
+        free(r->text);
+        free(r);
+    }
+    free(st->avail.chunks);
+    free(st->avail.chunk_len);
+    free(st->block);
+    memset(st, 0, sizeof(*st));
+}
+
+static void sync_full(struct seat_store* st, int w);
+
+void seats_restore(struct seat_store* st, const uint64_t* booked_bits, const int64_t* owners) {
+    for (int w = 0; w < st->num_words; w++) {
+        atomic_store_explicit(&st->booked_bits[w], booked_bits[w], memory_order_relaxed);
+        atomic_store_explicit(&st->held_bits[w], 0, memory_order_relaxed);
+        atomic_store_explicit(&st->dirty_words[w / 64], ~0ULL, memory_order_relaxed);
+        sync_full(st, w);
+    }
+    for (int i = 0; i < st->num_seats; i++)
+        atomic_store_explicit(&st->owners[i], booked_bits[i / 64] >> (i % 64) & 1 ? owners[i] : NO_OWNER,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&st->version, 1, memory_order_release);
+}
+
+/* Bring w's bit in full_words in line with the word. Whoever writes the bit re-reads
+ * the word afterwards, so once writers are done the bit is right even if two of them
+ * raced; in between it is only a hint. The bit rarely changes, so this is two loads */
+static void sync_full(struct seat_store* st, int w) {
+    uint64_t pad = w == st->num_words - 1 && st->num_seats % 64 ? ~0ULL << (st->num_seats % 64) : 0;
+    uint64_t bit = 1ULL << (w % 64);
+    _Atomic uint64_t* summary = &st->full_words[w / 64];
+    for (;;) {
+        int full = (atomic_load(&st->booked_bits[w]) | pad) == ~0ULL;
+        if (((atomic_load(summary) & bit) != 0) == full) return;
+        if (full) atomic_fetch_or(summary, bit);
+        else atomic_fetch_and(summary, ~bit);
+    }
+}
+
+/* Record that bitmap word w changed; callers bump the version once afterwards */
+static inline void mark_dirty(struct seat_store* st, int w) {
+    atomic_fetch_or_explicit(&st->dirty_words[w / 64], 1ULL << (w % 64), memory_order_release);
+    sync_full(st, w);
+}
+
+static inline void bump_version(struct seat_store* st) {
+    atomic_fetch_add_explicit(&st->version, 1, memory_order_release);
+}
+
+uint64_t seats_version(struct seat_store* st) {
+    return atomic_load_explicit(&st->version, memory_order_acquire);
+}
+
+static inline void commit(struct seat_store* st, enum seat_op op, const int* seat_nums, int n, int64_t owner) {
+    if (st->commit_hook) st->commit_hook(st->hook_arg, op, seat_nums, n, owner);
+}
+
+static inline int seat_is_booked(struct seat_store* st, int idx) {
+    return (atomic_load_explicit(&st->booked_bits[idx / 64], memory_order_acquire) >> (idx % 64)) & 1;
+}
+
+static inline int seat_is_held(struct seat_store* st, int idx) {
+    return (atomic_load_explicit(&st->held_bits[idx / 64], memory_order_acquire) >> (idx % 64)) & 1;
+}
+
+/* Mark a just-claimed seat held until expiry, before its owner is published */
+static inline void set_held(struct seat_store* st, int idx, uint32_t expiry) {
+    st->hold_expiry[idx] = expiry;
+    atomic_fetch_or_explicit(&st->held_bits[idx / 64], 1ULL << (idx % 64), memory_order_release);
+}
+
+/* What happens to seats that are already booked */
+enum settle_action {
+    SETTLE_CANCEL,   /* booked, not held: free it */
+    SETTLE_CONFIRM,  /* held: make it a booking */
+    SETTLE_RELEASE,  /* held: free it */
+    SETTLE_EXPIRE    /* held by the hold that set this expiry: free it */
+};
+
+/* Whether an owned seat is in the right hold state for action */
+static enum seat_status settle_state(struct seat_store* st, int idx, enum settle_action action, uint32_t expiry) {
+    if (action == SETTLE_CANCEL) return seat_is_held(st, idx) ? SEAT_HELD : SEAT_OK;
+    if (!seat_is_held(st, idx) || (action == SETTLE_EXPIRE && st->hold_expiry[idx] != expiry)) return SEAT_NOT_HELD;
+    return SEAT_OK;
+}
+
+/* Insert key into the ascending array keys[0..count); returns its slot, or -(slot + 2) if already present */
+static int insert_sorted(int* keys, int count, int key) {
+    int j = count;
+    while (j > 0 && keys[j - 1] > key) j--;
+    if (j > 0 && keys[j - 1] == key) return -(j - 1) - 2;
+    for (int k = count; k > j; k--) keys[k] = keys[k - 1];
+    keys[j] = key;
+    return j;
+}
+
+/* Collect the distinct stripes covering seat_nums (n >= 1) in ascending order */
+static int stripes_for(struct seat_store* st, const int* seat_nums, int n, int* out) {
+    int count = 1;
+    out[0] = (seat_nums[0] - 1) / st->stripe_size;
+    for (int i = 1; i < n; i++)
+        if (insert_sorted(out, count, (seat_nums[i] - 1) / st->stripe_size) >= 0) count++;
+    return count;
+}
+
+/* Group seat_nums into per-word masks, ordered by ascending word */
+static int words_for(const int* seat_nums, int n, struct word_mask* out) {
+    int words[MAX_REQUEST_SEATS], count = 0;
+    for (int i = 0; i < n; i++) {
+        int idx = seat_nums[i] - 1;
+        int slot = insert_sorted(words, count, idx / 64);
+        if (slot >= 0) {
+            for (int k = count; k > slot; k--) out[k] = out[k - 1];
+            out[slot].word = idx / 64;
+            out[slot].mask = 0;
+            count++;
+        } else {
+            slot = -slot - 2;
+        }
+        out[slot].mask |= 1ULL << (idx % 64);
+    }
+    return count;
+}
+
+/* Waits are timed only when the trylock fails, so uncontended locking costs nothing extra */
+static void lock_stripes(struct seat_store* st, const int* ids, int count) {
+    for (int i = 0; i < count; i++) {
+        pthread_mutex_t* lock = &st->stripes[ids[i]].lock;
+        if (pthread_mutex_trylock(lock) == 0) continue;
+        TRACE_SCOPE("seat lock wait");
+        struct timespec a, b;
+        clock_gettime(CLOCK_MONOTONIC, &a);
+        pthread_mutex_lock(lock);
+        clock_gettime(CLOCK_MONOTONIC, &b);
+        atomic_fetch_add_explicit(&st->contention.waits, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&st->contention.wait_ns,
+                                  (b.tv_sec - a.tv_sec) * 1000000000ULL + b.tv_nsec - a.tv_nsec, memory_order_relaxed);
+    }
+}
+
+static void unlock_stripes(struct seat_store* st, const int* ids, int count) {
+    for (int i = count - 1; i >= 0; i--) pthread_mutex_unlock(&st->stripes[ids[i]].lock);
+}
+
+/* First seat in request order whose bit is set in bits (for error reporting) */
+static int first_in_word(const int* seat_nums, int n, int word, uint64_t bits) {
+    for (int i = 0; i < n; i++) {
+        int idx = seat_nums[i] - 1;
+        if (idx / 64 == word && ((bits >> (idx % 64)) & 1)) return seat_nums[i];
+    }
+    return seat_nums[0];
+}
+
+/* BOOK, or HOLD when hold is set: holds are not committed until confirmed */
+static enum seat_status book_locked(struct seat_store* st, const int* seat_nums, int n, int64_t owner, int hold,
+                                    uint32_t expiry, int* first_bad) {
+    int ids[MAX_REQUEST_SEATS];
+    int count = stripes_for(st, seat_nums, n, ids);
+    
+    /* CRITICAL SECTION: Atomic check-and-book over every stripe involved */
+    lock_stripes(st, ids, count);
+    for (int i = 0; i < n; i++) {
+        if (seat_is_booked(st, seat_nums[i] - 1)) {
+            *first_bad = seat_nums[i];
+            unlock_stripes(st, ids, count);
+            return SEAT_TAKEN;
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        int idx = seat_nums[i] - 1;
+        atomic_store_explicit(&st->owners[idx], owner, memory_order_relaxed);
+        if (hold) set_held(st, idx, expiry);
+        /* Other stripes may share this word, so the bit update itself is atomic */
+        atomic_fetch_or_explicit(&st->booked_bits[idx / 64], 1ULL << (idx % 64), memory_order_release);
+        mark_dirty(st, idx / 64);
+    }
+    if (!hold) commit(st, SEAT_OP_BOOK, seat_nums, n, owner);
+    bump_version(st);
+    unlock_stripes(st, ids, count);
+    return SEAT_OK;
+}
+
+static enum seat_status settle_locked(struct seat_store* st, const int* seat_nums, int n, int64_t owner,
+                                     enum settle_action action, uint32_t expiry, int* first_bad) {
+    int ids[MAX_REQUEST_SEATS];
+    int count = stripes_for(st, seat_nums, n, ids);
+    int held = action != SETTLE_CANCEL;
+    
+    lock_stripes(st, ids, count);
+    for (int i = 0; i < n; i++) {
+        int idx = seat_nums[i] - 1;
+        enum seat_status status = !seat_is_booked(st, idx) ? (held ? SEAT_NOT_HELD : SEAT_NOT_BOOKED)
+            : atomic_load_explicit(&st->owners[idx], memory_order_relaxed) != owner ? (held ? SEAT_NOT_HELD : SEAT_NOT_OWNER)
+            : settle_state(st, idx, action, expiry);
+        if (status != SEAT_OK) {
+            *first_bad = seat_nums[i];
+            unlock_stripes(st, ids, count);
+            return status;
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        int idx = seat_nums[i] - 1;
+        if (held) atomic_fetch_and_explicit(&st->held_bits[idx / 64], ~(1ULL << (idx % 64)), memory_order_release);
+        if (action == SETTLE_CONFIRM) continue;
+        atomic_store_explicit(&st->owners[idx], NO_OWNER, memory_order_relaxed);
+        atomic_fetch_and_explicit(&st->booked_bits[idx / 64], ~(1ULL << (idx % 64)), memory_order_release);
+        mark_dirty(st, idx / 64);
+    }
+    if (action == SETTLE_CANCEL) commit(st, SEAT_OP_CANCEL, seat_nums, n, owner);
+    else if (action == SETTLE_CONFIRM) commit(st, SEAT_OP_BOOK, seat_nums, n, owner);
+    if (action != SETTLE_CONFIRM) bump_version(st);
+    unlock_stripes(st, ids, count);
+    return SEAT_OK;
+}
+
+static enum seat_status book_cas(struct seat_store* st, const int* seat_nums, int n, int64_t owner, int hold,
+                                 uint32_t expiry, int* first_bad) {
+    struct word_mask words[MAX_REQUEST_SEATS];
+    int count = words_for(seat_nums, n, words);
+    
+    /* Claim word by word in ascending order; a conflict undoes the words already claimed */
+    for (int w = 0; w < count; w++) {
+        _Atomic uint64_t* word = &st->booked_bits[words[w].word];
+        uint64_t old = atomic_load_explicit(word, memory_order_relaxed);
+        for (;;) {
+            if (old & words[w].mask) {
+                *first_bad = first_in_word(seat_nums, n, words[w].word, old & words[w].mask);
+                if (w == 0) return SEAT_TAKEN;
+                /* A render may have seen the rolled-back claims, so those words are dirty too */
+                while (--w >= 0) {
+                    atomic_fetch_and_explicit(&st->booked_bits[words[w].word], ~words[w].mask, memory_order_release);
+                    mark_dirty(st, words[w].word);
+                }
+                bump_version(st);
+                return SEAT_TAKEN;
+            }
+            if (atomic_compare_exchange_weak_explicit(word, &old, old | words[w].mask,
+                                                      memory_order_acq_rel, memory_order_relaxed)) break;
+            atomic_fetch_add_explicit(&st->contention.cas_retries, 1, memory_order_relaxed);
+        }
+    }
+    /* Until the owners are published no CANCEL can settle these seats, so the hook sees the BOOK first */
+    if (!hold) commit(st, SEAT_OP_BOOK, seat_nums, n, owner);
+    for (int i = 0; i < n; i++) {
+        if (hold) set_held(st, seat_nums[i] - 1, expiry);
+        atomic_store_explicit(&st->owners[seat_nums[i] - 1], owner, memory_order_release);
+    }
+    for (int w = 0; w < count; w++) mark_dirty(st, words[w].word);
+    bump_version(st);
+    return SEAT_OK;
+}
+
+static enum seat_status settle_cas(struct seat_store* st, const int* seat_nums, int n, int64_t owner,
+                                  enum settle_action action, uint32_t expiry, int* first_bad) {
+    int held = action != SETTLE_CANCEL;
+    /* Take every owner slot first so a concurrent CANCEL/CONFIRM/RELEASE cannot settle the same seats */
+    for (int i = 0; i < n; i++) {
+        int idx = seat_nums[i] - 1;
+        int64_t expected = owner;
+        enum seat_status status;
+        if (!atomic_compare_exchange_strong_explicit(&st->owners[idx], &expected, CANCELLING,
+                                                     memory_order_acq_rel, memory_order_relaxed))
+            status = held ? SEAT_NOT_HELD : seat_is_booked(st, idx) ? SEAT_NOT_OWNER : SEAT_NOT_BOOKED;
+        else if ((status = settle_state(st, idx, action, expiry)) != SEAT_OK)
+            atomic_store_explicit(&st->owners[idx], owner, memory_order_release);
+        if (status != SEAT_OK) {
+            *first_bad = seat_nums[i];
+            for (int j = 0; j < i; j++) atomic_store_explicit(&st->owners[seat_nums[j] - 1], owner, memory_order_release);
+            return status;
+        }
+    }
+    struct word_mask words[MAX_REQUEST_SEATS];
+    int count = words_for(seat_nums, n, words);
+    if (held)
+        for (int w = 0; w < count; w++) atomic_fetch_and_explicit(&st->held_bits[words[w].word], ~words[w].mask, memory_order_release);
+    if (action == SETTLE_CONFIRM) {
+        commit(st, SEAT_OP_BOOK, seat_nums, n, owner);
+        for (int i = 0; i < n; i++) atomic_store_explicit(&st->owners[seat_nums[i] - 1], owner, memory_order_release);
+        return SEAT_OK;
+    }
+    /* Still exclusive: no BOOK can claim these seats until the bits are cleared */
+    if (action == SETTLE_CANCEL) commit(st, SEAT_OP_CANCEL, seat_nums, n, owner);
+    for (int i = 0; i < n; i++) atomic_store_explicit(&st->owners[seat_nums[i] - 1], NO_OWNER, memory_order_relaxed);
+    for (int w = 0; w < count; w++) {
+        atomic_fetch_and_explicit(&st->booked_bits[words[w].word], ~words[w].mask, memory_order_release);
+        mark_dirty(st, words[w].word);
+    }
+    bump_version(st);
+    return SEAT_OK;
+}
+
+enum seat_status seats_book(struct seat_store* st, const int* seat_nums, int n, int64_t owner, int* first_bad) {
+    return st->kind == SEAT_STORE_CAS ? book_cas(st, seat_nums, n, owner, 0, 0, first_bad)
+                                      : book_locked(st, seat_nums, n, owner, 0, 0, first_bad);
+}
+
+enum seat_status seats_hold(struct seat_store* st, const int* seat_nums, int n, int64_t owner, uint32_t expiry,
+                            int* first_bad) {
+    return st->kind == SEAT_STORE_CAS ? book_cas(st, seat_nums, n, owner, 1, expiry, first_bad)
+                                      : book_locked(st, seat_nums, n, owner, 1, expiry, first_bad);
+}
+
+static enum seat_status settle(struct seat_store* st, const int* seat_nums, int n, int64_t owner,
+                               enum settle_action action, uint32_t expiry, int* first_bad) {
+    return st->kind == SEAT_STORE_CAS ? settle_cas(st, seat_nums, n, owner, action, expiry, first_bad)
+                                      : settle_locked(st, seat_nums, n, owner, action, expiry, first_bad);
+}
+
+enum seat_status seats_cancel(struct seat_store* st, const int* seat_nums, int n, int64_t owner, int* first_bad) {
+    return settle(st, seat_nums, n, owner, SETTLE_CANCEL, 0, first_bad);
+}
+
+enum seat_status seats_confirm(struct seat_store* st, const int* seat_nums, int n, int64_t owner, int* first_bad) {
+    return settle(st, seat_nums, n, owner, SETTLE_CONFIRM, 0, first_bad);
+}
+
+enum seat_status seats_release(struct seat_store* st, const int* seat_nums, int n, int64_t owner, int* first_bad) {
+    return settle(st, seat_nums, n, owner, SETTLE_RELEASE, 0, first_bad);
+}
+
+/* Free bits of word w restricted to seat indexes [from, to) */
+static inline uint64_t free_bits(struct seat_store* st, int w, int from, int to) {
+    uint64_t bits = ~atomic_load_explicit(&st->booked_bits[w], memory_order_acquire);
+    int lo = from > w * 64 ? from - w * 64 : 0;
+    int hi = to < (w + 1) * 64 ? to - w * 64 : 64;
+    if (lo > 0) bits &= ~0ULL << lo;
+    if (hi < 64) bits &= (1ULL << hi) - 1;
+    return bits;
+}
+
+/* Start of the first n free adjacent seats in seat indexes [from, to), a word at a time; -1 if none */
+static int find_run(struct seat_store* st, int from, int to, int n) {
+    int run = 0;  /* free seats running up to the end of the previous word */
+    for (int w = from / 64; w * 64 < to && w < st->num_words; w++) {
+        uint64_t bits = free_bits(st, w, from, to);
+        int lead = bits == ~0ULL ? 64 : __builtin_ctzll(~bits);
+        if (run + lead >= n) return w * 64 - run;
+        if (n <= 64) {
+            /* Bit i of y: seats i..i+len-1 all free, doubling len up to n */
+            uint64_t y = bits;
+            for (int len = 1; len < n && y;) {
+                int step = len < n - len ? len : n - len;
+                y &= y >> step;
+                len += step;
+            }
+            if (y) return w * 64 + __builtin_ctzll(y);
+        }
+        run = bits == ~0ULL ? run + 64 : __builtin_clzll(~bits);
+    }
+    return -1;
+}
+
+/* First bitmap word from w on with a free seat, 64 words per load; num_words if none */
+static int next_open_word(struct seat_store* st, int w) {
+    for (int s = w / 64; s * 64 < st->num_words; s++) {
+        uint64_t open = ~atomic_load_explicit(&st->full_words[s], memory_order_acquire);
+        if (s == w / 64) open &= ~0ULL << (w % 64);
+        if (open) {
+            int found = s * 64 + __builtin_ctzll(open);
+            return found < st->num_words ? found : st->num_words;
+        }
+    }
+    return st->num_words;
+}
+
+enum seat_status seats_book_best(struct seat_store* st, const struct venue_section* sec, int n, int64_t owner,
+                                 int* seat_nums) {
+    if (n < 1 || n > MAX_REQUEST_SEATS || n > sec->row_width) return SEAT_TAKEN;
+    int base = sec->first_seat - 1, row = 0, first_bad;
+    while (row < sec->rows) {
+        /* Sold-out words have no room, so skip ahead to the row of the next word with a free seat */
+        int open = next_open_word(st, (base + row * sec->row_width) / 64) * 64 - base;
+        if (open > row * sec->row_width) row = open / sec->row_width;
+        if (row >= sec->rows) break;
+        int from = base + row * sec->row_width;
+        int to = from + sec->row_width < st->num_seats ? from + sec->row_width : st->num_seats;
+        /* The last row may be cut short by the venue size */
+        int start = to - from >= n ? find_run(st, from, to, n) : -1;
+        if (start < 0) {
+            row++;
+            continue;
+        }
+        for (int i = 0; i < n; i++) seat_nums[i] = start + i + 1;
+        /* The scan read the bitmap without locks; losing a race means scanning this row again */
+        if (seats_book(st, seat_nums, n, owner, &first_bad) == SEAT_OK) return SEAT_OK;
+    }
+    return SEAT_TAKEN;
+}
+
+int seats_expire(struct seat_store* st, const int* seat_nums, int n, int64_t owner, uint32_t expiry) {
+    int released = 0, bad;
+    for (int i = 0; i < n; i++)
+        released += settle(st, &seat_nums[i], 1, owner, SETTLE_EXPIRE, expiry, &bad) == SEAT_OK;
+    return released;
+}
+
+
+int seats_free_bitmap(struct seat_store* st, uint64_t* out) {
+    /* Both stores change booked_bits with atomic read-modify-writes, so acquire
+     * loads see whole words and no seat lock is taken, as for the AVAILABLE snapshot */
+    int count = 0;
+    for (int w = 0; w < st->num_words; w++) {
+        out[w] = free_bits(st, w, 0, st->num_seats);
+        count += __builtin_popcountll(out[w]);
+    }
+    return count;
+}
+
+char* put_seat(char* p, unsigned n) {
+    char digits[12];
+    int len = 0;
+    do digits[len++] = '0' + n % 10; while ((n /= 10));
+    *p++ = ' ';
+    while (len) *p++ = digits[--len];
+    return p;
+}
+
+/* Re-render dirty words and assemble them into the unpublished slot (render_lock held) */
+static int render_available(struct seat_store* st) {
+    struct avail_snapshot* av = &st->avail;
+    if (!av->chunks) {
+        int digits = 1;
+        for (int n = st->num_seats; n >= 10; n /= 10) digits++;
+        av->chunk_cap = 64 * (digits + 1);
+        av->chunks = malloc((size_t)st->num_words * av->chunk_cap);
+        av->chunk_len = calloc(st->num_words, sizeof(*av->chunk_len));
+        if (!av->chunks || !av->chunk_len) {
+            free(av->chunks);
+            free(av->chunk_len);
+            av->chunks = NULL;
+            av->chunk_len = NULL;
+            return -1;
+        }
+    }
+    
+    /* Loading the version first means every change it covers has already marked its words dirty */
+    uint64_t version = seats_version(st);
+    size_t total = 0;
+    for (int d = 0; d * 64 < st->num_words; d++) {
+        uint64_t dirty = atomic_exchange_explicit(&st->dirty_words[d], 0, memory_order_acq_rel);
+        for (; dirty; dirty &= dirty - 1) {
+            int w = d * 64 + __builtin_ctzll(dirty);
+            if (w >= st->num_words) break;
+            char* start = av->chunks + (size_t)w * av->chunk_cap;
+            char* p = start;
+            for (uint64_t bits = free_bits(st, w, 0, st->num_seats); bits; bits &= bits - 1)
+                p = put_seat(p, w * 64 + __builtin_ctzll(bits) + 1);
+            av->chunk_len[w] = p - start;
+        }
+    }
+    for (int w = 0; w < st->num_words; w++) total += av->chunk_len[w];
+    
+    /* Rewrite the slot readers are not directed to; any still copying it will see seq move and retry */
+    struct avail_slot* slot = &av->slots[1 - atomic_load(&av->current)];
+    char* text = atomic_load_explicit(&slot->text, memory_order_relaxed);
+    if (slot->cap < total + 16) {
+        /* Grown, never realloc'd: the old text stays readable for readers that loaded it */
+        size_t cap = slot->cap * 2 > total + 16 ? slot->cap * 2 : total + 16;
+        struct avail_retired* r = text ? malloc(sizeof(*r)) : NULL;
+        char* grown = malloc(cap);
+        if (!grown || (text && !r)) {
+            free(grown);
+            free(r);
+            return -1;
+        }
+        if (r) {
+            r->text = text;
+            r->next = av->retired;
+            av->retired = r;
+        }
+        text = grown;
+        slot->cap = cap;
+    }
+    uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    char* p = text;
+    memcpy(p, "AVAILABLE", 9);
+    p += 9;
+    for (int w = 0; w < st->num_words; w++) {
+        memcpy(p, av->chunks + (size_t)w * av->chunk_cap, av->chunk_len[w]);
+        p += av->chunk_len[w];
+    }
+    if (total == 0) {
+        memcpy(p, " NONE", 5);
+        p += 5;
+    }
+    *p++ = '\n';
+    atomic_store_explicit(&slot->text, text, memory_order_relaxed);
+    atomic_store_explicit(&slot->len, p - text, memory_order_relaxed);
+    atomic_store_explicit(&slot->version, version, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+    atomic_store_explicit(&av->current, (int)(slot - av->slots), memory_order_release);
+    return 0;
+}
+
+long seats_avail_read(struct seat_store* st, uint64_t min_version, char* buf, size_t cap) {
+    struct avail_snapshot* av = &st->avail;
+    for (;;) {
+        struct avail_slot* slot = &av->slots[atomic_load_explicit(&av->current, memory_order_acquire)];
+        uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq & 1) continue; /* flipped away and being rewritten; current already names the other slot */
+        if (atomic_load_explicit(&slot->version, memory_order_relaxed) >= min_version) {
+            const char* text = atomic_load_explicit(&slot->text, memory_order_relaxed);
+            size_t len = atomic_load_explicit(&slot->len, memory_order_relaxed);
+            /* text and len must come from one rendering before len bytes of text are read */
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq) continue;
+            if (len <= cap) memcpy(buf, text, len);
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == seq) return len;
+            continue;
+        }
+        
+        /* Stale: render it ourselves unless another reader already did while we waited */
+        pthread_mutex_lock(&av->render_lock);
+        int failed = 0;
+        if (atomic_load(&av->slots[atomic_load(&av->current)].version) < min_version) failed = render_available(st) < 0;
+        pthread_mutex_unlock(&av->render_lock);
+        if (failed) return -1;
+    }
+}
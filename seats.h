@@ -0,0 +1,175 @@
+/*
+ * Seat store shared by the server and the benchmarks
+ * Every event owns a separate store, so events never contend with each other.
+ * Layout: one bit per seat in a packed atomic bitmap (64 seats per word)
+ * plus a parallel owner array. Two booking protocols over that layout:
+ *  - SEAT_STORE_LOCK: seats are split into stripes of consecutive seats,
+ *    each with its own mutex; multi-seat operations lock the stripes they
+ *    touch in ascending order, so they are deadlock-free and all-or-nothing.
+ *  - SEAT_STORE_CAS: lock-free; seats in one word are claimed with a single
+ *    compare-and-swap, cross-word requests claim words in ascending order
+ *    and roll back the words already claimed if a later one conflicts.
+ * HOLD claims seats like BOOK but also sets their held bit and an expiry
+ * tick; CONFIRM turns a hold into a booking, RELEASE or expiry frees it.
+ * Holds are not committed (journaled) until they are confirmed.
+ * BOOK BEST scans rows for a run of free seats with ctz and shift-and
+ * over the bitmap, skipping sold-out words through a one-bit-per-word summary.
+ * AVAILABLE is served from a pre-rendered text snapshot: writers mark the
+ * bitmap words they change as dirty and bump a version, readers re-render
+ * only dirty words and publish the result into one of two slots, so
+ * AVAILABLE never takes a seat lock. Each slot is a seqlock: readers copy
+ * the text and retry if the slot's sequence moved meanwhile, so neither
+ * bookers nor the renderer ever wait for a reader.
+ */
+
+#ifndef SEATS_H
+#define SEATS_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define DEFAULT_SEATS 20
+#define DEFAULT_ROW_WIDTH 5
+#define MAX_VENUE_SEATS 10000000
+#define MAX_REQUEST_SEATS 128 /* seats named in one BOOK/CANCEL */
+#define MAX_SECTION_NAME 32
+#define SEATS_PER_STRIPE 4
+#define NO_OWNER (-1)
+#define CACHE_LINE 64
+
+/* Seats are numbered 1..num_seats, section by section, row by row */
+struct venue_section {
+    char name[MAX_SECTION_NAME];
+    int first_seat, rows, row_width;
+};
+
+struct venue {
+    int num_seats, num_sections;
+    struct venue_section* sections;
+};
+
+enum seat_store_kind { SEAT_STORE_LOCK, SEAT_STORE_CAS };
+
+enum seat_op { SEAT_OP_BOOK = 1, SEAT_OP_CANCEL };
+
+/* Runs inside every successful BOOK/CANCEL while its seats are still held
+ * exclusively, so two operations on the same seat reach the hook in the
+ * order they took effect */
+typedef void (*seat_commit_hook)(void* arg, enum seat_op op, const int* seat_nums, int n, int64_t owner);
+
+/* Padded so two stripes never share a cache line */
+struct seat_stripe {
+    pthread_mutex_t lock;
+} __attribute__((aligned(CACHE_LINE)));
+
+/* One published "AVAILABLE ...\n" rendering, read optimistically */
+struct avail_slot {
+    _Atomic uint64_t seq;            /* odd while the renderer rewrites the slot */
+    _Atomic(char*) text;
+    _Atomic size_t len;
+    _Atomic uint64_t version;
+    size_t cap;
+} __attribute__((aligned(CACHE_LINE)));
+
+/* Texts outgrown by a slot; a late reader may still be copying one, so they live as long as the store */
+struct avail_retired {
+    struct avail_retired* next;
+    char* text;
+};
+
+struct avail_snapshot {
+    pthread_mutex_t render_lock;     /* one renderer at a time; never held by BOOK/CANCEL */
+    _Atomic int current;             /* slot readers should use */
+    struct avail_slot slots[2];
+    struct avail_retired* retired;
+    char* chunks;                    /* rendered free seats of each bitmap word */
+    unsigned short* chunk_len;
+    int chunk_cap;
+};
+
+/* One event's inventory; each store is its own lock domain */
+struct seat_store {
+    void* block;
+    _Atomic uint64_t* booked_bits;
+    _Atomic uint64_t* held_bits;     /* subset of booked_bits: held, not yet confirmed */
+    _Atomic uint64_t* dirty_words;   /* one bit per bitmap word changed since the last render */
+    _Atomic uint64_t* full_words;    /* one bit per bitmap word with no free seat (BOOK BEST skips them) */
+    _Atomic int64_t* owners;         /* session id per seat, NO_OWNER if free */
+    uint32_t* hold_expiry;           /* expiry tick of a held seat's hold */
+    struct seat_stripe* stripes;
+    int num_seats, num_words;
+    int stripe_size, num_stripes;
+    enum seat_store_kind kind;
+    seat_commit_hook commit_hook;    /* optional, e.g. the write-ahead journal */
+    void* hook_arg;
+    struct {
+        _Atomic uint64_t waits, wait_ns;   /* stripe locks that were busy, time spent waiting */
+        _Atomic uint64_t cas_retries;      /* CAS claims retried after a concurrent change */
+    } contention __attribute__((aligned(CACHE_LINE)));
+    _Atomic uint64_t version __attribute__((aligned(CACHE_LINE)));
+    struct avail_snapshot avail;
+};
+
+/* A show: its venue layout and seat inventory */
+struct event {
+    int id;
+    struct venue venue;
+    struct seat_store store;
+};
+
+enum seat_status {
+    SEAT_OK = 0,
+    SEAT_TAKEN,        /* BOOK: seat already booked */
+    SEAT_NOT_BOOKED,   /* CANCEL: seat is free */
+    SEAT_NOT_OWNER,    /* CANCEL: seat booked by another client */
+    SEAT_HELD,         /* CANCEL: seat is only held (RELEASE it) */
+    SEAT_NOT_HELD      /* CONFIRM/RELEASE: seat not held by this client */
+};
+
+/* Single section of num_seats seats in rows of row_width */
+int venue_flat(struct venue* v, int num_seats, int row_width);
+/* Venue file: one "name rows row_width" line per section, '#' starts a comment */
+int venue_load(struct venue* v, const char* path);
+
+/* Allocates a store for num_seats seats; returns -1 if out of memory */
+int init_seats(struct seat_store* st, int num_seats, enum seat_store_kind kind, int seats_per_stripe);
+void destroy_seats(struct seat_store* st);
+/* Overwrite every seat from a bitmap and owner table (snapshot load, before serving) */
+void seats_restore(struct seat_store* st, const uint64_t* booked_bits, const int64_t* owners);
+
+/* seat_nums are 1-based, validated, duplicate-free and at most MAX_REQUEST_SEATS long;
+ * on failure *first_bad is the offending seat */
+enum seat_status seats_book(struct seat_store* st, const int* seat_nums, int n, int64_t owner, int* first_bad);
+enum seat_status seats_cancel(struct seat_store* st, const int* seat_nums, int n, int64_t owner, int* first_bad);
+
+/* Holds: HOLD marks the seats with expiry, which seats_expire must match to free them,
+ * so an expiry never frees a later hold of the same seat */
+enum seat_status seats_hold(struct seat_store* st, const int* seat_nums, int n, int64_t owner, uint32_t expiry,
+                            int* first_bad);
+enum seat_status seats_confirm(struct seat_store* st, const int* seat_nums, int n, int64_t owner, int* first_bad);
+enum seat_status seats_release(struct seat_store* st, const int* seat_nums, int n, int64_t owner, int* first_bad);
+/* Free the seats still held by owner under expiry, one at a time; returns how many */
+int seats_expire(struct seat_store* st, const int* seat_nums, int n, int64_t owner, uint32_t expiry);
+
+/* BOOK BEST: the first n adjacent free seats of one row, front row first, booked
+ * like seats_book into seat_nums; SEAT_TAKEN if no row of the section has room */
+enum seat_status seats_book_best(struct seat_store* st, const struct venue_section* sec, int n, int64_t owner,
+                                 int* seat_nums);
+
+/* Fill free_bits (num_words words, bit i set = seat i+1 free) without taking seat
+ * locks; returns the free count */
+int seats_free_bitmap(struct seat_store* st, uint64_t* free_bits);
+
+/* Write " <n>" at p (room for 11 bytes); returns the end. Shared by AVAILABLE and the seat replies */
+char* put_seat(char* p, unsigned n);
+
+/* Bumped after every change to the bitmap */
+uint64_t seats_version(struct seat_store* st);
+
+/* Copy a rendering of "AVAILABLE s1 s2 ...\n" that includes every change up to min_version
+ * into buf; returns its length, or -1 if out of memory. A length over cap means nothing
+ * was copied: call again with at least that much room. */
+long seats_avail_read(struct seat_store* st, uint64_t min_version, char* buf, size_t cap);
+
+#endif
@@ -1,333 +1,1981 @@
 /*
  * Multi-threaded Ticket Reservation Server
- * Protocol: AVAILABLE, BOOK n s1 s2..., CANCEL n s1 s2..., EXIT
- * Concurrency: seats_mutex protects seat array, log_mutex protects logging
+ * Protocol: AVAILABLE, BOOK n s1 s2... | BEST n [section], CANCEL n s1 s2... | ALL, MINE,
+ * HOLD/CONFIRM/RELEASE n s1 s2..., LOGIN, RESUME token, STATS, TRACE, PROMOTE, EXIT, or the binary
+ * frames of protocol.h on connections that start with BIN_MAGIC
+ * Concurrency: the seat store (seats.c) uses striped locks or lock-free CAS,
+ * requests are logged through per-thread rings drained by a writer thread (logger.c)
+ * Modes: thread (one thread per client, default), epoll (edge-triggered
+ * reactor, clients multiplexed over a fixed number of event-loop threads) or
+ * pool (one poller queues ready clients to a fixed set of workers), uring
+ * (io_uring rings with multishot accept/recv and batched sends, uring.c) or
+ * reuseport (epoll loops pinned to cores, each accepting on its own
+ * SO_REUSEPORT listener); every mode turns clients beyond -C away with FAIL busy
+ * Durability (-j): BOOK/CANCEL are journaled (journal.c) and their replies
+ * are held back until the journal record is on disk; snapshots (snapshot.c)
+ * keep restarts short
+ * Replication (repl.c): -P ships every committed BOOK/CANCEL to replicas;
+ * -F follows a primary, serving reads and refusing writes until PROMOTE
+ * Metrics (metrics.c): per-command counts and latencies, reported by STATS
+ * and, with -M, served in Prometheus format over HTTP
+ * Tracing (trace.c, make trace): per-thread spans dumped as Chrome trace JSON
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <pthread.h>
 #include <time.h>
-#include <ctype.h>
 #include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/epoll.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/eventfd.h>
+#include "seats.h"
+#include "logger.h"
+#include "journal.h"
+#include "snapshot.h"
+#include "protocol.h"
+#include "parse.h"
+#include "session.h"
+#include "timer.h"
+#include "metrics.h"
+#include "trace.h"
+#include "queue.h"
+#include "uring.h"
+#include "repl.h"
 
 #define PORT 8080
-#define MAX_SEATS 20
 #define BUFFER_SIZE 1024
+#define MAX_LINE (BUFFER_SIZE - 1)      /* longest accepted command line */
+#define IN_BUFFER_MAX (64 * 1024)       /* input buffer growth limit, i.e. pipelined bytes per recv */
 #define MAX_CLIENTS 100
+#define MAX_CONNECTIONS 10000           /* default -C in thread mode */
+#define FD_RESERVE 64                   /* descriptors kept back from -C for listeners, journal, epoll... */
+#define EPOLL_BATCH 256
+#define MAX_SHOWS 65536
+#define OUT_HIGH_WATER (64 * 1024)
+#define HOLD_SECONDS 300                /* default lifetime of a HOLD */
+#define URING_ENTRIES 256               /* submission queue per ring thread */
+#define URING_CQ_ENTRIES 4096
+#define URING_BUFS 1024                 /* provided recv buffers per ring thread */
+#define URING_BUF_SIZE 4096
 
-struct seat {
-    int id, booked, booked_by;
+enum conn_proto { PROTO_UNKNOWN, PROTO_TEXT, PROTO_BINARY };
+
+/* Per-connection state; input is framed into lines or binary frames from in,
+ * responses are queued in out and flushed once per batch of input */
+struct conn {
+    int fd;
+    struct sockaddr_in addr;
+    struct session* session;  /* owner of the seats booked here; LOGIN/RESUME */
+    enum conn_proto proto;  /* decided by the first byte received */
+    char* in;
+    size_t in_len, in_cap;
+    int discard; /* skipping the rest of an oversized line */
+    char* out;
+    size_t out_len, out_sent, out_cap;
+    int eof;
+    int closing;        /* finished, waiting for held output before closing */
+    uint64_t wait_lsn;  /* output is held until this journal LSN is durable */
+    int waiting;        /* on its loop's waiter list */
+    struct conn *wait_prev, *wait_next;
+    int recv_armed;     /* uring: a multishot recv is outstanding */
+    int recv_paused;    /* uring: recv cancelled until the input backlog drains */
+    int send_busy;      /* uring: a send of out is in flight, so out must not move */
+    int dead;           /* uring: close once the operations above have completed */
+};
+
+struct event_loop {
+    int epfd;
+    int efd;               /* signalled by the journal after every sync */
+    int listen_fd;         /* reuseport: this loop's own listener, else -1 */
+    int cpu;               /* reuseport: the core the loop is pinned to */
+    struct conn* waiters;  /* connections with output held for the journal */
+    pthread_t thread;
+};
+
+/* Pool mode: the poller queues connections with input, a fixed set of workers serves them */
+struct worker_pool {
+    int epfd;                      /* listening socket plus every idle connection, EPOLLONESHOT */
+    struct queue ready;
+    sem_t queued;                  /* posted once per queued connection */
+    _Atomic size_t depth_max;
 };
 
-struct seat seats[MAX_SEATS];
-pthread_mutex_t seats_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
 volatile int server_fd_global = -1;
+struct event* events;  /* event id N lives at events[N - 1] */
+int num_events;
+struct journal* journal;  /* NULL unless -j */
+int release_on_close;     /* -R: a session's seats go back when its last connection closes */
+uint64_t hold_ticks;      /* -H, in timer ticks */
+int max_conns;                     /* -C: connections beyond this are turned away; 0 until defaulted */
+_Atomic int open_conns;
+_Atomic uint64_t rejected_conns;
+struct worker_pool pool;
+
+/* Metrics: results are binary statuses, plus one for failures that have none */
+#define RESULT_OTHER (BIN_READ_ONLY + 1)
+static const char* const command_names[] = {
+    "EMPTY", "UNKNOWN", "EXIT", "EVENTS", "AVAILABLE", "LAYOUT", "BOOK", "CANCEL", "LOGIN", "RESUME",
+    "MINE", "HOLD", "CONFIRM", "RELEASE", "STATS", "TRACE", "PROMOTE"
+};
+static const char* const result_names[] = {
+    "ok", "taken", "not_booked", "not_owner", "invalid", "unknown_event", "unknown_command", "no_memory",
+    "bad_session", "held", "not_held", "read_only", "other"
+};
+static const enum bin_status seat_results[] = {
+    [SEAT_OK] = BIN_OK, [SEAT_TAKEN] = BIN_TAKEN, [SEAT_NOT_BOOKED] = BIN_NOT_BOOKED,
+    [SEAT_NOT_OWNER] = BIN_NOT_OWNER, [SEAT_HELD] = BIN_HELD, [SEAT_NOT_HELD] = BIN_NOT_HELD
+};
+static __thread int outcome;              /* result of the command being processed */
+static __thread uint64_t command_start;   /* when it started: the end of the one before */
+
+/* One HOLD request, freed when its timer fires; seats confirmed or released
+ * by then are skipped, since their expiry no longer matches */
+struct hold {
+    struct timer timer;
+    struct event* ev;
+    int64_t owner;
+    uint32_t expiry;
+    struct sockaddr_in addr;
+    int n;
+    int seats[];
+};
 
 void signal_handler(int sig) {
     if (sig == SIGINT || sig == SIGTERM) {
         write(STDERR_FILENO, "\n\nShutting down server...\n", 26);
         if (server_fd_global >= 0) close(server_fd_global);
-        pthread_mutex_destroy(&seats_mutex);
-        pthread_mutex_destroy(&log_mutex);
+        logger_shutdown();
         exit(0);
     }
 }
 
-void init_seats(void) {
-    for (int i = 0; i < MAX_SEATS; i++) {
-        seats[i].id = i + 1;
-        seats[i].booked = 0;
-        seats[i].booked_by = -1;
+struct conn* conn_new(int fd, struct sockaddr_in* addr) {
+    struct conn* c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+    c->fd = fd;
+    c->addr = *addr;
+    if (!(c->session = session_new())) {
+        free(c);
+        return NULL;
     }
+    metrics_conn(1);
+    atomic_fetch_add_explicit(&open_conns, 1, memory_order_relaxed);
+    return c;
 }
 
-void log_request(const char* action, struct sockaddr_in* client_addr, const char* result) {
-    pthread_mutex_lock(&log_mutex);
-    time_t now = time(NULL);
-    char* time_str = ctime(&now);
-    time_str[strlen(time_str) - 1] = '\0';
-    char client_ip[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &(client_addr->sin_addr), client_ip, INET_ADDRSTRLEN);
-    printf("[%s] Client %s:%d - %s - %s\n", time_str, client_ip, ntohs(client_addr->sin_port), action, result);
-    fflush(stdout);
-    pthread_mutex_unlock(&log_mutex);
+/* Admission control: over -C the client gets FAIL busy and is closed at once; NULL if not admitted */
+struct conn* conn_admit(int fd, struct sockaddr_in* addr) {
+    if (atomic_load_explicit(&open_conns, memory_order_relaxed) >= max_conns) {
+        send(fd, "FAIL busy\n", 10, MSG_NOSIGNAL | MSG_DONTWAIT);
+        close(fd);
+        atomic_fetch_add_explicit(&rejected_conns, 1, memory_order_relaxed);
+        log_request("CONNECT", addr, "FAIL: busy");
+        return NULL;
+    }
+    struct conn* c = conn_new(fd, addr);
+    if (!c) close(fd);
+    return c;
 }
 
-int handle_available(int client_fd) {
-    char response[BUFFER_SIZE] = "AVAILABLE";
-    char temp[32];
-    int count = 0;
-    
-    pthread_mutex_lock(&seats_mutex);
-    for (int i = 0; i < MAX_SEATS; i++) {
-        if (seats[i].booked == 0) {
-            snprintf(temp, sizeof(temp), " %d", seats[i].id);
-            strcat(response, temp);
-            count++;
+int cancel_all(struct conn* c, uint32_t event, struct seat_ref** seats);
+
+void conn_free(struct conn* c) {
+    close(c->fd);
+    metrics_conn(0);
+    atomic_fetch_sub_explicit(&open_conns, 1, memory_order_relaxed);
+    if (release_on_close && session_conns(c->session) == 1 && !repl_read_only()) {
+        struct seat_ref* refs;
+        cancel_all(c, 0, &refs);
+        free(refs);
+    }
+    session_release(c->session);
+    free(c->in);
+    free(c->out);
+    free(c);
+}
+
+/* Make room for len more output bytes; returns the write position (commit with out_len += n) */
+char* conn_reserve(struct conn* c, size_t len) {
+    if (c->out_sent == c->out_len) c->out_len = c->out_sent = 0;
+    if (c->out_len + len > c->out_cap) {
+        size_t cap = c->out_cap ? c->out_cap : BUFFER_SIZE;
+        while (cap < c->out_len + len) cap *= 2;
+        char* out = realloc(c->out, cap);
+        if (!out) return NULL;
+        c->out = out;
+        c->out_cap = cap;
+    }
+    return c->out + c->out_len;
+}
+
+/* Queue response bytes; the output buffer is only allocated once a reply is pending */
+void conn_reply(struct conn* c, const char* data, size_t len) {
+    if (outcome == BIN_OK && len > 4 && memcmp(data, "FAIL", 4) == 0) outcome = RESULT_OTHER;
+    char* p = conn_reserve(c, len);
+    if (!p) return;
+    memcpy(p, data, len);
+    c->out_len += len;
+}
+
+/* Queue "<prefix> s1 s2 ...\n" */
+void conn_reply_seats(struct conn* c, const char* prefix, const int* seat_nums, int num_seats) {
+    size_t plen = strlen(prefix);
+    char* start = conn_reserve(c, plen + num_seats * 12 + 1);
+    if (!start) return;
+    char* p = start + plen;
+    memcpy(start, prefix, plen);
+    for (int i = 0; i < num_seats; i++) p = put_seat(p, seat_nums[i]);
+    *p++ = '\n';
+    c->out_len += p - start;
+}
+
+/* Queue "<prefix> s1 s2 ...\n" from index entries, or "<prefix> NONE\n" */
+void conn_reply_refs(struct conn* c, const char* prefix, const struct seat_ref* refs, int n) {
+    size_t plen = strlen(prefix);
+    char* start = conn_reserve(c, plen + n * 12 + 6);
+    if (!start) return;
+    char* p = start + plen;
+    memcpy(start, prefix, plen);
+    for (int i = 0; i < n; i++) p = put_seat(p, refs[i].seat);
+    if (n == 0) p = stpcpy(p, " NONE");
+    *p++ = '\n';
+    c->out_len += p - start;
+}
+
+/* Replies after a journaled BOOK/CANCEL must not leave before its record is durable */
+int conn_held(struct conn* c) {
+    return journal && c->wait_lsn > journal_durable(journal);
+}
+
+/* Send pending output; returns 1 if all sent, 0 on EAGAIN or held output, -1 on error */
+int conn_flush(struct conn* c) {
+    if (conn_held(c)) return 0;
+    TRACE_SCOPE("send");
+    while (c->out_sent < c->out_len) {
+        ssize_t n = send(c->fd, c->out + c->out_sent, c->out_len - c->out_sent, MSG_NOSIGNAL);
+        metrics_syscalls(1);
+        if (n > 0) {
+            c->out_sent += n;
+            metrics_bytes(0, n);
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 0;
+        } else {
+            return -1;
         }
     }
-    pthread_mutex_unlock(&seats_mutex);
-    
-    strcat(response, count ? "\n" : " NONE\n");
-    send(client_fd, response, strlen(response), 0);
-    return 0;
+    c->out_len = c->out_sent = 0;
+    if (c->out_cap > OUT_HIGH_WATER) {
+        free(c->out);
+        c->out = NULL;
+        c->out_cap = 0;
+    }
+    return 1;
 }
 
-/* Parse seat numbers from command arguments */
-int parse_seats(char* args, int* seat_nums, int* num_seats) {
-    char args_copy[BUFFER_SIZE];
-    strncpy(args_copy, args, BUFFER_SIZE - 1);
-    args_copy[BUFFER_SIZE - 1] = '\0';
-    
-    char* token = strtok(args_copy, " \t\n");
-    if (!token) return -1;
-    
-    int expected = atoi(token);
-    if (expected <= 0 || expected > MAX_SEATS) return -1;
-    
-    *num_seats = 0;
-    while ((token = strtok(NULL, " \t\n")) && *num_seats < MAX_SEATS) {
-        int seat = atoi(token);
-        if (seat < 1 || seat > MAX_SEATS) return -1;
-        seat_nums[(*num_seats)++] = seat;
+/* Copies the store's latest pre-rendered snapshot; no seat locks are taken and no writer is waited for */
+int handle_available(struct conn* c, struct event* ev) {
+    TRACE_SCOPE("AVAILABLE");
+    uint64_t version = seats_version(&ev->store);
+    char* p = conn_reserve(c, BUFFER_SIZE);
+    if (!p) return 0;
+    size_t room = c->out_cap - c->out_len;
+    for (;;) {
+        long len = seats_avail_read(&ev->store, version, p, room);
+        if (len < 0) {
+            conn_reply(c, "FAIL out of memory\n", 19);
+            return 0;
+        }
+        if ((size_t)len <= room) {
+            c->out_len += len;
+            return 0;
+        }
+        /* Larger than the free space left in the buffer: make room and copy again */
+        if (!(p = conn_reserve(c, len + 256))) return 0;
+        room = c->out_cap - c->out_len;
     }
-    
-    if (*num_seats != expected) return -1;
-    
-    /* Check duplicates */
-    for (int i = 0; i < *num_seats; i++)
-        for (int j = i + 1; j < *num_seats; j++)
-            if (seat_nums[i] == seat_nums[j]) return -1;
-    
+}
+
+/* LAYOUT <seats> <section>:<first_seat>:<rows>:<row_width> ... */
+int handle_layout(struct conn* c, struct event* ev) {
+    struct venue* venue = &ev->venue;
+    char* start = conn_reserve(c, 32 + venue->num_sections * (MAX_SECTION_NAME + 40));
+    if (!start) return 0;
+    char* p = start + sprintf(start, "LAYOUT %d", venue->num_seats);
+    for (int i = 0; i < venue->num_sections; i++) {
+        struct venue_section* sec = &venue->sections[i];
+        p += sprintf(p, " %s:%d:%d:%d", sec->name, sec->first_seat, sec->rows, sec->row_width);
+    }
+    *p++ = '\n';
+    c->out_len += p - start;
     return 0;
 }
 
-int handle_cancel(int client_fd, char* args, struct sockaddr_in* client_addr) {
-    int seat_nums[MAX_SEATS], num_seats;
-    
-    if (parse_seats(args, seat_nums, &num_seats) < 0) {
-        send(client_fd, "FAIL invalid request\n", 21, 0);
-        log_request("CANCEL", client_addr, "FAIL: invalid");
-        return 0;
+/* Core operations, shared by the text and binary protocols */
+
+/* Atomic check-and-book over the stripes covering the requested seats */
+enum seat_status book_seats(struct conn* c, struct event* ev, const int* seat_nums, int n, int* first_bad) {
+    TRACE_SCOPE("seats_book");
+    enum seat_status status = seats_book(&ev->store, seat_nums, n, c->session->id, first_bad);
+    outcome = seat_results[status];
+    if (status == SEAT_OK && journal) c->wait_lsn = journal_last_lsn();
+    log_request("BOOK", &c->addr, status == SEAT_OK ? "SUCCESS" : "FAIL");
+    return status;
+}
+
+/* Check all seats are booked and owned by this client, then release them */
+enum seat_status cancel_seats(struct conn* c, struct event* ev, const int* seat_nums, int n, int* first_bad) {
+    TRACE_SCOPE("seats_cancel");
+    enum seat_status status = seats_cancel(&ev->store, seat_nums, n, c->session->id, first_bad);
+    outcome = seat_results[status];
+    if (status == SEAT_OK && journal) c->wait_lsn = journal_last_lsn();
+    log_request("CANCEL", &c->addr, status == SEAT_OK ? "SUCCESS" : "FAIL");
+    return status;
+}
+
+/* n adjacent seats in one row of section (-1 = the first section with room) */
+enum seat_status book_best(struct conn* c, struct event* ev, int section, int n, int* seat_nums) {
+    enum seat_status status = SEAT_TAKEN;
+    for (int i = section < 0 ? 0 : section; status != SEAT_OK && i < ev->venue.num_sections; i++) {
+        status = seats_book_best(&ev->store, &ev->venue.sections[i], n, c->session->id, seat_nums);
+        if (section >= 0) break;
     }
-    
-    pthread_mutex_lock(&seats_mutex);
-    
-    /* Check all seats are booked and owned by this client */
-    int all_ok = 1;
-    int first_bad = -1;
-    for (int i = 0; i < num_seats; i++) {
-        int idx = seat_nums[i] - 1;
-        if (seats[idx].booked == 0) {
-            all_ok = 0;
-            first_bad = seat_nums[i];
-            break;
-        }
-        if (seats[idx].booked_by != client_fd) {
-            all_ok = 0;
-            first_bad = seat_nums[i];
-            break;
+    outcome = seat_results[status];
+    if (status == SEAT_OK && journal) c->wait_lsn = journal_last_lsn();
+    log_request("BOOK BEST", &c->addr, status == SEAT_OK ? "SUCCESS" : "FAIL");
+    return status;
+}
+
+void hold_expired(struct timer* t) {
+    struct hold* h = (struct hold*)t;
+    if (seats_expire(&h->ev->store, h->seats, h->n, h->owner, h->expiry) > 0)
+        log_request("EXPIRE", &h->addr, "Hold released");
+    free(h);
+}
+
+/* Book seats provisionally until the hold times out; -1 if out of memory */
+int hold_seats(struct conn* c, struct event* ev, const int* seat_nums, int n, int* first_bad) {
+    struct hold* h = malloc(sizeof(*h) + n * sizeof(int));
+    if (!h) return -1;
+    *h = (struct hold){ .timer.fire = hold_expired, .ev = ev, .owner = c->session->id,
+                        .expiry = (uint32_t)(timer_now() + hold_ticks), .addr = c->addr, .n = n };
+    memcpy(h->seats, seat_nums, n * sizeof(int));
+    enum seat_status status = seats_hold(&ev->store, seat_nums, n, h->owner, h->expiry, first_bad);
+    outcome = seat_results[status];
+    log_request("HOLD", &c->addr, status == SEAT_OK ? "SUCCESS" : "FAIL");
+    if (status == SEAT_OK) timer_add(&h->timer, hold_ticks);
+    else free(h);
+    return status;
+}
+
+/* Turn held seats into a booking; journaled like BOOK */
+enum seat_status confirm_seats(struct conn* c, struct event* ev, const int* seat_nums, int n, int* first_bad) {
+    enum seat_status status = seats_confirm(&ev->store, seat_nums, n, c->session->id, first_bad);
+    outcome = seat_results[status];
+    if (status == SEAT_OK && journal) c->wait_lsn = journal_last_lsn();
+    log_request("CONFIRM", &c->addr, status == SEAT_OK ? "SUCCESS" : "FAIL");
+    return status;
+}
+
+enum seat_status release_seats(struct conn* c, struct event* ev, const int* seat_nums, int n, int* first_bad) {
+    enum seat_status status = seats_release(&ev->store, seat_nums, n, c->session->id, first_bad);
+    outcome = seat_results[status];
+    log_request("RELEASE", &c->addr, status == SEAT_OK ? "SUCCESS" : "FAIL");
+    return status;
+}
+
+/* Cancel every seat the session holds in event (0 = every event) through the
+ * per-owner index, MAX_REQUEST_SEATS seats per store operation. The seats
+ * cancelled are left in *seats (free it); returns their count, -1 if out of memory */
+int cancel_all(struct conn* c, uint32_t event, struct seat_ref** seats) {
+    int n, done = 0;
+    struct seat_ref* refs = session_seats(c->session, event, &n);
+    for (int i = 0; i < n;) {
+        struct event* ev = &events[refs[i].event - 1];
+        int chunk[MAX_REQUEST_SEATS], k = 0, first = i, bad;
+        while (i < n && k < MAX_REQUEST_SEATS && refs[i].event == refs[first].event) chunk[k++] = refs[i++].seat;
+        if (cancel_seats(c, ev, chunk, k, &bad) == SEAT_OK) {
+            memmove(&refs[done], &refs[first], k * sizeof(*refs));
+            done += k;
+            continue;
         }
+        /* Another connection of the session got to some of them first: go seat by seat */
+        for (int j = 0; j < k; j++)
+            if (cancel_seats(c, ev, &chunk[j], 1, &bad) == SEAT_OK) refs[done++] = refs[first + j];
+    }
+    *seats = refs;
+    outcome = n < 0 ? BIN_NO_MEMORY : BIN_OK;  /* seats another connection cancelled first are no failure */
+    return n < 0 ? -1 : done;
+}
+
+/* Move the connection into the session named by token; -1 if the token is not valid */
+int resume_session(struct conn* c, const char* token, size_t len) {
+    struct session* s = session_resume(token, len);
+    log_request("RESUME", &c->addr, s ? "SUCCESS" : "FAIL: invalid session");
+    if (!s) {
+        outcome = BIN_BAD_SESSION;
+        return -1;
+    }
+    session_release(c->session);
+    c->session = s;
+    return 0;
+}
+
+/* Bad seat list: clients only see "invalid", the log records why */
+void log_invalid(struct conn* c, const char* action, enum parse_error err) {
+    char result[64];
+    snprintf(result, sizeof(result), "FAIL: invalid (%s)", parse_error_string(err));
+    outcome = BIN_INVALID;
+    log_request(action, &c->addr, result);
+}
+
+/* Text protocol */
+
+/* MINE: this session's seats in the event, from the per-owner index */
+int handle_mine(struct conn* c, struct event* ev) {
+    int n;
+    struct seat_ref* refs = session_seats(c->session, ev->id, &n);
+    if (n < 0) conn_reply(c, "FAIL out of memory\n", 19);
+    else conn_reply_refs(c, "MINE", refs, n);
+    free(refs);
+    return 0;
+}
+
+int handle_cancel_all(struct conn* c, struct event* ev) {
+    struct seat_ref* refs;
+    int n = cancel_all(c, ev->id, &refs);
+    if (n < 0) conn_reply(c, "FAIL out of memory\n", 19);
+    else if (n == 0) conn_reply(c, "FAIL no seats booked\n", 21);
+    else conn_reply_refs(c, "OK CANCELLED", refs, n);
+    free(refs);
+    return 0;
+}
+
+int handle_cancel(struct conn* c, struct event* ev, const struct command* cmd) {
+    TRACE_SCOPE("CANCEL");
+    int seat_nums[MAX_REQUEST_SEATS], num_seats, first_bad;
+    if (parse_all(cmd->args, cmd->args_len)) return handle_cancel_all(c, ev);
+    enum parse_error err = parse_seats(cmd->args, cmd->args_len, ev->store.num_seats, seat_nums, &num_seats);
+    if (err != PARSE_OK) {
+        conn_reply(c, "FAIL invalid request\n", 21);
+        log_invalid(c, "CANCEL", err);
+        return 0;
     }
     
-    if (all_ok) {
-        char response[BUFFER_SIZE] = "OK CANCELLED";
-        for (int i = 0; i < num_seats; i++) {
-            int idx = seat_nums[i] - 1;
-            seats[idx].booked = 0;
-            seats[idx].booked_by = -1;
-            char temp[32];
-            snprintf(temp, sizeof(temp), " %d", seat_nums[i]);
-            strcat(response, temp);
-        }
-        strcat(response, "\n");
-        pthread_mutex_unlock(&seats_mutex);
-        send(client_fd, response, strlen(response), 0);
-        log_request("CANCEL", client_addr, "SUCCESS");
+    enum seat_status status = cancel_seats(c, ev, seat_nums, num_seats, &first_bad);
+    if (status == SEAT_OK) {
+        conn_reply_seats(c, "OK CANCELLED", seat_nums, num_seats);
         return 0;
     }
     
-    pthread_mutex_unlock(&seats_mutex);
     char error[BUFFER_SIZE];
     snprintf(error, sizeof(error), "FAIL seat %d %s\n", first_bad,
-             seats[first_bad - 1].booked == 0 ? "is not booked" : "was not booked by you");
-    send(client_fd, error, strlen(error), 0);
-    log_request("CANCEL", client_addr, "FAIL");
+             status == SEAT_NOT_BOOKED ? "is not booked" : status == SEAT_HELD ? "is held" : "was not booked by you");
+    conn_reply(c, error, strlen(error));
     return 0;
 }
 
-int handle_book(int client_fd, char* args, struct sockaddr_in* client_addr) {
-    int seat_nums[MAX_SEATS], num_seats;
-    
-    if (parse_seats(args, seat_nums, &num_seats) < 0) {
-        send(client_fd, "FAIL invalid request\n", 21, 0);
-        log_request("BOOK", client_addr, "FAIL: invalid");
+/* BOOK BEST n [section] */
+int handle_book_best(struct conn* c, struct event* ev, const struct best_request* req) {
+    TRACE_SCOPE("BOOK BEST");
+    int section = -1, seat_nums[MAX_REQUEST_SEATS];
+    for (int i = 0; req->section && i < ev->venue.num_sections; i++) {
+        const char* name = ev->venue.sections[i].name;
+        if (strlen(name) == req->section_len && strncasecmp(name, req->section, req->section_len) == 0) section = i;
+    }
+    if (req->section && section < 0) {
+        conn_reply(c, "FAIL unknown section\n", 21);
         return 0;
     }
-    
-    /* CRITICAL SECTION: Atomic check-and-book prevents double-booking */
-    pthread_mutex_lock(&seats_mutex);
-    
-    int all_available = 1;
-    int first_unavailable = -1;
-    for (int i = 0; i < num_seats; i++) {
-        int idx = seat_nums[i] - 1;
-        if (seats[idx].booked != 0) {
-            all_available = 0;
-            first_unavailable = seat_nums[i];
-            break;
-        }
+    if (book_best(c, ev, section, req->count, seat_nums) == SEAT_OK) {
+        conn_reply_seats(c, "OK BOOKED", seat_nums, req->count);
+        return 0;
+    }
+    char error[BUFFER_SIZE];
+    snprintf(error, sizeof(error), "FAIL no %d adjacent seats available\n", req->count);
+    conn_reply(c, error, strlen(error));
+    return 0;
+}
+
+int handle_book(struct conn* c, struct event* ev, const struct command* cmd) {
+    TRACE_SCOPE("BOOK");
+    int seat_nums[MAX_REQUEST_SEATS], num_seats, first_unavailable;
+    struct best_request best;
+    enum parse_error err;
+    int is_best = parse_best(cmd->args, cmd->args_len, &best, &err);
+    if (is_best && err == PARSE_OK) return handle_book_best(c, ev, &best);
+    if (!is_best) err = parse_seats(cmd->args, cmd->args_len, ev->store.num_seats, seat_nums, &num_seats);
+    if (err != PARSE_OK) {
+        conn_reply(c, "FAIL invalid request\n", 21);
+        log_invalid(c, "BOOK", err);
+        return 0;
     }
     
-    if (all_available) {
-        char response[BUFFER_SIZE] = "OK BOOKED";
-        for (int i = 0; i < num_seats; i++) {
-            int idx = seat_nums[i] - 1;
-            seats[idx].booked = 1;
-            seats[idx].booked_by = client_fd;
-            char temp[32];
-            snprintf(temp, sizeof(temp), " %d", seat_nums[i]);
-            strcat(response, temp);
-        }
-        strcat(response, "\n");
-        pthread_mutex_unlock(&seats_mutex);
-        send(client_fd, response, strlen(response), 0);
-        log_request("BOOK", client_addr, "SUCCESS");
+    if (book_seats(c, ev, seat_nums, num_seats, &first_unavailable) == SEAT_OK) {
+        conn_reply_seats(c, "OK BOOKED", seat_nums, num_seats);
         return 0;
     }
     
-    pthread_mutex_unlock(&seats_mutex);
     char error[BUFFER_SIZE];
     snprintf(error, sizeof(error), "FAIL seat %d already booked\n", first_unavailable);
-    send(client_fd, error, strlen(error), 0);
-    log_request("BOOK", client_addr, "FAIL");
+    conn_reply(c, error, strlen(error));
+    return 0;
+}
+
+/* HOLD / CONFIRM / RELEASE n s1 s2 ... */
+int handle_hold_op(struct conn* c, struct event* ev, const struct command* cmd) {
+    TRACE_SCOPE(cmd->name);
+    int seat_nums[MAX_REQUEST_SEATS], num_seats, first_bad;
+    enum parse_error err = parse_seats(cmd->args, cmd->args_len, ev->store.num_seats, seat_nums, &num_seats);
+    if (err != PARSE_OK) {
+        conn_reply(c, "FAIL invalid request\n", 21);
+        log_invalid(c, cmd->name, err);
+        return 0;
+    }
+
+    int status;
+    if (cmd->type == CMD_HOLD) status = hold_seats(c, ev, seat_nums, num_seats, &first_bad);
+    else if (cmd->type == CMD_CONFIRM) status = confirm_seats(c, ev, seat_nums, num_seats, &first_bad);
+    else status = release_seats(c, ev, seat_nums, num_seats, &first_bad);
+    if (status == SEAT_OK) {
+        conn_reply_seats(c, cmd->type == CMD_HOLD ? "OK HELD" : cmd->type == CMD_CONFIRM ? "OK CONFIRMED" : "OK RELEASED",
+                         seat_nums, num_seats);
+        return 0;
+    }
+    if (status < 0) {
+        conn_reply(c, "FAIL out of memory\n", 19);
+        return 0;
+    }
+
+    char error[BUFFER_SIZE];
+    snprintf(error, sizeof(error), "FAIL seat %d %s\n", first_bad,
+             status == SEAT_TAKEN ? "already booked" : "is not held by you");
+    conn_reply(c, error, strlen(error));
     return 0;
 }
 
-void to_upper(char* str) {
-    for (int i = 0; str[i]; i++) str[i] = toupper(str[i]);
+/* SESSION <token>: the token to RESUME this connection's session from another one */
+int handle_login(struct conn* c) {
+    char reply[SESSION_TOKEN_LEN + 10] = "SESSION ";
+    session_token(c->session, reply + 8);
+    reply[SESSION_TOKEN_LEN + 8] = '\n';
+    conn_reply(c, reply, SESSION_TOKEN_LEN + 9);
+    log_request("LOGIN", &c->addr, "SUCCESS");
+    return 0;
+}
+
+int handle_resume(struct conn* c, const struct command* cmd) {
+    size_t len = cmd->args_len;
+    while (len > 0 && (cmd->args[len - 1] == ' ' || cmd->args[len - 1] == '\t')) len--;
+    if (resume_session(c, cmd->args, len) < 0) conn_reply(c, "FAIL invalid session\n", 21);
+    else conn_reply(c, "OK RESUMED\n", 11);
+    return 0;
 }
 
-int process_command(int client_fd, char* command, struct sockaddr_in* client_addr) {
-    command[strcspn(command, "\r\n")] = '\0';
-    if (strlen(command) == 0) return 0;
+/* EVENTS <id>:<seats> ... */
+int handle_events(struct conn* c) {
+    char* start = conn_reserve(c, 16 + num_events * 24);
+    if (!start) return 0;
+    char* p = start + sprintf(start, "EVENTS");
+    for (int i = 0; i < num_events; i++) p += sprintf(p, " %d:%d", events[i].id, events[i].venue.num_seats);
+    *p++ = '\n';
+    c->out_len += p - start;
+    return 0;
+}
+
+/* Counters kept outside metrics.c: seat store contention summed over events, admission and the pool queue */
+struct server_counters {
+    unsigned long long waits, wait_ns, retries, rejected, depth, depth_max;
+};
+
+static void server_counters(struct server_counters* k) {
+    memset(k, 0, sizeof(*k));
+    for (int i = 0; i < num_events; i++) {
+        k->waits += atomic_load_explicit(&events[i].store.contention.waits, memory_order_relaxed);
+        k->wait_ns += atomic_load_explicit(&events[i].store.contention.wait_ns, memory_order_relaxed);
+        k->retries += atomic_load_explicit(&events[i].store.contention.cas_retries, memory_order_relaxed);
+    }
+    k->rejected = atomic_load_explicit(&rejected_conns, memory_order_relaxed);
+    if (pool.ready.cells) k->depth = queue_depth(&pool.ready);
+    k->depth_max = atomic_load_explicit(&pool.depth_max, memory_order_relaxed);
+}
+
+/* STATS: the metrics line plus the server counters */
+int handle_stats(struct conn* c) {
+    char* text = NULL;
+    size_t len = 0;
+    FILE* f = open_memstream(&text, &len);
+    if (!f) return 0;
+    struct server_counters k;
+    server_counters(&k);
+    metrics_write_stats(f);
+    fprintf(f, " seat_lock_waits=%llu seat_lock_wait_us=%llu seat_cas_retries=%llu rejected=%llu queue_depth=%llu"
+               " queue_depth_max=%llu", k.waits, k.wait_ns / 1000, k.retries, k.rejected, k.depth, k.depth_max);
+    struct repl_stats r;
+    repl_get_stats(&r);
+    if (r.primary) fprintf(f, " replicas=%d repl_seq=%llu repl_acked=%llu", r.replicas, (unsigned long long)r.seq,
+                           (unsigned long long)r.acked);
+    if (r.replica) fprintf(f, " repl_connected=%d repl_applied=%llu", r.connected, (unsigned long long)r.applied);
+    fputc('\n', f);
+    fclose(f);
+    conn_reply(c, text, len);
+    free(text);
+    return 0;
+}
+
+/* TRACE: dump the trace rings (only in -DTRACE builds) */
+int handle_trace(struct conn* c) {
+    char path[64], reply[96];
+    snprintf(path, sizeof(path), "trace-%d.json", (int)getpid());
+    if (trace_dump(path) < 0) {
+        snprintf(reply, sizeof(reply), "FAIL %s\n", errno == ENOSYS ? "tracing not compiled in" : "cannot write trace");
+    } else {
+        snprintf(reply, sizeof(reply), "OK TRACE %s\n", path);
+    }
+    conn_reply(c, reply, strlen(reply));
+    log_request("TRACE", &c->addr, reply);
+    return 0;
+}
+
+/* PROMOTE: a replica stops following its primary and starts taking writes */
+int handle_promote(struct conn* c) {
+    if (repl_promote() < 0) {
+        outcome = RESULT_OTHER;
+        conn_reply(c, "FAIL not a replica\n", 19);
+        log_request("PROMOTE", &c->addr, "FAIL: not a replica");
+    } else {
+        conn_reply(c, "OK PROMOTED\n", 12);
+    }
+    return 0;
+}
+
+/* Record the command just finished; it started where the previous one ended */
+static void command_done(enum command_type type) {
+    uint64_t now = metrics_now();
+    metrics_command(type, outcome, now - command_start);
+    command_start = now;
+}
+
+/* Run one parsed command; returns 1 on EXIT */
+int dispatch_command(struct conn* c, const struct command* cmd) {
+    switch (cmd->type) {
+    case CMD_EMPTY:
+        return 0;
+    case CMD_EXIT:
+        log_request("EXIT", &c->addr, "Disconnecting");
+        return 1;
+    case CMD_EVENTS:
+        return handle_events(c);
+    case CMD_STATS:
+        return handle_stats(c);
+    case CMD_TRACE:
+        return handle_trace(c);
+    case CMD_PROMOTE:
+        return handle_promote(c);
+    case CMD_LOGIN:
+        return handle_login(c);
+    case CMD_RESUME:
+        return handle_resume(c, cmd);
+    case CMD_UNKNOWN: {
+        char text[64];
+        size_t n = cmd->args_len < sizeof(text) - 1 ? cmd->args_len : sizeof(text) - 1;
+        memcpy(text, cmd->args, n);
+        text[n] = '\0';
+        outcome = BIN_UNKNOWN_OP;
+        conn_reply(c, "FAIL unknown command\n", 21);
+        log_request("UNKNOWN", &c->addr, text);
+        return 0;
+    }
+    default:
+        break;
+    }
     
-    char cmd_upper[BUFFER_SIZE];
-    strncpy(cmd_upper, command, BUFFER_SIZE - 1);
-    cmd_upper[BUFFER_SIZE - 1] = '\0';
-    to_upper(cmd_upper);
+    /* Optional "@<event>" defaults to the first event */
+    if (cmd->event < 0 || cmd->event > num_events) {
+        outcome = BIN_UNKNOWN_EVENT;
+        conn_reply(c, "FAIL unknown event\n", 19);
+        log_request(cmd->name, &c->addr, "FAIL: unknown event");
+        return 0;
+    }
+    struct event* ev = &events[cmd->event ? cmd->event - 1 : 0];
     
-    if (strncmp(cmd_upper, "AVAILABLE", 9) == 0) {
-        return handle_available(client_fd);
-    } else if (strncmp(cmd_upper, "BOOK", 4) == 0) {
-        char* args = command + 4;
-        while (*args == ' ' || *args == '\t') args++;
-        return handle_book(client_fd, args, client_addr);
-    } else if (strncmp(cmd_upper, "CANCEL", 6) == 0) {
-        char* args = command + 6;
-        while (*args == ' ' || *args == '\t') args++;
-        return handle_cancel(client_fd, args, client_addr);
-    } else if (strncmp(cmd_upper, "EXIT", 4) == 0) {
-        log_request("EXIT", client_addr, "Disconnecting");
-        return 1;
-    } else {
-        send(client_fd, "FAIL unknown command\n", 21, 0);
-        log_request("UNKNOWN", client_addr, command);
+    if (cmd->type != CMD_AVAILABLE && cmd->type != CMD_LAYOUT && cmd->type != CMD_MINE && repl_read_only()) {
+        outcome = BIN_READ_ONLY;
+        conn_reply(c, "FAIL read-only replica\n", 23);
+        log_request(cmd->name, &c->addr, "FAIL: read-only replica");
         return 0;
     }
+    
+    switch (cmd->type) {
+    case CMD_AVAILABLE: return handle_available(c, ev);
+    case CMD_LAYOUT: return handle_layout(c, ev);
+    case CMD_MINE: return handle_mine(c, ev);
+    case CMD_HOLD:
+    case CMD_CONFIRM:
+    case CMD_RELEASE: return handle_hold_op(c, ev, cmd);
+    case CMD_BOOK: return handle_book(c, ev, cmd);
+    default: return handle_cancel(c, ev, cmd);
+    }
+}
+
+/* One command line, parsed in place (the line is not NUL-terminated) */
+int process_command(struct conn* c, const char* line, size_t len) {
+    TRACE_SCOPE("process_command");
+    struct command cmd;
+    {
+        TRACE_SCOPE("parse");
+        parse_command(line, len, &cmd);
+    }
+    outcome = BIN_OK;
+    int result = dispatch_command(c, &cmd);
+    if (cmd.type != CMD_EMPTY) command_done(cmd.type);
+    return result;
+}
+
+/* Run every complete line in the input buffer; returns 1 on EXIT */
+int conn_process_text(struct conn* c) {
+    size_t start = 0;
+    int result = 0;
+    command_start = metrics_now();
+    while (result == 0 && c->out_len - c->out_sent < OUT_HIGH_WATER) {
+        char* nl = memchr(c->in + start, '\n', c->in_len - start);
+        size_t end;
+        if (nl) {
+            end = nl - c->in;
+        } else if (c->eof && start < c->in_len) {
+            end = c->in_len; /* final unterminated line */
+        } else {
+            break;
+        }
+        if (c->discard) {
+            c->discard = 0;
+        } else if (end - start > MAX_LINE) {
+            outcome = BIN_INVALID;
+            conn_reply(c, "FAIL request too long\n", 22);
+            log_request("UNKNOWN", &c->addr, "FAIL: request too long");
+            command_done(CMD_UNKNOWN);
+        } else {
+            result = process_command(c, c->in + start, end - start);
+        }
+        start = end + 1 < c->in_len ? end + 1 : c->in_len;
+    }
+    if (c->in_len - start > MAX_LINE && !memchr(c->in + start, '\n', c->in_len - start)) {
+        /* An unterminated line is already too long: reject it and drop it up to the next newline */
+        if (!c->discard) {
+            conn_reply(c, "FAIL request too long\n", 22);
+            log_request("UNKNOWN", &c->addr, "FAIL: request too long");
+        }
+        c->discard = 1;
+        start = c->in_len;
+    }
+    memmove(c->in, c->in + start, c->in_len - start);
+    c->in_len -= start;
+    return result;
+}
+
+/* Binary protocol */
+
+void bin_reply(struct conn* c, const struct bin_request* req, enum bin_status status, uint32_t seat) {
+    if (status != BIN_OK) outcome = status;
+    struct bin_response resp = { sizeof(resp), req->op, status, 0, req->tag, seat };
+    conn_reply(c, (const char*)&resp, sizeof(resp));
+}
+
+/* Free-seat bitmap straight from the store, one bit per seat */
+void bin_available(struct conn* c, struct event* ev, const struct bin_request* req) {
+    static __thread uint64_t* words;
+    static __thread int words_cap;
+    struct seat_store* st = &ev->store;
+    if (words_cap < st->num_words) {
+        uint64_t* grown = realloc(words, st->num_words * sizeof(uint64_t));
+        if (!grown) {
+            bin_reply(c, req, BIN_NO_MEMORY, 0);
+            return;
+        }
+        words = grown;
+        words_cap = st->num_words;
+    }
+    seats_free_bitmap(st, words);
+    size_t size = sizeof(struct bin_response) + st->num_words * sizeof(uint64_t);
+    char* p = conn_reserve(c, size);
+    if (!p) return;
+    struct bin_response resp = { size, req->op, BIN_OK, 0, req->tag, st->num_seats };
+    memcpy(p, &resp, sizeof(resp));
+    memcpy(p + sizeof(resp), words, st->num_words * sizeof(uint64_t));
+    c->out_len += size;
+}
+
+/* BOOK, CANCEL, HOLD, CONFIRM and RELEASE */
+void bin_seat_op(struct conn* c, struct event* ev, const struct bin_request* req, const char* payload) {
+    static const char* const names[] = {
+        [BIN_OP_BOOK] = "BOOK", [BIN_OP_CANCEL] = "CANCEL",
+        [BIN_OP_HOLD] = "HOLD", [BIN_OP_CONFIRM] = "CONFIRM", [BIN_OP_RELEASE] = "RELEASE"
+    };
+    int seat_nums[MAX_REQUEST_SEATS], first_bad = 0;
+    int n = req->count;
+    for (int i = 0; i < n && n <= MAX_REQUEST_SEATS; i++) {
+        uint32_t seat;
+        memcpy(&seat, payload + i * sizeof(seat), sizeof(seat));
+        seat_nums[i] = seat > INT32_MAX ? 0 : (int)seat;
+    }
+    enum parse_error err = check_seats(seat_nums, n, ev->store.num_seats);
+    if (err != PARSE_OK) {
+        bin_reply(c, req, BIN_INVALID, 0);
+        log_invalid(c, names[req->op], err);
+        return;
+    }
+    int status;
+    switch (req->op) {
+    case BIN_OP_BOOK: status = book_seats(c, ev, seat_nums, n, &first_bad); break;
+    case BIN_OP_CANCEL: status = cancel_seats(c, ev, seat_nums, n, &first_bad); break;
+    case BIN_OP_HOLD: status = hold_seats(c, ev, seat_nums, n, &first_bad); break;
+    case BIN_OP_CONFIRM: status = confirm_seats(c, ev, seat_nums, n, &first_bad); break;
+    default: status = release_seats(c, ev, seat_nums, n, &first_bad); break;
+    }
+    if (status < 0) bin_reply(c, req, BIN_NO_MEMORY, 0);
+    else bin_reply(c, req, seat_results[status], status == SEAT_OK ? 0 : first_bad);
+}
+
+/* MINE / CANCEL_ALL: the seats after the header, their count in seat */
+void bin_seat_list(struct conn* c, struct event* ev, const struct bin_request* req) {
+    int n;
+    struct seat_ref* refs = NULL;
+    if (req->op == BIN_OP_MINE) refs = session_seats(c->session, ev->id, &n);
+    else n = cancel_all(c, ev->id, &refs);
+    if (n < 0) {
+        bin_reply(c, req, BIN_NO_MEMORY, 0);
+        return;
+    }
+    size_t size = sizeof(struct bin_response) + n * sizeof(uint32_t);
+    char* p = conn_reserve(c, size);
+    if (p) {
+        struct bin_response resp = { size, req->op, BIN_OK, 0, req->tag, n };
+        memcpy(p, &resp, sizeof(resp));
+        for (int i = 0; i < n; i++) memcpy(p + sizeof(resp) + i * sizeof(uint32_t), &refs[i].seat, sizeof(uint32_t));
+        c->out_len += size;
+    }
+    free(refs);
+}
+
+/* BOOK_BEST: the seats booked after the header, their count in seat */
+void bin_book_best(struct conn* c, struct event* ev, const struct bin_request* req, const char* payload) {
+    uint32_t args[2];
+    int seat_nums[MAX_REQUEST_SEATS];
+    if (req->count == 2) memcpy(args, payload, sizeof(args));
+    if (req->count != 2 || args[0] < 1 || args[0] > MAX_REQUEST_SEATS || args[1] > (uint32_t)ev->venue.num_sections) {
+        bin_reply(c, req, BIN_INVALID, 0);
+        log_invalid(c, "BOOK BEST", PARSE_BAD_COUNT);
+        return;
+    }
+    int n = args[0];
+    if (book_best(c, ev, (int)args[1] - 1, n, seat_nums) != SEAT_OK) {
+        bin_reply(c, req, BIN_TAKEN, 0);
+        return;
+    }
+    size_t size = sizeof(struct bin_response) + n * sizeof(uint32_t);
+    char* p = conn_reserve(c, size);
+    if (!p) return;
+    struct bin_response resp = { size, req->op, BIN_OK, 0, req->tag, n };
+    memcpy(p, &resp, sizeof(resp));
+    for (int i = 0; i < n; i++) memcpy(p + sizeof(resp) + i * sizeof(uint32_t), &seat_nums[i], sizeof(uint32_t));
+    c->out_len += size;
+}
+
+/* LOGIN answers with the token after the header; RESUME carries one in place of seats */
+void bin_session(struct conn* c, const struct bin_request* req, const char* payload) {
+    if (req->op == BIN_OP_RESUME) {
+        bin_reply(c, req, resume_session(c, payload, req->count * sizeof(uint32_t)) < 0 ? BIN_BAD_SESSION : BIN_OK, 0);
+        return;
+    }
+    char* p = conn_reserve(c, sizeof(struct bin_response) + SESSION_TOKEN_LEN);
+    if (!p) return;
+    struct bin_response resp = { sizeof(resp) + SESSION_TOKEN_LEN, req->op, BIN_OK, 0, req->tag, 0 };
+    memcpy(p, &resp, sizeof(resp));
+    session_token(c->session, p + sizeof(resp));
+    c->out_len += resp.size;
+    log_request("LOGIN", &c->addr, "SUCCESS");
+}
+
+/* Run every complete frame in the input buffer; returns 1 if the stream is unusable */
+int conn_process_binary(struct conn* c) {
+    static const enum command_type commands[] = {
+        [BIN_OP_AVAILABLE] = CMD_AVAILABLE, [BIN_OP_BOOK] = CMD_BOOK, [BIN_OP_CANCEL] = CMD_CANCEL,
+        [BIN_OP_LOGIN] = CMD_LOGIN, [BIN_OP_RESUME] = CMD_RESUME, [BIN_OP_MINE] = CMD_MINE,
+        [BIN_OP_CANCEL_ALL] = CMD_CANCEL, [BIN_OP_HOLD] = CMD_HOLD, [BIN_OP_CONFIRM] = CMD_CONFIRM,
+        [BIN_OP_RELEASE] = CMD_RELEASE, [BIN_OP_BOOK_BEST] = CMD_BOOK
+    };
+    size_t start = 0;
+    int result = 0;
+    struct bin_request req;
+    command_start = metrics_now();
+    while (c->out_len - c->out_sent < OUT_HIGH_WATER && c->in_len - start >= sizeof(req)) {
+        memcpy(&req, c->in + start, sizeof(req));
+        if (req.size != sizeof(req) + req.count * sizeof(uint32_t)) {
+            /* Frame boundaries are lost, nothing after this can be trusted */
+            bin_reply(c, &req, BIN_INVALID, 0);
+            log_request("UNKNOWN", &c->addr, "FAIL: bad binary frame");
+            result = 1;
+            break;
+        }
+        if (c->in_len - start < req.size) break;
+        
+        TRACE_SCOPE("binary frame");
+        outcome = BIN_OK;
+        struct event* ev = req.event == 0 ? &events[0] : req.event <= (uint32_t)num_events ? &events[req.event - 1] : NULL;
+        if (req.op == BIN_OP_LOGIN || req.op == BIN_OP_RESUME) bin_session(c, &req, c->in + start + sizeof(req));
+        else if (!ev) bin_reply(c, &req, BIN_UNKNOWN_EVENT, 0);
+        else if (req.op == BIN_OP_AVAILABLE) bin_available(c, ev, &req);
+        else if (req.op != BIN_OP_MINE && repl_read_only()) bin_reply(c, &req, BIN_READ_ONLY, 0);
+        else if (req.op == BIN_OP_BOOK || req.op == BIN_OP_CANCEL || (req.op >= BIN_OP_HOLD && req.op <= BIN_OP_RELEASE))
+            bin_seat_op(c, ev, &req, c->in + start + sizeof(req));
+        else if (req.op == BIN_OP_MINE || req.op == BIN_OP_CANCEL_ALL) bin_seat_list(c, ev, &req);
+        else if (req.op == BIN_OP_BOOK_BEST) bin_book_best(c, ev, &req, c->in + start + sizeof(req));
+        else bin_reply(c, &req, BIN_UNKNOWN_OP, 0);
+        command_done(req.op < sizeof(commands) / sizeof(commands[0]) && commands[req.op] ? commands[req.op] : CMD_UNKNOWN);
+        start += req.size;
+    }
+    memmove(c->in, c->in + start, c->in_len - start);
+    c->in_len -= start;
+    return result;
+}
+
+/* Frame input with the protocol chosen by the first byte; returns 1 when the connection should close */
+int conn_process_input(struct conn* c) {
+    if (c->in_len == 0) return 0; /* the buffer is only allocated on the first read */
+    if (c->proto == PROTO_UNKNOWN) {
+        c->proto = (unsigned char)c->in[0] == BIN_MAGIC ? PROTO_BINARY : PROTO_TEXT;
+        if (c->proto == PROTO_BINARY) memmove(c->in, c->in + 1, --c->in_len);
+    }
+    return c->proto == PROTO_BINARY ? conn_process_binary(c) : conn_process_text(c);
+}
+
+/* A complete request is waiting (processing stopped at the output high-water mark) */
+int conn_has_request(struct conn* c) {
+    struct bin_request req;
+    if (c->proto != PROTO_BINARY) return c->in_len > 0 && memchr(c->in, '\n', c->in_len) != NULL;
+    if (c->in_len < sizeof(req)) return 0;
+    memcpy(&req, c->in, sizeof(req));
+    return c->in_len >= req.size;
+}
+
+/* One recv into the input buffer, grown so that a single read can pick up many
+ * pipelined commands; returns bytes read, 0 at EOF (sets eof), -1 on error */
+ssize_t conn_read(struct conn* c) {
+    TRACE_SCOPE("recv");
+    if (c->in_cap - c->in_len < BUFFER_SIZE && c->in_cap < IN_BUFFER_MAX) {
+        size_t cap = c->in_cap ? c->in_cap * 2 : BUFFER_SIZE * 4;
+        char* in = realloc(c->in, cap);
+        if (!in) return -1;
+        c->in = in;
+        c->in_cap = cap;
+    }
+    ssize_t n = recv(c->fd, c->in + c->in_len, c->in_cap - c->in_len, 0);
+    metrics_syscalls(1);
+    if (n > 0) {
+        c->in_len += n;
+        metrics_bytes(n, 0);
+    } else if (n == 0) {
+        c->eof = 1;
+    }
+    return n;
 }
 
 void* handle_client(void* arg) {
-    int client_fd = *(int*)arg;
-    free(arg);
+    struct conn* c = arg;
+    log_request("CONNECT", &c->addr, "Connected");
     
-    struct sockaddr_in client_addr;
-    socklen_t addr_len = sizeof(client_addr);
-    getpeername(client_fd, (struct sockaddr*)&client_addr, &addr_len);
+    /* Every command of one recv is answered with a single send */
+    for (;;) {
+        int result = conn_process_input(c);
+        if (c->wait_lsn) {
+            TRACE_SCOPE("journal wait");
+            journal_wait(journal, c->wait_lsn);
+        }
+        if (conn_flush(c) < 0) {
+            log_request("ERROR", &c->addr, "Send failed");
+            break;
+        }
+        if (result == 1) break;
+        if (conn_has_request(c)) continue;
+        if (c->eof) {
+            log_request("DISCONNECT", &c->addr, "Disconnected");
+            break;
+        }
+        if (conn_read(c) < 0 && errno != EINTR) {
+            log_request("DISCONNECT", &c->addr, "Connection error");
+            break;
+        }
+    }
+    conn_free(c);
+    return NULL;
+}
+
+/* The client is done: send what is left, unless it is held for the journal (then
+ * the loop's waiter list retries); returns -1 once the connection can be closed */
+int conn_finish(struct conn* c) {
+    c->closing = 1;
+    if (conn_held(c)) return 0;
+    conn_flush(c);
+    return -1;
+}
+
+/* Drive a non-blocking connection until EAGAIN; returns -1 when it should be closed */
+int conn_service(struct conn* c) {
+    if (c->closing) return conn_finish(c);
+    for (;;) {
+        if (conn_flush(c) < 0) return -1;
+        if (conn_process_input(c) == 1) return conn_finish(c);
+        if (c->out_len - c->out_sent >= OUT_HIGH_WATER) {
+            /* Stop reading until the client drains its responses (EPOLLOUT resumes us) */
+            return conn_flush(c) < 0 ? -1 : 0;
+        }
+        if (c->eof) {
+            log_request("DISCONNECT", &c->addr, "Disconnected");
+            return conn_finish(c);
+        }
+        if (conn_read(c) >= 0 || errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return conn_flush(c) < 0 ? -1 : 0;
+        } else {
+            log_request("DISCONNECT", &c->addr, "Connection error");
+            return -1;
+        }
+    }
+}
+
+void loop_add_waiter(struct event_loop* loop, struct conn* c) {
+    if (c->waiting) return;
+    c->waiting = 1;
+    c->wait_prev = NULL;
+    c->wait_next = loop->waiters;
+    if (loop->waiters) loop->waiters->wait_prev = c;
+    loop->waiters = c;
+}
+
+void loop_remove_waiter(struct event_loop* loop, struct conn* c) {
+    if (!c->waiting) return;
+    c->waiting = 0;
+    if (c->wait_prev) c->wait_prev->wait_next = c->wait_next;
+    else loop->waiters = c->wait_next;
+    if (c->wait_next) c->wait_next->wait_prev = c->wait_prev;
+}
+
+/* Service a connection; held output parks it on the waiter list instead of EPOLLOUT */
+void loop_service(struct event_loop* loop, struct conn* c) {
+    if (conn_service(c) < 0) {
+        loop_remove_waiter(loop, c);
+        conn_free(c); /* close() also removes it from the epoll set */
+    } else if (conn_held(c)) {
+        loop_add_waiter(loop, c);
+    }
+}
+
+/* The journal synced: resume every waiter whose records are now durable */
+void loop_wake_waiters(struct event_loop* loop) {
+    uint64_t count;
+    read(loop->efd, &count, sizeof(count));
+    struct conn* c = loop->waiters;
+    while (c) {
+        struct conn* next = c->wait_next;
+        if (!conn_held(c)) {
+            loop_remove_waiter(loop, c);
+            loop_service(loop, c);
+        }
+        c = next;
+    }
+}
+
+/* Reuseport: take every pending connection off this loop's listener and keep it here */
+void loop_accept(struct event_loop* loop) {
+    while (1) {
+        struct sockaddr_in client_addr;
+        socklen_t addr_len = sizeof(client_addr);
+        int client_fd = accept4(loop->listen_fd, (struct sockaddr*)&client_addr, &addr_len,
+                                SOCK_NONBLOCK | SOCK_CLOEXEC);
+        metrics_syscalls(1);
+        if (client_fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno == EMFILE || errno == ENFILE) usleep(10000); /* the listener stays ready; retry next turn */
+            return;
+        }
+        
+        struct conn* c = conn_admit(client_fd, &client_addr);
+        if (!c) continue;
+        log_request("CONNECT", &c->addr, "Connected");
+        
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.ptr = c };
+        if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, client_fd, &ev) < 0) conn_free(c);
+    }
+}
+
+void* event_loop_run(void* arg) {
+    struct event_loop* loop = arg;
+    struct epoll_event ready[EPOLL_BATCH];
     
-    char buffer[BUFFER_SIZE];
-    log_request("CONNECT", &client_addr, "Connected");
+    while (1) {
+        int n = epoll_wait(loop->epfd, ready, EPOLL_BATCH, -1);
+        metrics_syscalls(1);
+        for (int i = 0; i < n; i++) {
+            if (ready[i].data.ptr == loop) loop_wake_waiters(loop);
+            else if (ready[i].data.ptr == &loop->listen_fd) loop_accept(loop);
+            else loop_service(loop, ready[i].data.ptr);
+        }
+    }
+    return NULL;
+}
+
+/* Allow enough descriptors for tens of thousands of idle connections; returns
+ * how many connections that leaves room for (the default -C of the event-loop modes) */
+int raise_fd_limit(void) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) < 0) return MAX_CONNECTIONS;
+    if (rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+        getrlimit(RLIMIT_NOFILE, &rl);
+    }
+    /* Unlimited still needs a bound: the pool sizes its ready queue by it */
+    rlim_t limit = rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur > (1 << 20) ? (1 << 20) : rl.rlim_cur;
+    return limit > 2 * FD_RESERVE ? (int)(limit - FD_RESERVE) : (int)limit / 2 + 1;
+}
+
+void run_thread_mode(int server_fd) {
+    while (1) {
+        struct sockaddr_in client_addr;
+        socklen_t addr_len = sizeof(client_addr);
+        int client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &addr_len);
+        metrics_syscalls(1);
+        
+        if (client_fd < 0) continue;
+        
+        struct conn* c = conn_admit(client_fd, &client_addr);
+        if (!c) continue;
+        
+        pthread_t thread_id;
+        if (pthread_create(&thread_id, NULL, handle_client, c) == 0) {
+            pthread_detach(thread_id);
+        } else {
+            conn_free(c);
+        }
+    }
+}
+
+/* Set up loop's epoll set and journal wakeup; a listener, if any, is polled along with its clients */
+int event_loop_init(struct event_loop* loop, int listen_fd) {
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    loop->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    loop->listen_fd = listen_fd;
+    struct epoll_event wake = { .events = EPOLLIN, .data.ptr = loop };
+    struct epoll_event accept = { .events = EPOLLIN, .data.ptr = &loop->listen_fd };
+    if (loop->epfd < 0 || loop->efd < 0 || epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->efd, &wake) < 0 ||
+        (listen_fd >= 0 && epoll_ctl(loop->epfd, EPOLL_CTL_ADD, listen_fd, &accept) < 0) ||
+        (journal && journal_add_waker(journal, loop->efd) < 0)) return -1;
+    return 0;
+}
+
+void run_epoll_mode(int server_fd, int num_loops) {
+    struct event_loop* loops = calloc(num_loops, sizeof(*loops));
+    for (int i = 0; i < num_loops; i++) {
+        if (event_loop_init(&loops[i], -1) < 0 ||
+            pthread_create(&loops[i].thread, NULL, event_loop_run, &loops[i]) != 0) {
+            perror("Event loop setup failed");
+            exit(EXIT_FAILURE);
+        }
+    }
     
-    while (recv(client_fd, buffer, BUFFER_SIZE - 1, 0) > 0) {
-        buffer[BUFFER_SIZE - 1] = '\0';
-        char* line = strtok(buffer, "\n");
-        while (line) {
-            int result = process_command(client_fd, line, &client_addr);
-            if (result == 1) {
-                close(client_fd);
-                pthread_exit(NULL);
-            } else if (result == -1) {
-                log_request("ERROR", &client_addr, "Send failed");
-                close(client_fd);
-                pthread_exit(NULL);
+    /* Single acceptor hands connections out to the loops round-robin */
+    for (unsigned next = 0;; next++) {
+        struct sockaddr_in client_addr;
+        socklen_t addr_len = sizeof(client_addr);
+        int client_fd = accept4(server_fd, (struct sockaddr*)&client_addr, &addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        metrics_syscalls(1);
+        if (client_fd < 0) {
+            if (errno == EMFILE || errno == ENFILE) usleep(10000);
+            continue;
+        }
+        
+        struct conn* c = conn_admit(client_fd, &client_addr);
+        if (!c) continue;
+        log_request("CONNECT", &c->addr, "Connected");
+        
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.ptr = c };
+        if (epoll_ctl(loops[next % num_loops].epfd, EPOLL_CTL_ADD, client_fd, &ev) < 0) conn_free(c);
+    }
+}
+
+/* Reuseport mode: the n-th loop's thread only runs on the n-th core we may use */
+static int nth_cpu(int n) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0 || CPU_COUNT(&allowed) == 0) return -1;
+    n %= CPU_COUNT(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && n-- == 0) return cpu;
+    }
+    return -1;
+}
+
+static void* reuseport_loop_run(void* arg) {
+    struct event_loop* loop = arg;
+    if (loop->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(loop->cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    return event_loop_run(loop);
+}
+
+int open_listener(int port, int backlog, int reuseport);
+
+/* One listener per loop in an SO_REUSEPORT group, so the kernel spreads new connections
+ * over the loops and no thread hands them out. server_fd, already in the group, is loop 0's;
+ * the calling thread runs loop 0. */
+void run_reuseport_mode(int server_fd, int port, int num_loops) {
+    struct event_loop* loops = calloc(num_loops, sizeof(*loops));
+    for (int i = 0; i < num_loops; i++) {
+        int listen_fd = i == 0 ? server_fd : open_listener(port, SOMAXCONN, 1);
+        if (listen_fd < 0 || fcntl(listen_fd, F_SETFL, O_NONBLOCK) < 0) {
+            perror("Listener setup failed");
+            exit(EXIT_FAILURE);
+        }
+        /* Prefer the listener whose loop runs on the core that took the SYN */
+        loops[i].cpu = nth_cpu(i);
+        if (loops[i].cpu >= 0) setsockopt(listen_fd, SOL_SOCKET, SO_INCOMING_CPU, &loops[i].cpu, sizeof(int));
+        if (event_loop_init(&loops[i], listen_fd) < 0 ||
+            (i > 0 && pthread_create(&loops[i].thread, NULL, reuseport_loop_run, &loops[i]) != 0)) {
+            perror("Event loop setup failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    reuseport_loop_run(&loops[0]);
+}
+
+/* Hand c back to the poller: wait for input, or only for room to send once output is at the high-water mark */
+int pool_arm(struct conn* c, int op) {
+    struct epoll_event ev = { .events = EPOLLRDHUP | EPOLLONESHOT, .data.ptr = c };
+    if (c->out_len - c->out_sent < OUT_HIGH_WATER) ev.events |= EPOLLIN;
+    if (c->out_len > c->out_sent) ev.events |= EPOLLOUT;
+    metrics_syscalls(1);
+    return epoll_ctl(pool.epfd, op, c->fd, &ev);
+}
+
+/* A worker owns a connection from its dequeue until it re-arms it, so no two touch it at once.
+ * Output held for the journal is waited for here, as in thread mode. */
+void* pool_worker_run(void* arg) {
+    (void)arg;
+    for (;;) {
+        while (sem_wait(&pool.queued) < 0) continue;
+        struct conn* c;
+        while (!(c = queue_pop(&pool.ready))) sched_yield(); /* posted, but the push is still landing */
+        for (;;) {
+            if (conn_service(c) < 0) {
+                conn_free(c);
+                break;
+            }
+            if (!conn_held(c)) {
+                if (pool_arm(c, EPOLL_CTL_MOD) < 0) conn_free(c);
+                break;
             }
-            line = strtok(NULL, "\n");
+            TRACE_SCOPE("journal wait");
+            journal_wait(journal, c->wait_lsn);
+        }
+    }
+    return NULL;
+}
+
+void pool_accept(int server_fd) {
+    for (;;) {
+        struct sockaddr_in client_addr;
+        socklen_t addr_len = sizeof(client_addr);
+        int client_fd = accept4(server_fd, (struct sockaddr*)&client_addr, &addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        metrics_syscalls(1);
+        if (client_fd < 0) {
+            if (errno == EMFILE || errno == ENFILE) usleep(10000);
+            if (errno == EINTR) continue;
+            return;
+        }
+        struct conn* c = conn_admit(client_fd, &client_addr);
+        if (!c) continue;
+        log_request("CONNECT", &c->addr, "Connected");
+        if (pool_arm(c, EPOLL_CTL_ADD) < 0) conn_free(c);
+    }
+}
+
+/* The calling thread polls: it accepts, and queues every connection that becomes ready */
+void run_pool_mode(int server_fd, int num_workers) {
+    struct epoll_event listen_ev = { .events = EPOLLIN, .data.ptr = NULL };
+    pool.epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (pool.epfd < 0 || queue_init(&pool.ready, max_conns) < 0 || sem_init(&pool.queued, 0, 0) < 0 ||
+        fcntl(server_fd, F_SETFL, O_NONBLOCK) < 0 || epoll_ctl(pool.epfd, EPOLL_CTL_ADD, server_fd, &listen_ev) < 0) {
+        perror("Worker pool setup failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < num_workers; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, pool_worker_run, NULL) != 0) {
+            perror("Worker pool setup failed");
+            exit(EXIT_FAILURE);
         }
+        pthread_detach(thread);
     }
     
-    log_request("DISCONNECT", &client_addr, "Disconnected");
-    close(client_fd);
-    pthread_exit(NULL);
+    struct epoll_event ready[EPOLL_BATCH];
+    while (1) {
+        int n = epoll_wait(pool.epfd, ready, EPOLL_BATCH, -1);
+        metrics_syscalls(1);
+        for (int i = 0; i < n; i++) {
+            struct conn* c = ready[i].data.ptr;
+            if (!c) {
+                pool_accept(server_fd);
+                continue;
+            }
+            /* EPOLLONESHOT queues a connection at most once, and at most max_conns are open */
+            if (queue_push(&pool.ready, c) < 0) {
+                conn_free(c);
+                continue;
+            }
+            sem_post(&pool.queued);
+            size_t depth = queue_depth(&pool.ready);
+            if (depth > atomic_load_explicit(&pool.depth_max, memory_order_relaxed))
+                atomic_store_explicit(&pool.depth_max, depth, memory_order_relaxed);
+        }
+    }
 }
 
-int main(void) {
-    signal(SIGINT, signal_handler);
-    signal(SIGTERM, signal_handler);
+/* io_uring mode: every ring thread keeps a multishot accept on the listening
+ * socket and a multishot recv per connection fed from its provided buffers,
+ * and sends replies with one SEND per batch of input. All of it, and the
+ * wait for completions, goes to the kernel in one io_uring_enter per turn. */
+
+/* The low bits of user_data say which operation completed; the rest is the conn, if any */
+enum uring_tag { URING_ACCEPT, URING_RECV, URING_SEND, URING_CANCEL, URING_WAKE };
+#define URING_TAG_MASK 7
+
+struct uring_loop {
+    struct event_loop base;  /* waiters and the journal's eventfd */
+    struct uring ring;
+    struct uring_bufs bufs;
+    int server_fd;
+    uint64_t wake_count;     /* target of the eventfd read */
+};
+
+/* An SQE, submitting what is queued first if the ring is full */
+static struct io_uring_sqe* uring_loop_sqe(struct uring_loop* loop) {
+    struct io_uring_sqe* sqe;
+    while (!(sqe = uring_sqe(&loop->ring))) {
+        uring_submit(&loop->ring, 0);
+        metrics_syscalls(1);
+    }
+    return sqe;
+}
+
+static void uring_prep(struct io_uring_sqe* sqe, int op, int fd, struct conn* c, enum uring_tag tag) {
+    sqe->opcode = op;
+    sqe->fd = fd;
+    sqe->user_data = (uintptr_t)c | tag;
+}
+
+static void uring_arm_accept(struct uring_loop* loop) {
+    struct io_uring_sqe* sqe = uring_loop_sqe(loop);
+    uring_prep(sqe, IORING_OP_ACCEPT, loop->server_fd, NULL, URING_ACCEPT);
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+}
+
+static void uring_arm_wake(struct uring_loop* loop) {
+    struct io_uring_sqe* sqe = uring_loop_sqe(loop);
+    uring_prep(sqe, IORING_OP_READ, loop->base.efd, NULL, URING_WAKE);
+    sqe->addr = (uintptr_t)&loop->wake_count;
+    sqe->len = sizeof(loop->wake_count);
+}
+
+static void uring_arm_recv(struct uring_loop* loop, struct conn* c) {
+    struct io_uring_sqe* sqe = uring_loop_sqe(loop);
+    uring_prep(sqe, IORING_OP_RECV, c->fd, c, URING_RECV);
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = loop->bufs.bgid;
+    c->recv_armed = 1;
+}
+
+static void uring_cancel_recv(struct uring_loop* loop, struct conn* c) {
+    struct io_uring_sqe* sqe = uring_loop_sqe(loop);
+    uring_prep(sqe, IORING_OP_ASYNC_CANCEL, -1, NULL, URING_CANCEL);
+    sqe->addr = (uintptr_t)c | URING_RECV;
+}
+
+static void uring_send(struct uring_loop* loop, struct conn* c) {
+    struct io_uring_sqe* sqe = uring_loop_sqe(loop);
+    uring_prep(sqe, IORING_OP_SEND, c->fd, c, URING_SEND);
+    sqe->addr = (uintptr_t)(c->out + c->out_sent);
+    sqe->len = c->out_len - c->out_sent;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    c->send_busy = 1;
+}
+
+/* Free c once none of its operations can still complete */
+static void uring_close(struct uring_loop* loop, struct conn* c) {
+    if (!c->dead) {
+        c->dead = 1;
+        if (c->recv_armed) uring_cancel_recv(loop, c);
+    }
+    if (c->recv_armed || c->send_busy) return;
+    loop_remove_waiter(&loop->base, c);
+    conn_free(c);
+}
+
+/* Frame the input received so far and send the replies; the counterpart of conn_service.
+ * Input that arrives while a send is in flight waits for it, so out never moves under the kernel. */
+static void uring_service(struct uring_loop* loop, struct conn* c) {
+    if (c->send_busy || c->waiting) return;
+    if (c->dead) {
+        uring_close(loop, c);
+        return;
+    }
+    if (!c->closing) {
+        if (conn_process_input(c) == 1) {
+            c->closing = 1;
+        } else if (c->eof && c->out_len - c->out_sent < OUT_HIGH_WATER) {
+            log_request("DISCONNECT", &c->addr, "Disconnected");
+            c->closing = 1;
+        }
+    }
+    if (conn_held(c)) {
+        loop_add_waiter(&loop->base, c);
+    } else if (c->out_sent < c->out_len) {
+        uring_send(loop, c);
+    } else if (c->closing) {
+        uring_close(loop, c);
+    } else if (c->recv_paused && c->in_len < IN_BUFFER_MAX) {
+        c->recv_paused = 0;
+        if (!c->recv_armed) uring_arm_recv(loop, c);
+    }
+}
+
+static void uring_on_accept(struct uring_loop* loop, const struct io_uring_cqe* cqe) {
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        if (cqe->res == -EMFILE || cqe->res == -ENFILE) usleep(10000);
+        uring_arm_accept(loop);
+    }
+    if (cqe->res < 0) return;
+    struct sockaddr_in client_addr = {0};
+    socklen_t addr_len = sizeof(client_addr);
+    getpeername(cqe->res, (struct sockaddr*)&client_addr, &addr_len);
+    metrics_syscalls(1);
+    struct conn* c = conn_admit(cqe->res, &client_addr);
+    if (!c) return;
+    log_request("CONNECT", &c->addr, "Connected");
+    uring_arm_recv(loop, c);
+}
+
+static void uring_on_recv(struct uring_loop* loop, struct conn* c, const struct io_uring_cqe* cqe) {
+    TRACE_SCOPE("recv");
+    if (!(cqe->flags & IORING_CQE_F_MORE)) c->recv_armed = 0;
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        size_t n = cqe->res > 0 ? (size_t)cqe->res : 0;
+        if (n && !c->dead && c->in_cap - c->in_len < n) {
+            size_t cap = c->in_cap ? c->in_cap : BUFFER_SIZE * 4;
+            while (cap - c->in_len < n) cap *= 2;
+            char* in = realloc(c->in, cap);
+            if (in) {
+                c->in = in;
+                c->in_cap = cap;
+            } else {
+                c->dead = 1;
+            }
+        }
+        if (n && !c->dead) {
+            memcpy(c->in + c->in_len, uring_buf(&loop->bufs, bid), n);
+            c->in_len += n;
+            metrics_bytes(n, 0);
+        }
+        uring_buf_recycle(&loop->bufs, bid);
+    }
+    if (cqe->res == 0) {
+        c->eof = 1;
+    } else if (cqe->res < 0 && cqe->res != -ENOBUFS && cqe->res != -ECANCELED && !c->dead) {
+        log_request("DISCONNECT", &c->addr, "Connection error");
+        c->dead = 1;
+    }
+    /* A backlog beyond one recv's worth of pipelining pauses the client, as the epoll loops do */
+    if (c->in_len >= IN_BUFFER_MAX && c->recv_armed && !c->recv_paused) {
+        c->recv_paused = 1;
+        uring_cancel_recv(loop, c);
+    }
+    if (!c->recv_armed && !c->recv_paused && !c->eof && !c->dead) uring_arm_recv(loop, c);
+    uring_service(loop, c);
+}
+
+static void uring_on_send(struct uring_loop* loop, struct conn* c, const struct io_uring_cqe* cqe) {
+    c->send_busy = 0;
+    if (cqe->res < 0) {
+        if (!c->dead) log_request("ERROR", &c->addr, "Send failed");
+        c->dead = 1;
+    } else {
+        c->out_sent += cqe->res;
+        metrics_bytes(0, cqe->res);
+        if (c->out_sent == c->out_len) {
+            c->out_len = c->out_sent = 0;
+            if (c->out_cap > OUT_HIGH_WATER) {
+                free(c->out);
+                c->out = NULL;
+                c->out_cap = 0;
+            }
+        }
+    }
+    uring_service(loop, c);
+}
+
+/* The journal synced: the eventfd read completed, so re-arm it and resume the waiters now durable */
+static void uring_on_wake(struct uring_loop* loop) {
+    uring_arm_wake(loop);
+    struct conn* c = loop->base.waiters;
+    while (c) {
+        struct conn* next = c->wait_next;
+        if (!conn_held(c)) {
+            loop_remove_waiter(&loop->base, c);
+            uring_service(loop, c);
+        }
+        c = next;
+    }
+}
+
+/* The ring is created here: with IORING_SETUP_SINGLE_ISSUER only this thread may submit to it */
+void* uring_loop_run(void* arg) {
+    struct uring_loop* loop = arg;
+    if (uring_init(&loop->ring, URING_ENTRIES, URING_CQ_ENTRIES) < 0 ||
+        uring_bufs_init(&loop->ring, &loop->bufs, 0, URING_BUFS, URING_BUF_SIZE) < 0) {
+        perror("io_uring setup failed (try -m epoll)");
+        exit(EXIT_FAILURE);
+    }
+    uring_arm_accept(loop);
+    uring_arm_wake(loop);
     
-    init_seats();
-    printf("Server initialized with %d seats. Press Ctrl+C to shutdown.\n\n", MAX_SEATS);
+    while (1) {
+        if (uring_submit(&loop->ring, 1) < 0) {
+            perror("io_uring_enter failed");
+            exit(EXIT_FAILURE);
+        }
+        metrics_syscalls(1);
+        struct io_uring_cqe* next;
+        while ((next = uring_peek(&loop->ring))) {
+            struct io_uring_cqe cqe = *next;
+            uring_seen(&loop->ring);
+            struct conn* c = (struct conn*)(uintptr_t)(cqe.user_data & ~(uint64_t)URING_TAG_MASK);
+            switch (cqe.user_data & URING_TAG_MASK) {
+            case URING_ACCEPT: uring_on_accept(loop, &cqe); break;
+            case URING_RECV: uring_on_recv(loop, c, &cqe); break;
+            case URING_SEND: uring_on_send(loop, c, &cqe); break;
+            case URING_WAKE: uring_on_wake(loop); break;
+            default: break;
+            }
+        }
+    }
+    return NULL;
+}
+
+/* The calling thread runs the first ring */
+void run_uring_mode(int server_fd, int num_loops) {
+    struct uring_loop* loops = calloc(num_loops, sizeof(*loops));
+    for (int i = 0; i < num_loops; i++) {
+        loops[i].server_fd = server_fd;
+        loops[i].base.efd = eventfd(0, EFD_CLOEXEC);
+        if (loops[i].base.efd < 0 || (journal && journal_add_waker(journal, loops[i].base.efd) < 0) ||
+            (i > 0 && pthread_create(&loops[i].base.thread, NULL, uring_loop_run, &loops[i]) != 0)) {
+            perror("Ring thread setup failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    uring_loop_run(&loops[0]);
+}
+
+/* Event i uses the i-th venue file; events past the last file reuse it (or the -n/-r venue) */
+int init_events(const char** venue_files, int num_files, int num_seats, int row_width, enum seat_store_kind kind) {
+    if (num_events < num_files) num_events = num_files;
+    if (num_events == 0) num_events = 1;
+    events = calloc(num_events, sizeof(*events));
+    if (!events) return -1;
     
-    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd < 0) {
+    for (int i = 0; i < num_events; i++) {
+        struct event* ev = &events[i];
+        ev->id = i + 1;
+        const char* file = num_files ? venue_files[i < num_files ? i : num_files - 1] : NULL;
+        if (file ? venue_load(&ev->venue, file) < 0 : venue_flat(&ev->venue, num_seats, row_width) < 0) {
+            fprintf(stderr, file ? "Error: Invalid venue file %s\n" : "Error: Invalid venue size\n", file);
+            return -1;
+        }
+        if (init_seats(&ev->store, ev->venue.num_seats, kind, SEATS_PER_STRIPE) < 0) {
+            fprintf(stderr, "Error: Cannot allocate %d seats for event %d\n", ev->venue.num_seats, ev->id);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Journal replay: re-apply a committed operation (hooks are not installed yet) */
+int replay_record(void* arg, const struct journal_record* rec) {
+    (void)arg;
+    if (rec->event < 1 || rec->event > (uint32_t)num_events || rec->num_seats < 1 || rec->num_seats > MAX_REQUEST_SEATS)
+        return -1;
+    struct seat_store* st = &events[rec->event - 1].store;
+    int seat_nums[MAX_REQUEST_SEATS], bad;
+    for (int i = 0; i < rec->num_seats; i++) {
+        if (rec->seats[i] < 1 || rec->seats[i] > (uint32_t)st->num_seats) return -1;
+        seat_nums[i] = rec->seats[i];
+    }
+    enum seat_status status = rec->op == SEAT_OP_BOOK ? seats_book(st, seat_nums, rec->num_seats, rec->owner, &bad)
+                                                      : seats_cancel(st, seat_nums, rec->num_seats, rec->owner, &bad);
+    return status == SEAT_OK ? 0 : -1;
+}
+
+/* Every committed BOOK/CANCEL: keep the owner's seat index, then journal it */
+void seat_committed(void* arg, enum seat_op op, const int* seat_nums, int n, int64_t owner) {
+    struct event* ev = arg;
+    if (op == SEAT_OP_BOOK) session_index_add(owner, ev->id, seat_nums, n);
+    else session_index_remove(owner, ev->id, seat_nums, n);
+    if (journal) journal_append(journal, op, ev->id, seat_nums, n, owner);
+    repl_append(op, ev->id, seat_nums, n, owner);
+}
+
+/* Index the owners of recovered seats, then maintain the index from the commit hook */
+int init_sessions(const char* key_dir) {
+    if (session_init(key_dir) < 0) {
+        perror("Session key setup failed");
+        return -1;
+    }
+    for (int e = 0; e < num_events; e++) {
+        struct seat_store* st = &events[e].store;
+        for (int i = 0; i < st->num_seats; i++) {
+            int64_t owner = atomic_load_explicit(&st->owners[i], memory_order_relaxed);
+            int seat = i + 1;
+            if (owner != NO_OWNER && session_index_add(owner, events[e].id, &seat, 1) < 0) {
+                fprintf(stderr, "Error: Cannot index the seats of event %d\n", events[e].id);
+                return -1;
+            }
+        }
+        st->commit_hook = seat_committed;
+        st->hook_arg = &events[e];
+    }
+    return 0;
+}
+
+/* Rebuild the seat stores from the latest snapshot and the journal after it */
+int init_journal(const char* dir, enum journal_mode mode, int snapshot_interval) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    long replayed, skipped;
+    uint64_t snapshot_lsn;
+    if (snapshot_load(dir, events, num_events, &snapshot_lsn) < 0) {
+        fprintf(stderr, "Error: Damaged snapshot in %s\n", dir);
+        return -1;
+    }
+    journal = journal_open(dir, mode, snapshot_lsn, replay_record, NULL, &replayed, &skipped);
+    if (!journal) {
+        perror("Journal open failed");
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    long total_seats = 0;
+    for (int i = 0; i < num_events; i++) total_seats += events[i].venue.num_seats;
+    printf("Recovered %ld seats from %s in %.1f ms: snapshot at LSN %llu + %ld journaled operations",
+           total_seats, dir, (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6,
+           (unsigned long long)snapshot_lsn, replayed);
+    if (skipped) printf(" (%ld did not apply to this venue and were skipped)", skipped);
+    printf(", %s commit\n", mode == JOURNAL_SYNC ? "per-operation" : "group");
+    if (snapshot_interval > 0 && snapshot_start(dir, journal, events, num_events, snapshot_interval) < 0) {
+        fprintf(stderr, "Error: Cannot start the snapshot thread\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* -M: answer every HTTP request on the metrics port with the Prometheus exposition, one at a time */
+void* metrics_http_run(void* arg) {
+    int fd = (int)(intptr_t)arg;
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    for (;;) {
+        int client = accept(fd, NULL, NULL);
+        if (client < 0) continue;
+        /* A scraper sends a short GET; read what has arrived and answer whatever the path */
+        struct timeval timeout = { 1, 0 };
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        char request[1024];
+        if (recv(client, request, sizeof(request), 0) <= 0) {
+            close(client);
+            continue;
+        }
+        char* body = NULL;
+        size_t len = 0;
+        FILE* f = open_memstream(&body, &len);
+        if (f) {
+            struct server_counters k;
+            server_counters(&k);
+            metrics_write_prometheus(f);
+            fprintf(f, "# HELP ticket_seat_lock_waits_total Seat stripe locks that were found taken.\n"
+                       "# TYPE ticket_seat_lock_waits_total counter\n"
+                       "ticket_seat_lock_waits_total %llu\n"
+                       "# HELP ticket_seat_lock_wait_seconds_total Time spent waiting for seat stripe locks.\n"
+                       "# TYPE ticket_seat_lock_wait_seconds_total counter\n"
+                       "ticket_seat_lock_wait_seconds_total %.9f\n"
+                       "# HELP ticket_seat_cas_retries_total Seat CAS attempts lost to another writer.\n"
+                       "# TYPE ticket_seat_cas_retries_total counter\n"
+                       "ticket_seat_cas_retries_total %llu\n"
+                       "# HELP ticket_connections_rejected_total Connections turned away with FAIL busy.\n"
+                       "# TYPE ticket_connections_rejected_total counter\n"
+                       "ticket_connections_rejected_total %llu\n"
+                       "# HELP ticket_pool_queue_depth Connections waiting for a pool worker.\n"
+                       "# TYPE ticket_pool_queue_depth gauge\n"
+                       "ticket_pool_queue_depth %llu\n"
+                       "# HELP ticket_pool_queue_depth_max Most connections ever waiting for a pool worker.\n"
+                       "# TYPE ticket_pool_queue_depth_max gauge\n"
+                       "ticket_pool_queue_depth_max %llu\n",
+                    k.waits, k.wait_ns / 1e9, k.retries, k.rejected, k.depth, k.depth_max);
+            struct repl_stats r;
+            repl_get_stats(&r);
+            if (r.primary)
+                fprintf(f, "# HELP ticket_replicas Replicas attached.\n"
+                           "# TYPE ticket_replicas gauge\n"
+                           "ticket_replicas %d\n"
+                           "# HELP ticket_replication_seq Last change appended to the replication log.\n"
+                           "# TYPE ticket_replication_seq counter\n"
+                           "ticket_replication_seq %llu\n"
+                           "# HELP ticket_replication_acked Last change applied by every attached replica.\n"
+                           "# TYPE ticket_replication_acked gauge\n"
+                           "ticket_replication_acked %llu\n",
+                        r.replicas, (unsigned long long)r.seq, (unsigned long long)r.acked);
+            if (r.replica)
+                fprintf(f, "# HELP ticket_replica_connected Whether the replica is attached to its primary.\n"
+                           "# TYPE ticket_replica_connected gauge\n"
+                           "ticket_replica_connected %d\n"
+                           "# HELP ticket_replica_applied Last change from the primary applied here.\n"
+                           "# TYPE ticket_replica_applied gauge\n"
+                           "ticket_replica_applied %llu\n",
+                        r.connected, (unsigned long long)r.applied);
+            fclose(f);
+            char header[128];
+            int n = snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                                     "Content-Length: %zu\r\n\r\n", len);
+            if (send(client, header, n, MSG_NOSIGNAL) == n) send(client, body, len, MSG_NOSIGNAL);
+            free(body);
+        }
+        close(client);
+    }
+    return NULL;
+}
+
+int start_metrics_http(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = INADDR_ANY, .sin_port = htons(port) };
+    pthread_t thread;
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0 ||
+        pthread_create(&thread, NULL, metrics_http_run, (void*)(intptr_t)fd) != 0) {
+        close(fd);
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
+
+/* A listening TCP socket on port; reuseport joins the port's SO_REUSEPORT group */
+int open_listener(int port, int backlog, int reuseport) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
         perror("Socket failed");
-        exit(EXIT_FAILURE);
+        return -1;
     }
-    server_fd_global = server_fd;
     
-    int opt = 1;
-    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+        perror("SO_REUSEPORT failed");
+        close(fd);
+        return -1;
+    }
     
     struct sockaddr_in server_addr = {0};
     server_addr.sin_family = AF_INET;
     server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(PORT);
+    server_addr.sin_port = htons(port);
     
-    if (bind(server_fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+    if (bind(fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
         perror("Bind failed");
-        exit(EXIT_FAILURE);
+        close(fd);
+        return -1;
     }
     
-    if (listen(server_fd, MAX_CLIENTS) < 0) {
+    if (listen(fd, backlog) < 0) {
         perror("Listen failed");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-p port] [-m thread|epoll|pool|uring|reuseport] [-t loops_or_workers] [-s lock|cas]\n"
+                    "       %*s [-n seats] [-r row_width] [-v venue_file]... [-E events] [-L flush_ms]\n"
+                    "       %*s [-j journal_dir] [-J group|sync] [-S snapshot_secs] [-R] [-H hold_secs]\n"
+                    "       %*s [-M metrics_port] [-C max_connections] [-P repl_port] [-F primary_host:repl_port]\n",
+            prog, (int)strlen(prog), "", (int)strlen(prog), "", (int)strlen(prog), "");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char* argv[]) {
+    enum { MODE_THREAD, MODE_EPOLL, MODE_POOL, MODE_URING, MODE_REUSEPORT } mode = MODE_THREAD;
+    int port = PORT, num_loops = 0, opt;
+    int flush_ms = LOG_FLUSH_MS;
+    int num_seats = DEFAULT_SEATS, row_width = DEFAULT_ROW_WIDTH, num_files = 0;
+    const char** venue_files = calloc(argc, sizeof(char*));
+    enum seat_store_kind store = SEAT_STORE_LOCK;
+    const char* journal_path = NULL;
+    enum journal_mode journal_mode = JOURNAL_GROUP;
+    int snapshot_interval = SNAPSHOT_INTERVAL;
+    int hold_seconds = HOLD_SECONDS;
+    int metrics_port = 0, repl_port = 0;
+    const char* primary_addr = NULL;
+    while ((opt = getopt(argc, argv, "p:m:t:s:n:r:v:E:L:j:J:S:RH:M:C:P:F:h")) != -1) {
+        switch (opt) {
+        case 'p': port = atoi(optarg); break;
+        case 'm':
+            if (strcmp(optarg, "epoll") == 0) mode = MODE_EPOLL;
+            else if (strcmp(optarg, "pool") == 0) mode = MODE_POOL;
+            else if (strcmp(optarg, "uring") == 0) mode = MODE_URING;
+            else if (strcmp(optarg, "reuseport") == 0) mode = MODE_REUSEPORT;
+            else if (strcmp(optarg, "thread") != 0) usage(argv[0]);
+            break;
+        case 't': num_loops = atoi(optarg); break;
+        case 's':
+            if (strcmp(optarg, "cas") == 0) store = SEAT_STORE_CAS;
+            else if (strcmp(optarg, "lock") != 0) usage(argv[0]);
+            break;
+        case 'n': num_seats = atoi(optarg); break;
+        case 'r': row_width = atoi(optarg); break;
+        case 'v': venue_files[num_files++] = optarg; break;
+        case 'E': num_events = atoi(optarg); break;
+        case 'L': flush_ms = atoi(optarg); break;
+        case 'j': journal_path = optarg; break;
+        case 'J':
+            if (strcmp(optarg, "sync") == 0) journal_mode = JOURNAL_SYNC;
+            else if (strcmp(optarg, "group") != 0) usage(argv[0]);
+            break;
+        case 'S': snapshot_interval = atoi(optarg); break;
+        case 'R': release_on_close = 1; break;
+        case 'H': hold_seconds = atoi(optarg); break;
+        case 'M': metrics_port = atoi(optarg); break;
+        case 'C': max_conns = atoi(optarg); break;
+        case 'P': repl_port = atoi(optarg); break;
+        case 'F': primary_addr = optarg; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (port <= 0 || port > 65535 || num_loops < 0 || num_events < 0 || num_events > MAX_SHOWS || flush_ms < 1 ||
+        hold_seconds < 1 || metrics_port < 0 || metrics_port > 65535 || repl_port < 0 || repl_port > 65535 ||
+        max_conns < 0) usage(argv[0]);
+    hold_ticks = hold_seconds * 1000ULL / TIMER_TICK_MS;
+    if (num_loops == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_loops = cpus > 0 ? cpus : 1;
+    }
+    
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+    signal(SIGPIPE, SIG_IGN);
+    if (trace_start() < 0) {
+        perror("Trace setup failed");
         exit(EXIT_FAILURE);
     }
     
-    printf("Server listening on port %d...\n", PORT);
+    if (init_events(venue_files, num_files, num_seats, row_width, store) < 0) exit(EXIT_FAILURE);
+    free(venue_files);
+    if (journal_path && init_journal(journal_path, journal_mode, snapshot_interval) < 0) exit(EXIT_FAILURE);
+    if (init_sessions(journal_path) < 0) exit(EXIT_FAILURE);
+    if (timer_start() < 0) {
+        fprintf(stderr, "Error: Cannot start the hold timer thread\n");
+        exit(EXIT_FAILURE);
+    }
+    metrics_init(command_names, sizeof(command_names) / sizeof(command_names[0]),
+                 result_names, sizeof(result_names) / sizeof(result_names[0]));
+    if (metrics_port && start_metrics_http(metrics_port) < 0) {
+        perror("Metrics port setup failed");
+        exit(EXIT_FAILURE);
+    }
+    /* After the hooks are installed, so changes applied from a primary reach the journal and our replicas */
+    if (repl_port && repl_serve(repl_port, events, num_events) < 0) {
+        perror("Replication port setup failed");
+        exit(EXIT_FAILURE);
+    }
+    if (primary_addr && repl_follow(primary_addr, events, num_events, replay_record, NULL) < 0) {
+        fprintf(stderr, "Error: Cannot follow %s (expected host:port)\n", primary_addr);
+        exit(EXIT_FAILURE);
+    }
+    if (repl_port) printf("Shipping changes to replicas on port %d\n", repl_port);
+    if (primary_addr) printf("Replica of %s: read-only until PROMOTE\n", primary_addr);
+    long total_seats = 0;
+    for (int i = 0; i < num_events; i++) total_seats += events[i].venue.num_seats;
+    printf("Server initialized with %d event%s, %ld seats (%s store). Press Ctrl+C to shutdown.\n\n",
+           num_events, num_events == 1 ? "" : "s", total_seats,
+           store == SEAT_STORE_CAS ? "lock-free" : "striped-lock");
     
-    while (1) {
-        struct sockaddr_in client_addr;
-        socklen_t addr_len = sizeof(client_addr);
-        int client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &addr_len);
-        
-        if (client_fd < 0) continue;
-        
-        int* client_fd_ptr = malloc(sizeof(int));
-        *client_fd_ptr = client_fd;
-        
-        pthread_t thread_id;
-        if (pthread_create(&thread_id, NULL, handle_client, client_fd_ptr) == 0) {
-            pthread_detach(thread_id);
-        } else {
-            close(client_fd);
-            free(client_fd_ptr);
-        }
+    int server_fd = open_listener(port, mode != MODE_THREAD ? SOMAXCONN : MAX_CLIENTS, mode == MODE_REUSEPORT);
+    if (server_fd < 0) exit(EXIT_FAILURE);
+    server_fd_global = server_fd;
+    
+    fflush(stdout);
+    if (logger_start(flush_ms, mode == MODE_THREAD ? LOG_RING_SMALL : LOG_RING_SIZE) < 0) {
+        perror("Logger start failed");
+        exit(EXIT_FAILURE);
+    }
+    
+    /* Event loops hold idle connections cheaply, so only the descriptor limit caps them */
+    if (mode != MODE_THREAD) {
+        int fd_conns = raise_fd_limit();
+        if (max_conns == 0) max_conns = fd_conns;
+    } else if (max_conns == 0) {
+        max_conns = MAX_CONNECTIONS;
+    }
+    if (mode == MODE_EPOLL) {
+        printf("Server listening on port %d (epoll, %d event loops)...\n", port, num_loops);
+        fflush(stdout);
+        run_epoll_mode(server_fd, num_loops);
+    } else if (mode == MODE_POOL) {
+        printf("Server listening on port %d (pool, %d workers, up to %d connections)...\n", port, num_loops, max_conns);
+        fflush(stdout);
+        run_pool_mode(server_fd, num_loops);
+    } else if (mode == MODE_URING) {
+        printf("Server listening on port %d (io_uring, %d rings)...\n", port, num_loops);
+        fflush(stdout);
+        run_uring_mode(server_fd, num_loops);
+    } else if (mode == MODE_REUSEPORT) {
+        printf("Server listening on port %d (reuseport, %d pinned event loops)...\n", port, num_loops);
+        fflush(stdout);
+        run_reuseport_mode(server_fd, port, num_loops);
+    } else {
+        printf("Server listening on port %d...\n", port);
+        fflush(stdout);
+        run_thread_mode(server_fd);
     }
     
     return 0;
@@ -0,0 +1,242 @@
+/*
+ * Client sessions, see session.h
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/random.h>
+#include "session.h"
+#include "seats.h"
+
+#define SESSION_BUCKETS 65536
+#define SESSION_LOCKS 64   /* bucket b is guarded by locks[b % SESSION_LOCKS] */
+
+static uint64_t key[2];
+static _Atomic uint64_t next_seq;
+static struct session* buckets[SESSION_BUCKETS];
+static pthread_mutex_t locks[SESSION_LOCKS];
+
+#define ROTL(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+#define SIPROUND do { \
+        v0 += v1; v1 = ROTL(v1, 13); v1 ^= v0; v0 = ROTL(v0, 32); \
+        v2 += v3; v3 = ROTL(v3, 16); v3 ^= v2; \
+        v0 += v3; v3 = ROTL(v3, 21); v3 ^= v0; \
+        v2 += v1; v1 = ROTL(v1, 17); v1 ^= v2; v2 = ROTL(v2, 32); \
+    } while (0)
+
+/* SipHash-2-4 of one 64-bit word */
+static uint64_t token_tag(uint64_t m) {
+    uint64_t v0 = key[0] ^ 0x736f6d6570736575ULL, v1 = key[1] ^ 0x646f72616e646f6dULL;
+    uint64_t v2 = key[0] ^ 0x6c7967656e657261ULL, v3 = key[1] ^ 0x7465646279746573ULL;
+    uint64_t last = 8ULL << 56;
+    v3 ^= m; SIPROUND; SIPROUND; v0 ^= m;
+    v3 ^= last; SIPROUND; SIPROUND; v0 ^= last;
+    v2 ^= 0xff; SIPROUND; SIPROUND; SIPROUND; SIPROUND;
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/* splitmix64: a bijection, so one run never repeats an id */
+static int64_t new_id(void) {
+    for (;;) {
+        uint64_t z = atomic_fetch_add_explicit(&next_seq, 0x9e3779b97f4a7c15ULL, memory_order_relaxed);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        z = (z ^ (z >> 31)) >> 1;
+        if (z) return (int64_t)z;
+    }
+}
+
+static int random_bytes(void* buf, size_t len) {
+    return getrandom(buf, len, 0) == (ssize_t)len ? 0 : -1;
+}
+
+int session_init(const char* key_dir) {
+    for (int i = 0; i < SESSION_LOCKS; i++) pthread_mutex_init(&locks[i], NULL);
+    uint64_t seed;
+    if (random_bytes(&seed, sizeof(seed)) < 0) return -1;
+    atomic_store(&next_seq, seed);
+    if (!key_dir) return random_bytes(key, sizeof(key));
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/session.key", key_dir);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        ssize_t n = read(fd, key, sizeof(key));
+        close(fd);
+        return n == sizeof(key) ? 0 : -1;
+    }
+    if (random_bytes(key, sizeof(key)) < 0) return -1;
+    fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0) return -1;
+    int rc = write(fd, key, sizeof(key)) == sizeof(key) && fdatasync(fd) == 0 ? 0 : -1;
+    close(fd);
+    return rc;
+}
+
+static pthread_mutex_t* lock_for(int64_t id) {
+    return &locks[(uint64_t)id % SESSION_BUCKETS % SESSION_LOCKS];
+}
+
+/* Entry for id, added if missing; the caller holds its lock */
+static struct session* lookup(int64_t id, int create) {
+    struct session** head = &buckets[(uint64_t)id % SESSION_BUCKETS];
+    struct session* s = *head;
+    while (s && s->id != id) s = s->next;
+    if (!s && create && (s = calloc(1, sizeof(*s)))) {
+        s->id = id;
+        s->next = *head;
+        *head = s;
+    }
+    return s;
+}
+
+/* Drop an entry nothing refers to any more; the caller holds its lock */
+static void maybe_drop(struct session* s) {
+    if (s->conns > 0 || s->num_seats > 0) return;
+    struct session** pp = &buckets[(uint64_t)s->id % SESSION_BUCKETS];
+    while (*pp != s) pp = &(*pp)->next;
+    *pp = s->next;
+    free(s->seats);
+    free(s);
+}
+
+static struct session* attach(int64_t id) {
+    pthread_mutex_lock(lock_for(id));
+    struct session* s = lookup(id, 1);
+    if (s) s->conns++;
+    pthread_mutex_unlock(lock_for(id));
+    return s;
+}
+
+struct session* session_new(void) {
+    return attach(new_id());
+}
+
+static int hex_word(const char* p, uint64_t* out) {
+    uint64_t v = 0;
+    for (int i = 0; i < 16; i++) {
+        char ch = p[i];
+        int d = ch >= '0' && ch <= '9' ? ch - '0' : (ch | 0x20) >= 'a' && (ch | 0x20) <= 'f' ? (ch | 0x20) - 'a' + 10 : -1;
+        if (d < 0) return -1;
+        v = v << 4 | d;
+    }
+    *out = v;
+    return 0;
+}
+
+struct session* session_resume(const char* token, size_t len) {
+    uint64_t id, tag;
+    if (len != SESSION_TOKEN_LEN || hex_word(token, &id) < 0 || hex_word(token + 16, &tag) < 0) return NULL;
+    if (id == 0 || id > INT64_MAX || token_tag(id) != tag) return NULL;
+    return attach((int64_t)id);
+}
+
+void session_release(struct session* s) {
+    pthread_mutex_t* lock = lock_for(s->id);
+    pthread_mutex_lock(lock);
+    s->conns--;
+    maybe_drop(s);
+    pthread_mutex_unlock(lock);
+}
+
+void session_token(const struct session* s, char* token) {
+    char buf[SESSION_TOKEN_LEN + 1];
+    snprintf(buf, sizeof(buf), "%016llx%016llx", (unsigned long long)s->id,
+             (unsigned long long)token_tag((uint64_t)s->id));
+    memcpy(token, buf, SESSION_TOKEN_LEN);
+}
+
+int session_conns(struct session* s) {
+    pthread_mutex_lock(lock_for(s->id));
+    int conns = s->conns;
+    pthread_mutex_unlock(lock_for(s->id));
+    return conns;
+}
+
+int session_index_add(int64_t owner, int event, const int* seat_nums, int n) {
+    int rc = -1;
+    pthread_mutex_lock(lock_for(owner));
+    struct session* s = lookup(owner, 1);
+    if (s && s->num_seats + n > s->seats_cap) {
+        int cap = s->seats_cap ? s->seats_cap : 8;
+        while (cap < s->num_seats + n) cap *= 2;
+        struct seat_ref* grown = realloc(s->seats, cap * sizeof(*grown));
+        if (grown) {
+            s->seats = grown;
+            s->seats_cap = cap;
+        }
+    }
+    if (s && s->num_seats + n <= s->seats_cap) {
+        for (int i = 0; i < n; i++) s->seats[s->num_seats++] = (struct seat_ref){ event, seat_nums[i] };
+        rc = 0;
+    }
+    if (s) maybe_drop(s);
+    pthread_mutex_unlock(lock_for(owner));
+    return rc;
+}
+
+static int int_cmp(const void* a, const void* b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+void session_index_remove(int64_t owner, int event, const int* seat_nums, int n) {
+    /* Several seats (CANCEL ALL cancels up to MAX_REQUEST_SEATS at a time): sort
+     * them once and compact the list in one pass instead of a scan per seat */
+    int local[MAX_REQUEST_SEATS], *sorted = n <= MAX_REQUEST_SEATS ? local : malloc(n * sizeof(int));
+    if (n > 1 && sorted) {
+        memcpy(sorted, seat_nums, n * sizeof(int));
+        qsort(sorted, n, sizeof(int), int_cmp);
+    }
+    pthread_mutex_lock(lock_for(owner));
+    struct session* s = lookup(owner, 0);
+    if (s && n > 1 && sorted) {
+        int kept = 0;
+        for (int k = 0; k < s->num_seats; k++) {
+            int seat = (int)s->seats[k].seat;
+            if (s->seats[k].event != (uint32_t)event || !bsearch(&seat, sorted, n, sizeof(int), int_cmp))
+                s->seats[kept++] = s->seats[k];
+        }
+        s->num_seats = kept;
+    }
+    for (int i = 0; s && (n == 1 || !sorted) && i < n; i++) {
+        /* Recent bookings are the likeliest to go, so search from the end */
+        for (int k = s->num_seats - 1; k >= 0; k--) {
+            if (s->seats[k].event == (uint32_t)event && s->seats[k].seat == (uint32_t)seat_nums[i]) {
+                s->seats[k] = s->seats[--s->num_seats];
+                break;
+            }
+        }
+    }
+    if (s) maybe_drop(s);
+    pthread_mutex_unlock(lock_for(owner));
+    if (sorted != local) free(sorted);
+}
+
+static int ref_cmp(const void* a, const void* b) {
+    const struct seat_ref *x = a, *y = b;
+    if (x->event != y->event) return x->event < y->event ? -1 : 1;
+    return x->seat < y->seat ? -1 : x->seat > y->seat;
+}
+
+struct seat_ref* session_seats(struct session* s, uint32_t event, int* n) {
+    pthread_mutex_lock(lock_for(s->id));
+    struct seat_ref* out = s->num_seats ? malloc(s->num_seats * sizeof(*out)) : NULL;
+    *n = s->num_seats && !out ? -1 : 0;
+    for (int k = 0; out && k < s->num_seats; k++)
+        if (event == 0 || s->seats[k].event == event) out[(*n)++] = s->seats[k];
+    pthread_mutex_unlock(lock_for(s->id));
+    if (*n > 0) qsort(out, *n, sizeof(*out), ref_cmp);
+    if (*n <= 0) {
+        free(out);
+        out = NULL;
+    }
+    return out;
+}
@@ -0,0 +1,63 @@
+/*
+ * Client sessions
+ * Bookings belong to a session rather than to a socket, so a reused fd
+ * never inherits seats and a reconnecting client can get its seats back.
+ * Every connection starts in a fresh session; LOGIN returns its token and
+ * RESUME <token> moves a connection into an existing session. Seats record
+ * the session's 63-bit id.
+ * A token is the id and a SipHash-2-4 tag of it under a server key, both in
+ * hex, so tokens can't be forged and are verified without a lookup. With a
+ * journal directory the key is kept there and tokens survive restarts.
+ * Live sessions sit in a hash table keyed by id (O(1) lookup), one entry
+ * per session however many connections share it. Each entry also indexes
+ * the seats its session holds, maintained from every committed BOOK/CANCEL,
+ * so MINE and CANCEL ALL cost O(seats held) rather than O(venue). A session
+ * stays in the table while it has connections or seats.
+ */
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SESSION_TOKEN_LEN 32  /* hex characters, no terminator */
+
+struct seat_ref {
+    uint32_t event, seat;
+};
+
+/* Fields are guarded by the table lock of the session's bucket */
+struct session {
+    int64_t id;               /* positive; stored as the owner of its seats */
+    int conns;                /* connections attached */
+    int num_seats, seats_cap; /* seats held, in no particular order */
+    struct seat_ref* seats;
+    struct session* next;     /* hash chain */
+};
+
+/* Load or create key_dir/session.key; key_dir NULL uses a key for this run only */
+int session_init(const char* key_dir);
+
+/* A fresh session attached to the caller; NULL if out of memory */
+struct session* session_new(void);
+
+/* Attach to the session named by token; NULL if the token is not valid */
+struct session* session_resume(const char* token, size_t len);
+
+/* Detach; the session is dropped once it has neither connections nor seats */
+void session_release(struct session* s);
+
+void session_token(const struct session* s, char* token);
+int session_conns(struct session* s);
+
+/* Index upkeep for a committed BOOK/CANCEL by owner; runs while the seats are
+ * still held, so the index sees operations on a seat in order. -1 if out of memory */
+int session_index_add(int64_t owner, int event, const int* seat_nums, int n);
+void session_index_remove(int64_t owner, int event, const int* seat_nums, int n);
+
+/* Copy of the seats held in event (0 = every event), sorted by event then seat;
+ * NULL with *n = 0 if none, NULL with *n = -1 if out of memory */
+struct seat_ref* session_seats(struct session* s, uint32_t event, int* n);
+
+#endif
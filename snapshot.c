@@ -0,0 +1,202 @@
+/*
+ * Seat store snapshots and journal compaction, see snapshot.h
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "snapshot.h"
+
+#define ALIGN64(x) (((x) + 63) & ~(uint64_t)63)
+
+/* Shadow of one event's store, only touched by the compactor thread */
+struct shadow {
+    uint32_t id;
+    int num_seats, num_words;
+    uint64_t* bits;
+    int64_t* owners;
+};
+
+struct compactor {
+    char* dir;
+    struct journal* journal;
+    struct shadow* shadows;
+    int num_shadows;
+    uint64_t lsn;    /* the shadows hold every record up to here */
+    int interval;
+    pthread_t thread;
+};
+
+/* Map dir/snapshot read-only; NULL if there is none, MAP_FAILED if it is damaged */
+static struct snapshot_header* map_image(const char* dir, size_t* size) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/snapshot", dir);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat sb;
+    struct snapshot_header* h = MAP_FAILED;
+    if (fstat(fd, &sb) == 0 && sb.st_size >= (off_t)sizeof(*h))
+        h = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (h == MAP_FAILED) return MAP_FAILED;
+    *size = sb.st_size;
+    if (memcmp(h->magic, SNAPSHOT_MAGIC, 8) != 0 || h->size != (uint64_t)sb.st_size ||
+        sizeof(*h) + (uint64_t)h->num_events * sizeof(struct snapshot_event) > h->size) {
+        munmap(h, sb.st_size);
+        return MAP_FAILED;
+    }
+    return h;
+}
+
+/* Table entry for event id if its sections lie inside the image, else NULL */
+static const struct snapshot_event* image_event(const struct snapshot_header* h, uint32_t id, int num_seats) {
+    const struct snapshot_event* table = (const void*)(h + 1);
+    for (uint32_t i = 0; i < h->num_events; i++) {
+        const struct snapshot_event* e = &table[i];
+        if (e->id != id) continue;
+        uint64_t words = (e->num_seats + 63) / 64;
+        if ((int)e->num_seats != num_seats || e->bits_offset + words * 8 > h->size ||
+            e->owners_offset + (uint64_t)e->num_seats * 8 > h->size)
+            return NULL;
+        return e;
+    }
+    return NULL;
+}
+
+int snapshot_load(const char* dir, struct event* events, int num_events, uint64_t* lsn) {
+    size_t size;
+    struct snapshot_header* h = map_image(dir, &size);
+    *lsn = 0;
+    if (!h) return 0;
+    if (h == MAP_FAILED) return -1;
+    for (int i = 0; i < num_events; i++) {
+        const struct snapshot_event* e = image_event(h, events[i].id, events[i].store.num_seats);
+        if (e) seats_restore(&events[i].store, (const uint64_t*)((char*)h + e->bits_offset),
+                             (const int64_t*)((char*)h + e->owners_offset));
+    }
+    *lsn = h->lsn;
+    munmap(h, size);
+    return 0;
+}
+
+/* Replay a sealed record into the shadows; the journal only holds operations that succeeded */
+static int shadow_apply(void* arg, const struct journal_record* rec) {
+    struct compactor* cp = arg;
+    if (rec->event < 1 || rec->event > (uint32_t)cp->num_shadows) return -1;
+    struct shadow* s = &cp->shadows[rec->event - 1];
+    for (int i = 0; i < rec->num_seats; i++) {
+        if (rec->seats[i] < 1 || rec->seats[i] > (uint32_t)s->num_seats) continue;
+        int idx = rec->seats[i] - 1;
+        if (rec->op == SEAT_OP_BOOK) {
+            s->bits[idx / 64] |= 1ULL << (idx % 64);
+            s->owners[idx] = rec->owner;
+        } else {
+            s->bits[idx / 64] &= ~(1ULL << (idx % 64));
+            s->owners[idx] = NO_OWNER;
+        }
+    }
+    return 0;
+}
+
+static int write_all(int fd, const void* buf, size_t len) {
+    const char* p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Write the shadows as dir/snapshot: temporary file, sync, rename, sync the directory */
+static int write_image(struct compactor* cp) {
+    size_t table_size = cp->num_shadows * sizeof(struct snapshot_event);
+    struct snapshot_header h = { .lsn = cp->lsn, .num_events = cp->num_shadows };
+    struct snapshot_event* table = calloc(cp->num_shadows, sizeof(*table));
+    if (!table) return -1;
+    memcpy(h.magic, SNAPSHOT_MAGIC, 8);
+    uint64_t off = ALIGN64(sizeof(h) + table_size);
+    for (int i = 0; i < cp->num_shadows; i++) {
+        struct shadow* s = &cp->shadows[i];
+        table[i] = (struct snapshot_event){ s->id, s->num_seats, off, ALIGN64(off + s->num_words * 8) };
+        off = ALIGN64(table[i].owners_offset + (uint64_t)s->num_seats * 8);
+    }
+    h.size = off;
+
+    char tmp[PATH_MAX], path[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s/snapshot.tmp", cp->dir);
+    snprintf(path, sizeof(path), "%s/snapshot", cp->dir);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    int rc = fd < 0 || write_all(fd, &h, sizeof(h)) < 0 || write_all(fd, table, table_size) < 0 ? -1 : 0;
+    for (int i = 0; rc == 0 && i < cp->num_shadows; i++) {
+        struct shadow* s = &cp->shadows[i];
+        if (pwrite(fd, s->bits, s->num_words * 8, table[i].bits_offset) != (ssize_t)(s->num_words * 8) ||
+            pwrite(fd, s->owners, s->num_seats * 8, table[i].owners_offset) != (ssize_t)(s->num_seats * 8))
+            rc = -1;
+    }
+    if (rc == 0 && (ftruncate(fd, h.size) < 0 || fdatasync(fd) < 0 || rename(tmp, path) < 0 ||
+                    journal_sync_dir(cp->dir) < 0))
+        rc = -1;
+    if (fd >= 0) close(fd);
+    free(table);
+    return rc;
+}
+
+static void* compactor_run(void* arg) {
+    struct compactor* cp = arg;
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    for (;;) {
+        sleep(cp->interval);
+        journal_rotate(cp->journal);
+        uint64_t last = journal_replay_sealed(cp->journal, cp->lsn, shadow_apply, cp);
+        if (last == cp->lsn) continue;
+        cp->lsn = last;
+        if (write_image(cp) == 0) journal_discard(cp->journal, last);
+        else perror("Snapshot write failed");
+    }
+    return NULL;
+}
+
+int snapshot_start(const char* dir, struct journal* j, struct event* events, int num_events, int interval) {
+    struct compactor* cp = calloc(1, sizeof(*cp));
+    if (!cp || !(cp->dir = strdup(dir)) || !(cp->shadows = calloc(num_events, sizeof(struct shadow)))) return -1;
+    cp->journal = j;
+    cp->num_shadows = num_events;
+    cp->interval = interval;
+
+    /* The shadows start from the current image, not the live stores */
+    size_t size;
+    struct snapshot_header* h = map_image(dir, &size);
+    if (h == MAP_FAILED) h = NULL;
+    cp->lsn = h ? h->lsn : 0;
+    for (int i = 0; i < num_events; i++) {
+        struct shadow* s = &cp->shadows[i];
+        s->id = events[i].id;
+        s->num_seats = events[i].store.num_seats;
+        s->num_words = (s->num_seats + 63) / 64;
+        if (!(s->bits = calloc(s->num_words, 8)) || !(s->owners = malloc(s->num_seats * sizeof(int64_t)))) return -1;
+        const struct snapshot_event* e = h ? image_event(h, s->id, s->num_seats) : NULL;
+        if (e) {
+            memcpy(s->bits, (char*)h + e->bits_offset, s->num_words * 8);
+            memcpy(s->owners, (char*)h + e->owners_offset, s->num_seats * 8);
+        } else {
+            for (int k = 0; k < s->num_seats; k++) s->owners[k] = NO_OWNER;
+        }
+    }
+    if (h) munmap(h, size);
+    return pthread_create(&cp->thread, NULL, compactor_run, cp) == 0 ? 0 : -1;
+}
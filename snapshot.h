@@ -0,0 +1,48 @@
+/*
+ * Seat store snapshots and journal compaction
+ * A compactor thread keeps a private shadow copy of every event's bitmap
+ * and owner table and rolls it forward with the sealed journal segments,
+ * so an image is exact at its LSN and taking one never pauses or reads
+ * from the live stores. Each image is written to a temporary file, synced
+ * and renamed over dir/snapshot; then the segments it covers are deleted.
+ * On startup the image is mapped and copied into the stores, and only the
+ * journal records after its LSN are replayed.
+ * Image layout (mmap-able, every section 64-byte aligned):
+ *   struct snapshot_header
+ *   struct snapshot_event[num_events]
+ *   per event: booked bitmap (64 seats per word), owner table (int64 per seat)
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include "seats.h"
+#include "journal.h"
+
+#define SNAPSHOT_INTERVAL 60  /* default seconds between snapshots */
+#define SNAPSHOT_MAGIC "TKTSNAP1"
+
+struct snapshot_header {
+    char magic[8];
+    uint64_t lsn;          /* every journal record up to here is in the image */
+    uint64_t size;         /* file size, to reject truncated images */
+    uint32_t num_events;
+    uint32_t pad;
+};
+
+struct snapshot_event {
+    uint32_t id;
+    uint32_t num_seats;
+    uint64_t bits_offset;
+    uint64_t owners_offset;
+};
+
+/* Copy dir/snapshot into the stores of the events whose id and size match;
+ * *lsn is the image's LSN (0 without an image). Returns -1 on a damaged image. */
+int snapshot_load(const char* dir, struct event* events, int num_events, uint64_t* lsn);
+
+/* Start the compactor thread, snapshotting every interval seconds */
+int snapshot_start(const char* dir, struct journal* j, struct event* events, int num_events, int interval);
+
+#endif
@@ -35,6 +35,19 @@ cleanup() {
     echo -e "${GREEN}Cleanup complete.${NC}"
 }
 
+# Send commands (\n-separated) to the server on port $1, print its replies
+ask() {
+    exec 3<>/dev/tcp/127.0.0.1/$1 || return
+    echo -e "$2\nEXIT" >&3
+    timeout 5 cat <&3
+    exec 3<&-
+}
+
+# Session token from LOGIN on port $1
+login() {
+    ask $1 "LOGIN" | sed -n 's/.*SESSION \([0-9a-f]*\).*/\1/p'
+}
+
 # Trap Ctrl+C and cleanup
 trap cleanup EXIT INT TERM
 
@@ -112,6 +125,103 @@ echo -e "${YELLOW}Test 9: Try to book duplicate seats (1, 1)${NC}"
 echo -e "BOOK 2 1 1\nEXIT" | timeout 2 $CLIENT 2>/dev/null | grep "Server:"
 echo ""
 
+# Test 10: Best available in a venue whose last row is partial
+echo -e "${YELLOW}Test 10: 20 seats in rows of 6 - BOOK BEST 4 must not run past seat 20${NC}"
+$SERVER -p 8090 -n 20 -r 6 > /dev/null 2>&1 &
+PARTIAL_PID=$!
+sleep 1
+echo -e "BOOK 18 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18\nBOOK BEST 4\nBOOK BEST 2\nEXIT" |
+    timeout 2 $CLIENT 127.0.0.1 8090 2>/dev/null | grep "Server:"
+kill $PARTIAL_PID 2>/dev/null
+echo ""
+
+# Test 11: BOOK and CANCEL of one seat racing on two connections of one session
+echo -e "${YELLOW}Test 11: BOOK/CANCEL race on a resumed session (cas store) - the journal must replay to the same seats${NC}"
+JOURNAL_DIR=$(mktemp -d)
+$SERVER -p 8091 -s cas -j $JOURNAL_DIR > /dev/null 2>&1 &
+RACE_PID=$!
+sleep 1
+TOKEN=$(login 8091)
+(echo "RESUME $TOKEN"; for i in $(seq 300); do echo "BOOK 1 5"; done; echo EXIT) |
+    timeout 20 $CLIENT 127.0.0.1 8091 > /dev/null 2>&1 &
+BOOKER=$!
+(echo "RESUME $TOKEN"; for i in $(seq 300); do echo "CANCEL 1 5"; done; echo EXIT) |
+    timeout 20 $CLIENT 127.0.0.1 8091 > /dev/null 2>&1 &
+CANCELLER=$!
+wait $BOOKER $CANCELLER
+BEFORE=$(ask 8091 "AVAILABLE")
+{ kill -9 $RACE_PID && wait $RACE_PID; } 2>/dev/null
+$SERVER -p 8091 -s cas -j $JOURNAL_DIR > /dev/null 2>&1 &
+RACE_PID=$!
+sleep 1
+AFTER=$(ask 8091 "AVAILABLE")
+echo "$AFTER"
+if [ "$BEFORE" == "$AFTER" ]; then echo -e "${GREEN}PASS: same seats after replay${NC}"; else echo -e "${RED}FAIL: before restart: $BEFORE${NC}"; fi
+kill $RACE_PID 2>/dev/null
+rm -rf $JOURNAL_DIR
+echo ""
+
+# Test 12: CANCEL ALL gives back every seat of the session, and MINE then lists none
+echo -e "${YELLOW}Test 12: BOOK 3 seats and 2 more, CANCEL ALL, then MINE - should be MINE NONE${NC}"
+ask $PORT "BOOK 3 11 12 13\nBOOK 2 17 18\nMINE\nCANCEL ALL\nMINE"
+echo ""
+
+# Test 13: Crash recovery from the journal (group commit)
+echo -e "${YELLOW}Test 13: Book and cancel, kill -9 the server, restart it - AVAILABLE and MINE must survive${NC}"
+JOURNAL_DIR=$(mktemp -d)
+$SERVER -p 8092 -j $JOURNAL_DIR > /dev/null 2>&1 &
+CRASH_PID=$!
+sleep 1
+TOKEN=$(login 8092)
+ask 8092 "RESUME $TOKEN\nBOOK 4 2 4 6 8\nCANCEL 1 4\nBOOK 2 19 20" > /dev/null
+BEFORE=$(ask 8092 "AVAILABLE\nRESUME $TOKEN\nMINE")
+{ kill -9 $CRASH_PID && wait $CRASH_PID; } 2>/dev/null
+$SERVER -p 8092 -j $JOURNAL_DIR > /dev/null 2>&1 &
+CRASH_PID=$!
+sleep 1
+AFTER=$(ask 8092 "AVAILABLE\nRESUME $TOKEN\nMINE")
+echo "$AFTER"
+if [ "$BEFORE" == "$AFTER" ]; then echo -e "${GREEN}PASS: recovered state matches${NC}"; else echo -e "${RED}FAIL: before the crash: $BEFORE${NC}"; fi
+kill $CRASH_PID 2>/dev/null
+rm -rf $JOURNAL_DIR
+echo ""
+
+# Test 14: Sessions - seats belong to the session, not the connection
+echo -e "${YELLOW}Test 14: LOGIN and book, reconnect with RESUME - MINE and CANCEL work; a stranger cannot cancel${NC}"
+TOKEN=$(ask $PORT "BOOK 1 14\nLOGIN" | sed -n 's/.*SESSION \([0-9a-f]*\).*/\1/p')
+ask $PORT "CANCEL 1 14"
+ask $PORT "RESUME $TOKEN\nMINE\nCANCEL 1 14\nMINE"
+echo ""
+
+# Test 15: Seat holds expire through the timer wheel unless confirmed
+echo -e "${YELLOW}Test 15: HOLD with a 1s lifetime - CONFIRM books, an unconfirmed hold frees its seats on expiry${NC}"
+$SERVER -p 8093 -H 1 > /dev/null 2>&1 &
+HOLD_PID=$!
+sleep 1
+ask 8093 "HOLD 2 1 2\nCONFIRM 2 1 2\nHOLD 2 5 6\nBOOK 1 5\nMINE"
+sleep 2
+ask 8093 "BOOK 1 5\nAVAILABLE"
+kill $HOLD_PID 2>/dev/null
+echo ""
+
+# Test 16: Replication - a replica follows the primary, refuses writes, and takes them after PROMOTE
+echo -e "${YELLOW}Test 16: Primary and replica - same AVAILABLE, FAIL read-only replica, then PROMOTE${NC}"
+$SERVER -p 8094 -P 9094 > /dev/null 2>&1 &
+PRIMARY_PID=$!
+sleep 1
+$SERVER -p 8095 -F 127.0.0.1:9094 > /dev/null 2>&1 &
+REPLICA_PID=$!
+sleep 1
+ask 8094 "BOOK 3 1 2 3\nCANCEL 1 2\nBOOK 1 9" > /dev/null
+sleep 1
+PRIMARY_SEATS=$(ask 8094 "AVAILABLE")
+REPLICA_SEATS=$(ask 8095 "AVAILABLE")
+echo "$REPLICA_SEATS"
+if [ "$PRIMARY_SEATS" == "$REPLICA_SEATS" ]; then echo -e "${GREEN}PASS: replica matches the primary${NC}"; else echo -e "${RED}FAIL: primary has $PRIMARY_SEATS${NC}"; fi
+ask 8095 "BOOK 1 4\nPROMOTE\nBOOK 1 4"
+kill $PRIMARY_PID $REPLICA_PID 2>/dev/null
+echo ""
+
 # Show server log
 echo -e "${YELLOW}=== Server Log (last 20 lines) ===${NC}"
 tail -20 server.log
@@ -0,0 +1,105 @@
+/*
+ * Hierarchical timer wheel, see timer.h
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "timer.h"
+
+#define SLOT_MASK (TIMER_SLOTS - 1)
+
+static struct timer* wheel[TIMER_LEVELS][TIMER_SLOTS];
+static uint64_t current;   /* every timer due up to here has been collected */
+static _Atomic uint64_t now_tick;
+static pthread_mutex_t wheel_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t thread;
+
+/* File t by its distance from current; during a cascade it may be due right now (wheel_lock held) */
+static void place(struct timer* t) {
+    uint64_t delta = t->expires > current ? t->expires - current : 0;
+    int level = 0;
+    while (level < TIMER_LEVELS - 1 && delta >= 1ULL << (TIMER_SLOT_BITS * (level + 1))) level++;
+    /* Beyond the wheel's range it parks in the last reachable slot and is placed again from there */
+    uint64_t max = (1ULL << (TIMER_SLOT_BITS * TIMER_LEVELS)) - 1;
+    uint64_t at = current + (delta > max ? max : delta);
+    struct timer** slot = &wheel[level][(at >> (TIMER_SLOT_BITS * level)) & SLOT_MASK];
+    t->next = *slot;
+    *slot = t;
+}
+
+/* Move every timer of a level's slot down to the finer levels */
+static void cascade(int level, int index) {
+    struct timer* t = wheel[level][index];
+    wheel[level][index] = NULL;
+    while (t) {
+        struct timer* next = t->next;
+        place(t);
+        t = next;
+    }
+}
+
+/* Step to the next tick and detach the timers due in it (wheel_lock held) */
+static struct timer* advance(void) {
+    current++;
+    for (int level = 1; level < TIMER_LEVELS; level++) {
+        if ((current & ((1ULL << (TIMER_SLOT_BITS * level)) - 1)) != 0) break;
+        cascade(level, (current >> (TIMER_SLOT_BITS * level)) & SLOT_MASK);
+    }
+    struct timer* due = wheel[0][current & SLOT_MASK];
+    wheel[0][current & SLOT_MASK] = NULL;
+    return due;
+}
+
+static uint64_t elapsed_ticks(const struct timespec* start) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((ts.tv_sec - start->tv_sec) * 1000 + (ts.tv_nsec - start->tv_nsec) / 1000000) / TIMER_TICK_MS;
+}
+
+static void* timer_run(void* arg) {
+    (void)arg;
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    struct timespec tick = { 0, TIMER_TICK_MS * 1000000L };
+    for (;;) {
+        nanosleep(&tick, NULL);
+        /* Catch up tick by tick if the thread fell behind */
+        uint64_t target = elapsed_ticks(&start);
+        while (atomic_load_explicit(&now_tick, memory_order_relaxed) < target) {
+            pthread_mutex_lock(&wheel_lock);
+            struct timer* due = advance();
+            atomic_store_explicit(&now_tick, current, memory_order_release);
+            pthread_mutex_unlock(&wheel_lock);
+            while (due) {
+                struct timer* next = due->next;
+                due->fire(due);
+                due = next;
+            }
+        }
+    }
+    return NULL;
+}
+
+int timer_start(void) {
+    return pthread_create(&thread, NULL, timer_run, NULL) == 0 ? 0 : -1;
+}
+
+uint64_t timer_now(void) {
+    return atomic_load_explicit(&now_tick, memory_order_acquire);
+}
+
+void timer_add(struct timer* t, uint64_t ticks) {
+    pthread_mutex_lock(&wheel_lock);
+    t->expires = current + (ticks ? ticks : 1);
+    place(t);
+    pthread_mutex_unlock(&wheel_lock);
+}
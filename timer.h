@@ -0,0 +1,38 @@
+/*
+ * Hierarchical timer wheel
+ * Four levels of 64 slots: level 0 has one slot per tick, each slot of
+ * level k spans 64^k ticks. A timer goes into the coarsest level that still
+ * tells its slot apart; whenever level k wraps around, the next slot of
+ * level k+1 is cascaded down. Adding a timer is O(1), and each tick only
+ * touches the timers that expire or cascade in it, however many are
+ * pending. Timers are intrusive and cannot be cancelled: owners make the
+ * callback a no-op instead (a hold that was confirmed or released).
+ * One thread advances the wheel and runs the callbacks outside its lock.
+ */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+#define TIMER_TICK_MS 100
+#define TIMER_LEVELS 4
+#define TIMER_SLOT_BITS 6
+#define TIMER_SLOTS (1 << TIMER_SLOT_BITS)
+
+struct timer {
+    uint64_t expires;                 /* tick */
+    struct timer* next;
+    void (*fire)(struct timer* t);    /* runs on the wheel thread; may free t */
+};
+
+/* Start the wheel thread; ticks count from here */
+int timer_start(void);
+
+/* Current tick */
+uint64_t timer_now(void);
+
+/* Fire t once ticks have passed (at least one) */
+void timer_add(struct timer* t, uint64_t ticks);
+
+#endif
@@ -0,0 +1,140 @@
+/*
+ * Hot-path tracing, see trace.h
+ */
+
+#ifdef TRACE
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "trace.h"
+
+#define TRACE_MASK (TRACE_RING_SIZE - 1)
+
+struct trace_record {
+    const char* name;
+    uint64_t start;     /* ns, CLOCK_MONOTONIC */
+    uint32_t dur;       /* ns, saturated */
+    uint32_t tid;
+};
+
+/* One writer (the owning thread); dumps copy it and keep what was not overwritten meanwhile */
+struct trace_ring {
+    _Atomic uint64_t head;
+    _Atomic int free;       /* owning thread exited, the next new thread takes it over */
+    uint32_t tid;
+    struct trace_ring* next;
+    struct trace_record records[TRACE_RING_SIZE];
+};
+
+static _Atomic(struct trace_ring*) rings;   /* only ever pushed to */
+static __thread struct trace_ring* my_ring;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t dump_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void ring_release(void* arg) {
+    atomic_store_explicit(&((struct trace_ring*)arg)->free, 1, memory_order_release);
+}
+
+static void ring_key_create(void) {
+    pthread_key_create(&ring_key, ring_release);
+}
+
+/* Reuse the ring of an exited thread, so thread-per-client does not grow without bound */
+static struct trace_ring* ring_register(void) {
+    struct trace_ring* r;
+    pthread_once(&ring_key_once, ring_key_create);
+    for (r = atomic_load_explicit(&rings, memory_order_acquire); r; r = r->next) {
+        int expected = 1;
+        if (atomic_compare_exchange_strong(&r->free, &expected, 0)) break;
+    }
+    if (!r) {
+        if (!(r = calloc(1, sizeof(*r)))) return NULL;
+        r->next = atomic_load_explicit(&rings, memory_order_relaxed);
+        while (!atomic_compare_exchange_weak_explicit(&rings, &r->next, r, memory_order_release, memory_order_relaxed))
+            ;
+    }
+    r->tid = gettid();
+    pthread_setspecific(ring_key, r);
+    return my_ring = r;
+}
+
+uint64_t trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void trace_span_end(struct trace_span* s) {
+    uint64_t end = trace_now();
+    struct trace_ring* r = my_ring ? my_ring : ring_register();
+    if (!r) return;
+    uint64_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+    struct trace_record* rec = &r->records[h & TRACE_MASK];
+    rec->name = s->name;
+    rec->start = s->start;
+    rec->dur = end - s->start > UINT32_MAX ? UINT32_MAX : end - s->start;
+    rec->tid = r->tid;
+    atomic_store_explicit(&r->head, h + 1, memory_order_release);
+}
+
+int trace_dump(const char* path) {
+    static struct trace_record copy[TRACE_RING_SIZE];
+    FILE* f = fopen(path, "w");
+    if (!f) return -1;
+    pthread_mutex_lock(&dump_lock);
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    const char* sep = "\n";
+    for (struct trace_ring* r = atomic_load_explicit(&rings, memory_order_acquire); r; r = r->next) {
+        uint64_t end = atomic_load_explicit(&r->head, memory_order_acquire);
+        uint64_t begin = end > TRACE_RING_SIZE ? end - TRACE_RING_SIZE : 0;
+        for (uint64_t i = begin; i < end; i++) copy[i & TRACE_MASK] = r->records[i & TRACE_MASK];
+        /* Records the owner wrote over while we copied are torn: drop them */
+        atomic_thread_fence(memory_order_acquire);
+        uint64_t now = atomic_load_explicit(&r->head, memory_order_relaxed);
+        if (now + 1 > begin + TRACE_RING_SIZE) begin = now + 1 - TRACE_RING_SIZE;
+        for (uint64_t i = begin; i < end; i++) {
+            const struct trace_record* rec = &copy[i & TRACE_MASK];
+            fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u}", sep,
+                    rec->name, rec->start / 1e3, rec->dur / 1e3, (int)getpid(), rec->tid);
+            sep = ",\n";
+        }
+    }
+    fprintf(f, "\n]}\n");
+    pthread_mutex_unlock(&dump_lock);
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+static void* trace_signal_run(void* arg) {
+    sigset_t* set = arg;
+    char path[64];
+    snprintf(path, sizeof(path), "trace-%d.json", (int)getpid());
+    for (;;) {
+        int sig;
+        if (sigwait(set, &sig) != 0) continue;
+        if (trace_dump(path) == 0) printf("Trace written to %s\n", path);
+        else perror("Trace dump failed");
+        fflush(stdout);
+    }
+    return NULL;
+}
+
+int trace_start(void) {
+    static sigset_t set;
+    pthread_t thread;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR2);
+    if (pthread_sigmask(SIG_BLOCK, &set, NULL) != 0) return -1;
+    if (pthread_create(&thread, NULL, trace_signal_run, &set) != 0) return -1;
+    pthread_detach(thread);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,55 @@
+/*
+ * Hot-path tracing (build with -DTRACE: make trace)
+ * TRACE_SCOPE(name) times the rest of the enclosing block: it stamps the
+ * start, and a cleanup handler records (name, start, duration) into a
+ * per-thread ring when the block is left, whichever return it takes. Rings
+ * keep the last TRACE_RING_SIZE spans of each thread and are written out as
+ * Chrome trace JSON (chrome://tracing, Perfetto) on SIGUSR2 or the TRACE
+ * command. Without -DTRACE the macro expands to nothing and the functions
+ * are stubs, so the hot path carries no trace instructions at all.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <errno.h>
+#include <stdint.h>
+
+#define TRACE_RING_SIZE 8192   /* spans per thread, power of two */
+
+#ifdef TRACE
+
+struct trace_span {
+    const char* name;   /* a string literal: only the pointer is kept */
+    uint64_t start;
+};
+
+uint64_t trace_now(void);
+void trace_span_end(struct trace_span* s);
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) \
+    struct trace_span TRACE_CONCAT(trace_span_, __LINE__) __attribute__((cleanup(trace_span_end))) = { name, trace_now() }
+
+/* Dump on SIGUSR2; call before starting any other thread so they all inherit it blocked */
+int trace_start(void);
+
+/* Write every ring to path as Chrome trace JSON */
+int trace_dump(const char* path);
+
+#else
+
+#define TRACE_SCOPE(name) ((void)0)
+
+static inline int trace_start(void) { return 0; }
+
+static inline int trace_dump(const char* path) {
+    (void)path;
+    errno = ENOSYS;
+    return -1;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,144 @@
+/*
+ * Minimal io_uring wrapper, see uring.h
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "uring.h"
+
+static int setup(unsigned entries, struct io_uring_params* p) {
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+int uring_init(struct uring* r, unsigned entries, unsigned cq_entries) {
+    memset(r, 0, sizeof(*r));
+    /* Completions are only reaped by the thread that submits, so task work can wait for io_uring_enter */
+    struct io_uring_params p = { .flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER |
+                                          IORING_SETUP_DEFER_TASKRUN, .cq_entries = cq_entries };
+    r->fd = setup(entries, &p);
+    if (r->fd < 0 && errno == EINVAL) {
+        /* Kernels before 6.1 */
+        memset(&p, 0, sizeof(p));
+        p.flags = IORING_SETUP_CQSIZE;
+        p.cq_entries = cq_entries;
+        r->fd = setup(entries, &p);
+    }
+    if (r->fd < 0) return -1;
+
+    r->sq_map_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_map_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_map_size > r->sq_map_size) r->sq_map_size = r->cq_map_size;
+        r->cq_map_size = 0;
+    }
+    r->sq_map = mmap(NULL, r->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_map == MAP_FAILED) goto fail;
+    r->cq_map = r->sq_map;
+    if (r->cq_map_size) {
+        r->cq_map = mmap(NULL, r->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+                         IORING_OFF_CQ_RING);
+        if (r->cq_map == MAP_FAILED) goto fail;
+    }
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) goto fail;
+
+    char* sq = r->sq_map;
+    char* cq = r->cq_map;
+    r->sq_entries = p.sq_entries;
+    r->cq_entries = p.cq_entries;
+    r->sq_head = (_Atomic unsigned*)(sq + p.sq_off.head);
+    r->sq_tail = (_Atomic unsigned*)(sq + p.sq_off.tail);
+    r->sq_mask = *(unsigned*)(sq + p.sq_off.ring_mask);
+    r->cq_head = (_Atomic unsigned*)(cq + p.cq_off.head);
+    r->cq_tail = (_Atomic unsigned*)(cq + p.cq_off.tail);
+    r->cq_mask = *(unsigned*)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    unsigned* array = (unsigned*)(sq + p.sq_off.array);
+    for (unsigned i = 0; i < p.sq_entries; i++) array[i] = i;
+    r->sq_local = atomic_load_explicit(r->sq_tail, memory_order_relaxed);
+    r->enter_flags = IORING_ENTER_GETEVENTS;
+    return 0;
+
+fail:
+    uring_destroy(r);
+    return -1;
+}
+
+void uring_destroy(struct uring* r) {
+    if (r->sqes && r->sqes != MAP_FAILED) munmap(r->sqes, r->sqes_size);
+    if (r->cq_map_size && r->cq_map && r->cq_map != MAP_FAILED) munmap(r->cq_map, r->cq_map_size);
+    if (r->sq_map && r->sq_map != MAP_FAILED) munmap(r->sq_map, r->sq_map_size);
+    if (r->fd >= 0) close(r->fd);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+struct io_uring_sqe* uring_sqe(struct uring* r) {
+    unsigned head = atomic_load_explicit(r->sq_head, memory_order_acquire);
+    if (r->sq_local - head >= r->sq_entries) return NULL;
+    struct io_uring_sqe* sqe = &r->sqes[r->sq_local++ & r->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int uring_submit(struct uring* r, unsigned wait_nr) {
+    /* Whatever the kernel has not consumed yet, including leftovers of a short submit */
+    unsigned pending = r->sq_local - atomic_load_explicit(r->sq_head, memory_order_acquire);
+    atomic_store_explicit(r->sq_tail, r->sq_local, memory_order_release);
+    int ret = syscall(__NR_io_uring_enter, r->fd, pending, wait_nr, r->enter_flags, NULL, 0);
+    if (ret < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY)) return 0;
+    return ret < 0 ? -1 : ret;
+}
+
+struct io_uring_cqe* uring_peek(struct uring* r) {
+    unsigned head = atomic_load_explicit(r->cq_head, memory_order_relaxed);
+    if (head == atomic_load_explicit(r->cq_tail, memory_order_acquire)) return NULL;
+    return &r->cqes[head & r->cq_mask];
+}
+
+void uring_seen(struct uring* r) {
+    unsigned head = atomic_load_explicit(r->cq_head, memory_order_relaxed);
+    atomic_store_explicit(r->cq_head, head + 1, memory_order_release);
+}
+
+int uring_bufs_init(struct uring* r, struct uring_bufs* b, uint16_t bgid, unsigned count, unsigned size) {
+    memset(b, 0, sizeof(*b));
+    size_t ring_size = count * sizeof(struct io_uring_buf);
+    b->ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    b->base = mmap(NULL, (size_t)count * size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (b->ring == MAP_FAILED || b->base == MAP_FAILED) goto fail;
+    b->count = count;
+    b->size = size;
+    b->bgid = bgid;
+    struct io_uring_buf_reg reg = { .ring_addr = (uint64_t)(uintptr_t)b->ring, .ring_entries = count, .bgid = bgid };
+    if (syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) goto fail;
+    for (unsigned i = 0; i < count; i++) uring_buf_recycle(b, i);
+    return 0;
+
+fail:
+    if (b->ring != MAP_FAILED && b->ring) munmap(b->ring, ring_size);
+    if (b->base != MAP_FAILED && b->base) munmap(b->base, (size_t)count * size);
+    memset(b, 0, sizeof(*b));
+    return -1;
+}
+
+void uring_bufs_destroy(struct uring* r, struct uring_bufs* b) {
+    struct io_uring_buf_reg reg = { .bgid = b->bgid };
+    syscall(__NR_io_uring_register, r->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    munmap(b->ring, b->count * sizeof(struct io_uring_buf));
+    munmap(b->base, (size_t)b->count * b->size);
+    memset(b, 0, sizeof(*b));
+}
+
+void uring_buf_recycle(struct uring_bufs* b, unsigned bid) {
+    struct io_uring_buf* buf = &b->ring->bufs[b->tail & (b->count - 1)];
+    buf->addr = (uint64_t)(uintptr_t)uring_buf(b, bid);
+    buf->len = b->size;
+    buf->bid = bid;
+    __atomic_store_n(&b->ring->tail, ++b->tail, __ATOMIC_RELEASE);
+}
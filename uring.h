@@ -0,0 +1,59 @@
+/*
+ * Minimal io_uring wrapper over the raw system calls (no liburing)
+ * One ring per thread: submissions are queued locally and handed to the
+ * kernel in the same io_uring_enter that waits for completions, so a batch
+ * of sends, re-armed receives and accepts costs one system call. Provided
+ * buffer rings let a multishot receive pick its own buffer per completion.
+ */
+
+#ifndef URING_H
+#define URING_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <linux/io_uring.h>
+
+struct uring {
+    int fd;
+    unsigned sq_entries, cq_entries;
+    _Atomic unsigned *sq_head, *sq_tail, *cq_head, *cq_tail;
+    unsigned sq_mask, cq_mask;
+    unsigned sq_local;          /* next SQE to fill; published on submit */
+    unsigned enter_flags;       /* IORING_ENTER_GETEVENTS, plus what the setup flags require */
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* sq_map;
+    void* cq_map;
+    size_t sq_map_size, cq_map_size, sqes_size;
+};
+
+/* Provided buffers: count buffers of size bytes registered as group bgid */
+struct uring_bufs {
+    struct io_uring_buf_ring* ring;
+    char* base;
+    unsigned count, size;
+    uint16_t bgid, tail;
+};
+
+int uring_init(struct uring* r, unsigned entries, unsigned cq_entries);
+void uring_destroy(struct uring* r);
+
+/* A zeroed SQE, or NULL when the submission queue is full (submit first) */
+struct io_uring_sqe* uring_sqe(struct uring* r);
+
+/* Submit everything queued and wait for at least wait_nr completions; -1 on error */
+int uring_submit(struct uring* r, unsigned wait_nr);
+
+/* Completions: peek the next one (NULL if none), then mark it seen */
+struct io_uring_cqe* uring_peek(struct uring* r);
+void uring_seen(struct uring* r);
+
+int uring_bufs_init(struct uring* r, struct uring_bufs* b, uint16_t bgid, unsigned count, unsigned size);
+void uring_bufs_destroy(struct uring* r, struct uring_bufs* b);
+/* Give buffer bid back to the kernel */
+void uring_buf_recycle(struct uring_bufs* b, unsigned bid);
+static inline char* uring_buf(struct uring_bufs* b, unsigned bid) {
+    return b->base + (size_t)bid * b->size;
+}
+
+#endif